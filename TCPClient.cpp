@@ -1,5 +1,7 @@
 #include <stdio.h>      /* for printf() and fprintf() */
 #include <string.h>
+#include <cstring>
+#include <algorithm>
 
 #include "TCPClient.h"
 #include "version.h"
@@ -15,8 +17,12 @@ vbi_unham8(unsigned int c)
 
 TCPClient::TCPClient(PacketSubtitle* subtitle, PageList* pageList) :
     _pCmd(_cmd),
+    _mode(MODENORMAL),
+    _charCount(0),
     _newfor(subtitle),
-    _pageList(pageList)
+    _pageList(pageList),
+    _subtitle(subtitle),
+    _recvTime(0)
 {
     strcpy(_pageNumber,"10000");
 }
@@ -25,12 +31,6 @@ TCPClient::~TCPClient()
 {
 }
 
-void TCPClient::DieWithError(std::string errorMessage)
-{
-    perror(errorMessage.c_str());
-    exit(1);
-}
-
 void TCPClient::command(char* cmd, char* response)
 {
     char result[132];
@@ -41,6 +41,7 @@ void TCPClient::command(char* cmd, char* response)
 #ifdef DEBUG
     strcpy(response,"todo");
 #endif
+    std::lock_guard<std::mutex> lock(_pageList->GetSelectionMutex()); // another port may be selecting pages
     switch (cmd[0])
     {
         case 'D' : // D[<start>]<sign>[<steps>] - directory
@@ -140,11 +141,20 @@ void TCPClient::command(char* cmd, char* response)
             status=0; // @todo Line number out of range =1
             //sprintf(result, "L Command Page=%.*s row=%d ptr=%s\n\r", 5, _pageNumber, row, ptr);
             std::cerr << "[TCPClient::command] L command starts" << std::endl;
+            std::vector<TTXPageStream*> edited; // pages in the list, which own the files. A subpage of a carousel has none
             for (TTXPageStream* p=_pageList->FirstPage(); p!=nullptr; p=_pageList->NextSelectedPage())
             {
                 TTXPageStream* page=p;
                 std::cerr << "[TCPClient::command] L command applied to page=" << std::hex << page->GetPageNumber() << std::endl;
                 page->SetRow(row, ptr);
+                TTXPageStream* root=_pageList->GetIteratorPage();
+                if (std::find(edited.begin(), edited.end(), root)==edited.end())
+                    edited.push_back(root);
+            }
+            for (unsigned int i=0; i<edited.size(); i++)
+            {
+                if (!edited[i]->GetSourcePage().empty()) // uploaded pages have no file
+                    _pageList->GetPageWriter()->Write(edited[i]->GetSourcePage(), edited[i]->GetTTI()); // saved later, on the writer thread
             }
             break;
         }
@@ -225,6 +235,14 @@ void TCPClient::command(char* cmd, char* response)
             }
             break;
         }
+        case 'S' : // S - Subtitle latency report
+        {
+            if (_subtitle)
+                snprintf(result,120,"S %s ",_subtitle->LatencyReport().c_str()); // leave room for the status
+            else
+                strcpy(result,"S no subtitle service ");
+            break;
+        }
         case 'T' :;
         {
             strcpy(result,"T not implemented\n\r");
@@ -242,7 +260,7 @@ void TCPClient::command(char* cmd, char* response)
         }
         default:
         {
-            sprintf(result,"Command not recognised cmd=%s\n\r",cmd);
+            snprintf(result,sizeof(result),"Command not recognised cmd=%s\n\r",cmd);
         }
     }
     sprintf(response,"%s%1d\n\r",result,status);
@@ -266,28 +284,27 @@ void TCPClient::clearCmd(void)
  */
 void TCPClient::addChar(char ch, char* response)
 {
-    static int mode=MODENORMAL;
-    static int charCount=0; // Used to accumulate Newfor
-
     response[0]=0;
-    switch (mode)
+    switch (_mode)
     {
         case MODENORMAL :
         {
             _pkt=_cmd;
             if (_pCmd==_cmd) // On the first character we check if it is a Softel
             {
+                if (ch==0x0e || ch==0x0f || ch==0x10 || ch==0x18)
+                    _newfor.Received(_recvTime); // the start of a subtitle, for latency measurement
                 switch (ch)
                 {
                     case 0x0e :
                     {
-                        mode=MODESOFTELPAGEINIT; // page 0nnn
-                        charCount=4;
+                        _mode=MODESOFTELPAGEINIT; // page 0nnn
+                        _charCount=4;
                         break;
                     }
                     case 0x0f :
                     {
-                        mode=MODEGETROWCOUNT; // n and n*(rowhigh, rowlow, 40 bytes)
+                        _mode=MODEGETROWCOUNT; // n and n*(rowhigh, rowlow, 40 bytes)
                         break;
                     }
                     case 0x10 :
@@ -295,7 +312,7 @@ void TCPClient::addChar(char ch, char* response)
                         // Put the subtitle on air immediately
                         _newfor.SubtitleOnair(response);
                         clearCmd();
-                        mode=MODENORMAL;
+                        _mode=MODENORMAL;
                         return;
                     }
                     case 0x18 :
@@ -304,29 +321,27 @@ void TCPClient::addChar(char ch, char* response)
                         _newfor.SubtitleOffair();
                         strcpy(response, "[addChar]Clear");
                         clearCmd();
-                        mode=MODENORMAL;
+                        _mode=MODENORMAL;
                         return;
                     }
                 }
             } // If first character
             if (ch!='\n' && ch!='\r')
             {
-                *_pCmd++=ch;
+                if (_pCmd<_cmd+MAXLINE) // the rest of an overlong line is dropped
+                    *_pCmd++=ch;
                 *_pCmd=0;
                 if (response) response[0]=0;
             }
             else
             {
                 // Got a complete non-newfor command
-                std::stringstream ss;
-                ss << "[TCPClient::addChar] finished cmd='" << strlen(_cmd) << "\n";
-                std::cerr << ss.str();
                 if (strlen(_cmd))  // Avoid this being called twice by \n\r combinations
                 {
                     command(_cmd, response);
                 }
                 clearCmd();
-                mode=MODENORMAL;
+                _mode=MODENORMAL;
             }
             break;
         }
@@ -335,15 +350,15 @@ void TCPClient::addChar(char ch, char* response)
         {
             // @todo If a nybble fails deham or isn't in range we should return nack
             *_pCmd++=ch;
-            charCount--;
+            _charCount--;
             // The last time around we have the completed command
-            if (!charCount)
+            if (!_charCount)
             {
                 int page=_newfor.SoftelPageInit(_cmd);
                 sprintf(response,"[addChar]MODESOFTELPAGEINIT Set page=%03x",page);
                 // Now that we are done, set up for the next command
                 clearCmd();
-                mode=MODENORMAL;
+                _mode=MODENORMAL;
             }
             break;
         }
@@ -353,14 +368,14 @@ void TCPClient::addChar(char ch, char* response)
             char* p=_cmd;
             _row=_newfor.GetRowCount(p);
             sprintf(response,"[TCPClient::addChar] MODEGETROWCOUNT =%d\n",_row);
-            mode=MODESUBTITLEDATAHIGHNYBBLE;
+            _mode=MODESUBTITLEDATAHIGHNYBBLE;
             break;
         }
         case MODESUBTITLEDATAHIGHNYBBLE:
         {
             *_pCmd++=ch;
-            charCount=40;
-            mode=MODESUBTITLEDATALOWNYBBLE;
+            _charCount=40;
+            _mode=MODESUBTITLEDATALOWNYBBLE;
             _rowAddress=vbi_unham8(ch)*16; // @todo Check validity
             break;
         }
@@ -369,7 +384,7 @@ void TCPClient::addChar(char ch, char* response)
             *_pCmd++=ch;
             _rowAddress+=vbi_unham8(ch); // @todo Check validity
             sprintf(response,"[addChar]MODESUBTITLEDATALOWNYBBLE _rowAddress=%d\n",_rowAddress);
-            mode=MODEGETROW;
+            _mode=MODEGETROW;
             _pkt=_pCmd; // Save the start of this packet
             break;
         }
@@ -377,8 +392,8 @@ void TCPClient::addChar(char ch, char* response)
         {
             *_pCmd++=ch;
             *_pCmd=0; // cap off the string
-            charCount--;
-            if (charCount<=0) // End of line?
+            _charCount--;
+            if (_charCount<=0) // End of line?
             {
                 sprintf(response,"[TCPClient::addChar] MODEGETROW _rowAddress=%d _pkt=%s\n",_rowAddress,_pkt);
                 // Generate the teletext packet
@@ -386,13 +401,13 @@ void TCPClient::addChar(char ch, char* response)
                 if (_row>1) // Next row
                 {
                     _row--;
-                    mode=MODESUBTITLEDATAHIGHNYBBLE;
+                    _mode=MODESUBTITLEDATAHIGHNYBBLE;
                 }
                 else // Last row
                 {
                     // Now that we are done, set up for the next command
                     sprintf(response,"subtitle data complete\n");
-                    mode=MODENORMAL;
+                    _mode=MODENORMAL;
                     clearCmd();
                 }
             }
@@ -402,40 +417,31 @@ void TCPClient::addChar(char ch, char* response)
 }
 
 
-/** HandleTCPClient
- *  Commands come in here.
- * They need to be accumulated and when we have a complete line, send it to a command interpreter.
+/** Receive
+ * Commands come in here a buffer at a time.
+ * Rows of subtitle data are copied in one go. Everything else goes through addChar.
  */
-void TCPClient::Handler(int clntSocket)
+void TCPClient::Receive(const char* data, int length, std::string* responses)
 {
-    char echoBuffer[RCVBUFSIZE];        /* Buffer for echo string */
     char response[RCVBUFSIZE];
-    int recvMsgSize;                    /* Size of received message */
-    int i;
-    clearCmd();
-
-    /* Send received string and receive again until end of transmission */
-    for (recvMsgSize=1;recvMsgSize > 0;)      /* zero indicates end of transmission */
+    _recvTime=PacketSubtitle::Timestamp();
+    for (int i=0;i<length;)
     {
-        /* See if there is more data to receive */
-        if ((recvMsgSize = recv(clntSocket, echoBuffer, RCVBUFSIZE, 0)) < 0)
-            DieWithError("recv() failed");
-        for (i=0;i<recvMsgSize;i++)
+        if (_mode==MODEGETROW && _charCount>1)
         {
-            addChar(echoBuffer[i], response);
-            if (*response)
-                send(clntSocket, response, strlen(response), 0);
+            // all but the last character of the row, which addChar takes to finish the row
+            int n=std::min(_charCount-1, length-i);
+            std::memcpy(_pCmd, data+i, n);
+            _pCmd+=n;
+            *_pCmd=0;
+            _charCount-=n;
+            i+=n;
+            continue;
         }
-        /* Echo message back to client */
-        //if (send(clntSocket, echoBuffer, recvMsgSize, 0) != recvMsgSize)
-        //    DieWithError("send() failed");
+        addChar(data[i++], response);
+        if (*response)
+            responses->append(response);
     }
-
-#ifdef WIN32
-    closesocket(clntSocket);
-#else
-    close(clntSocket);    /* Close client socket */
-#endif // WIN32
 }
 
 /** Validate a page identity
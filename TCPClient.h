@@ -35,20 +35,17 @@
  * Connect to the IP address and port of your VBIT "telnet 192.168.1.2 5570"
  * Type Y<enter>
  * Should reply "VBIT620"
+ * S<enter> replies with the subtitle latencies of this port's service since it started:
+ * the number of subtitles timed, then p50, p99 and max in microseconds of the input,
+ * header and total latencies. See PacketSubtitle::LatencyReport.
  * Use CTRL-] to exit telnet
 **/
 
 #ifndef _TCPCLIENT_H_
 #define _TCPCLIENT_H_
 
-#ifdef WIN32
-#include <winsock2.h>
-#else
-#include <sys/socket.h> /* for recv() and send() */
-#include <unistd.h>     /* for close() */
-#endif
-
 #include <stdint.h>
+#include <string>
 
 #include "pagelist.h"
 #include "newfor.h"
@@ -62,12 +59,22 @@ namespace vbit
         public:
             TCPClient(PacketSubtitle* subtitle, ttx::PageList* pageList);
             ~TCPClient();
-            void Handler(int clntSocket);
+
+            /**
+             * @brief Parse a buffer of data from the client
+             * Commands may be split across calls in any way. Each connection has its own TCPClient
+             * so that its parser state is kept from one call to the next.
+             * @param data Bytes as received
+             * @param length Number of bytes
+             * @param responses Replies to send back to the client are appended to this
+             */
+            void Receive(const char* data, int length, std::string* responses);
 
         private:
             // Constants
-            static const uint8_t MAXCMD=128;
-            static const uint8_t RCVBUFSIZE=132;   /* Size of receive buffer */
+            static const uint16_t MAXCMD=300;      // A Newfor subtitle of seven rows is 296 bytes
+            static const uint8_t MAXLINE=100;      // Longest XTP620 command line, so that its reply fits in RCVBUFSIZE
+            static const uint8_t RCVBUFSIZE=132;   /* Size of a response */
 
             // Normal command mode
             static const uint8_t MODENORMAL=0;
@@ -86,6 +93,8 @@ namespace vbit
             // Variables
             char _cmd[MAXCMD];  // command buffer
             char* _pCmd;        // Pointer into the command buffer
+            int _mode;          // Command parser state. Each command port has its own
+            int _charCount;     // Used to accumulate Newfor
             Newfor _newfor;
             int _row;           // Row counter
             char* _pkt;         // A teletext packet (one row of VBI)
@@ -97,13 +106,14 @@ namespace vbit
             char _pageNumber[6];
 
             ttx::PageList* _pageList; // List of pages for XTP620 commands to access
+            PacketSubtitle* _subtitle; // The subtitle service this port feeds
+            uint64_t _recvTime; // PacketSubtitle::Timestamp() of the last recv, for subtitle latency
 
 
             // Functions
             void clearCmd(void);
             void addChar(char ch, char* response);
             void command(char* cmd, char* response); // Handles XPT620 commands
-            void DieWithError(std::string errorMessage);
 
             /** Validate a page identity of the form mppss
              *  Where:
@@ -0,0 +1,155 @@
+/** AncSink
+ */
+#include "ancsink.h"
+
+#include <cstring>
+
+#include "coding.h"
+
+using namespace vbit;
+
+/** @return An 8 bit value as a 10 bit ancillary data word with even parity in bit 8 and its inverse in bit 9 */
+static uint16_t ancWord(uint16_t value)
+{
+    value &= 0xff;
+    uint16_t parity = value;
+    parity ^= parity >> 4;
+    parity ^= parity >> 2;
+    parity ^= parity >> 1;
+    parity &= 1;
+    return value | (parity << 8) | ((parity ^ 1) << 9);
+}
+
+/** SDP bytes before the packets: identifier, length, format code and five descriptors */
+#define OP47_HEADER_LENGTH 9
+/** SDP bytes after the packets: footer identifier, sequence counter and checksum */
+#define OP47_FOOTER_LENGTH 4
+/** ANC words around the user data words: ADF, DID, SDID, DC and checksum */
+#define ANC_OVERHEAD_WORDS 7
+
+AncSink::AncSink(std::string destination, Backpressure policy, unsigned int bufferFields, uint16_t linesPerField, Standard standard) :
+    OutputSink((standard == OP47) ? "op47" : "st2031", destination, policy, bufferFields, MaxFrameLength(linesPerField, standard)),
+    _standard(standard),
+    _sequence(0),
+    _sdpLines(0)
+{
+    if (_standard == OP47 && linesPerField > 16)
+    {
+        std::stringstream ss;
+        ss << "[AncSink::AncSink] OP-47 can only carry lines 7 to 22, the last " << (linesPerField - 16) << " lines of each field will be left out\n";
+        std::cerr << ss.str();
+    }
+}
+
+AncSink::~AncSink()
+{
+
+}
+
+unsigned int AncSink::MaxFrameLength(uint16_t linesPerField, Standard standard)
+{
+    unsigned int lines = linesPerField * 2;
+    if (standard == OP47)
+    {
+        unsigned int sdps = 2 * ((linesPerField + OP47_LINES_PER_SDP - 1) / OP47_LINES_PER_SDP); // SDPs don't span fields
+        return (sdps * (OP47_HEADER_LENGTH + OP47_FOOTER_LENGTH + ANC_OVERHEAD_WORDS) + lines * PACKETSIZE) * 2;
+    }
+    return lines * (46 + ANC_OVERHEAD_WORDS) * 2;
+}
+
+void AncSink::_writeAnc(uint8_t did, uint8_t sdid, const uint8_t* udw, unsigned int count)
+{
+    unsigned int words = count + ANC_OVERHEAD_WORDS;
+    uint8_t* p = _claim(words * 2);
+    if (!p)
+        return;
+
+    uint16_t anc[255 + ANC_OVERHEAD_WORDS];
+    unsigned int n = 0;
+    anc[n++] = 0x000; // ancillary data flag
+    anc[n++] = 0x3ff;
+    anc[n++] = 0x3ff;
+    anc[n++] = ancWord(did);
+    anc[n++] = ancWord(sdid);
+    anc[n++] = ancWord(count);
+    for (unsigned int i = 0; i < count; i++)
+        anc[n++] = ancWord(udw[i]);
+
+    uint16_t checksum = 0; // 9 bit sum of everything from the DID to the last user data word
+    for (unsigned int i = 3; i < n; i++)
+        checksum += anc[i] & 0x1ff;
+    checksum &= 0x1ff;
+    anc[n++] = checksum | ((~checksum & 0x100) << 1);
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        p[i * 2] = anc[i] & 0xff;
+        p[i * 2 + 1] = anc[i] >> 8;
+    }
+    _commit(words * 2);
+}
+
+void AncSink::_flushSDP()
+{
+    if (_sdpLines == 0)
+        return;
+
+    uint8_t sdp[OP47_HEADER_LENGTH + OP47_LINES_PER_SDP * PACKETSIZE + OP47_FOOTER_LENGTH];
+    unsigned int length = OP47_HEADER_LENGTH + _sdpLines * PACKETSIZE + OP47_FOOTER_LENGTH;
+    unsigned int n = 0;
+
+    sdp[n++] = 0x51; // identifier
+    sdp[n++] = 0x15;
+    sdp[n++] = length;
+    sdp[n++] = 0x02; // format code: WST teletext
+    for (unsigned int i = 0; i < OP47_LINES_PER_SDP; i++)
+        sdp[n++] = (i < _sdpLines) ? _sdpDescriptors[i] : 0x00; // unused descriptors are zero
+    for (unsigned int i = 0; i < _sdpLines; i++, n += PACKETSIZE)
+        std::memcpy(sdp + n, _sdpPackets[i], PACKETSIZE);
+    sdp[n++] = 0x74; // footer identifier
+    sdp[n++] = _sequence >> 8;
+    sdp[n++] = _sequence & 0xff;
+    _sequence++;
+
+    uint8_t sum = 0;
+    for (unsigned int i = 0; i < n; i++)
+        sum += sdp[i];
+    sdp[n++] = -sum; // every byte of the SDP adds up to zero
+
+    _writeAnc(ANC_OP47_DID, ANC_OP47_SDID, sdp, n);
+    _sdpLines = 0;
+}
+
+void AncSink::AddPacket(std::array<uint8_t, PACKETSIZE>* packet, uint16_t line, uint8_t field)
+{
+    bool firstField = !(field & 1); // same field parity as PES output
+
+    if (line == 0)
+    {
+        // each SDP only describes lines of one field
+        if (_standard == OP47)
+            _flushSDP();
+        if (firstField)
+            _endField(); // a new frame is starting so the last one is complete
+    }
+
+    if (_standard == OP47)
+    {
+        if (line > 15)
+            return; // no line number for it
+
+        _sdpDescriptors[_sdpLines] = (firstField ? 0x80 : 0x00) | (line + 7);
+        std::memcpy(_sdpPackets[_sdpLines], packet->data(), PACKETSIZE);
+        if (++_sdpLines == OP47_LINES_PER_SDP)
+            _flushSDP();
+    }
+    else
+    {
+        uint8_t unit[46];
+        unit[0] = 0x02; // data_unit_id (EBU teletext non-subtitle)
+        unit[1] = 0x2c; // data_unit_length (44 bytes)
+        unit[2] = ((firstField ? 1 : 0) << 5) | ((line > 15) ? 0 : (line + 7)); // field parity and line number, or undefined
+        ReverseBits(unit + 3, packet->data() + 2, 43); // framing code and packet, bits reversed as in PES
+        _writeAnc(ANC_ST2031_DID, ANC_ST2031_SDID, unit, 46);
+    }
+}
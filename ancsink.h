@@ -0,0 +1,82 @@
+#ifndef _ANCSINK_H_
+#define _ANCSINK_H_
+
+#include <vector>
+
+#include "outputsink.h"
+
+/**
+ * Output sink for teletext in SDI ancillary data packets.
+ *
+ * OP-47 (SMPTE RDD 8) packs up to five teletext lines into each Subtitling Distribution
+ * Packet with DID 0x43 and SDID 0x02. Each SDP holds its identifier 0x51 0x15, its length, a
+ * format code of 0x02 and five line descriptors (field bit and line number), then the 45 byte
+ * packets, a footer of 0x74, a 16 bit sequence counter and a checksum that makes its bytes
+ * sum to zero. An SDP never holds lines from two fields.
+ *
+ * SMPTE 2031 carries each line in its own packet with DID 0x41 and SDID 0x07, holding an
+ * EN 301 775 data unit laid out as in PES output.
+ *
+ * Line numbers come from the service's line counter, so the first line of a field is line 7
+ * (320 in the second field). OP-47 can only describe lines 7 to 22 so any lines after those are
+ * left out of its packets.
+ *
+ * The output is one frame at a time, i.e. two fields. Each ancillary packet is written as 10 bit
+ * words, each in a 16 bit little endian word, starting with the ancillary data flag 0x000 0x3FF 0x3FF
+ * and ending with the checksum word. Every word except the data flag carries its parity in bits 8 and 9.
+ */
+
+#define ANC_OP47_DID 0x43
+#define ANC_OP47_SDID 0x02
+#define ANC_ST2031_DID 0x41
+#define ANC_ST2031_SDID 0x07
+#define OP47_LINES_PER_SDP 5
+
+namespace vbit
+{
+    class AncSink : public OutputSink
+    {
+        public:
+            enum Standard
+            {
+                OP47,
+                ST2031
+            };
+
+            /** Constructor
+             * @param standard How to package the lines
+             * Other parameters as OutputSink, except that bufferFields counts frames
+             */
+            AncSink(std::string destination, Backpressure policy, unsigned int bufferFields, uint16_t linesPerField, Standard standard);
+
+            /** Default destructor */
+            virtual ~AncSink();
+
+            void AddPacket(std::array<uint8_t, PACKETSIZE>* packet, uint16_t line, uint8_t field) override;
+
+            /** @return Largest number of bytes for the ancillary packets of one frame */
+            static unsigned int MaxFrameLength(uint16_t linesPerField, Standard standard);
+
+        private:
+            Standard _standard;
+            uint16_t _sequence; // OP-47 footer sequence counter
+
+            // OP-47 lines waiting to fill an SDP
+            unsigned int _sdpLines;
+            uint8_t _sdpDescriptors[OP47_LINES_PER_SDP];
+            uint8_t _sdpPackets[OP47_LINES_PER_SDP][PACKETSIZE];
+
+            /** Write one ancillary packet to the frame
+             * @param did Data identifier
+             * @param sdid Secondary data identifier
+             * @param udw User data words
+             * @param count Number of user data words
+             */
+            void _writeAnc(uint8_t did, uint8_t sdid, const uint8_t* udw, unsigned int count);
+
+            /** Package the waiting OP-47 lines into an SDP */
+            void _flushSDP();
+    };
+}
+
+#endif // _ANCSINK_H_
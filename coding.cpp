@@ -0,0 +1,306 @@
+/** Parity, Hamming 8/4 and Hamming 24/18 encoding
+ */
+#include "coding.h"
+#include "tables.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CODING_X86
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CODING_NEON
+#endif
+
+using namespace vbit;
+
+/* Plain table lookups. Also used for the bytes left over after the vector loops. */
+
+static void parityScalar(uint8_t* data, unsigned int length)
+{
+    for (unsigned int i=0;i<length;i++)
+    {
+        data[i]=OddParityTable[data[i] & 0x7f];
+    }
+}
+
+static void hammingScalar(uint8_t* data, unsigned int length)
+{
+    for (unsigned int i=0;i<length;i++)
+    {
+        data[i]=Hamming8EncodeTable[data[i] & 0x0f];
+    }
+}
+
+static void reverseScalar(uint8_t* dest, const uint8_t* src, unsigned int length)
+{
+    for (unsigned int i=0;i<length;i++)
+    {
+        dest[i]=ReverseByteTab[src[i]];
+    }
+}
+
+/* Each nibble reversed, for reversing bytes a nibble at a time with a shuffle */
+static const uint8_t ReverseNibbleLow[16] = {0x00,0x08,0x04,0x0c,0x02,0x0a,0x06,0x0e,0x01,0x09,0x05,0x0d,0x03,0x0b,0x07,0x0f};
+static const uint8_t ReverseNibbleHigh[16] = {0x00,0x80,0x40,0xc0,0x20,0xa0,0x60,0xe0,0x10,0x90,0x50,0xd0,0x30,0xb0,0x70,0xf0};
+
+#ifdef CODING_X86
+
+/* The parity of a 7 bit value is found by folding it in half with exclusive ors until bit 0 holds
+ * the parity of all the bits. There are no byte shifts so 16 bit shifts are used and the bits that
+ * cross into the neighbouring byte are masked off. Bit 7 is then set if the parity was even. */
+
+__attribute__((target("sse2")))
+static void paritySSE2(uint8_t* data, unsigned int length)
+{
+    const __m128i m7f = _mm_set1_epi8(0x7f);
+    const __m128i m0f = _mm_set1_epi8(0x0f);
+    const __m128i m03 = _mm_set1_epi8(0x03);
+    const __m128i m01 = _mm_set1_epi8(0x01);
+    unsigned int i=0;
+    for (;i+16<=length;i+=16)
+    {
+        __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*)(data+i)), m7f);
+        __m128i t = _mm_xor_si128(v, _mm_and_si128(_mm_srli_epi16(v, 4), m0f));
+        t = _mm_xor_si128(t, _mm_and_si128(_mm_srli_epi16(t, 2), m03));
+        t = _mm_xor_si128(t, _mm_srli_epi16(t, 1)); // only bit 0 is used so no mask needed
+        __m128i even = _mm_andnot_si128(t, m01);
+        v = _mm_or_si128(v, _mm_slli_epi16(even, 7));
+        _mm_storeu_si128((__m128i*)(data+i), v);
+    }
+    parityScalar(data+i, length-i);
+}
+
+/* Hamming 8/4 has only 16 codes so a byte shuffle does the table lookup for every byte at once */
+
+__attribute__((target("ssse3")))
+static void hammingSSSE3(uint8_t* data, unsigned int length)
+{
+    const __m128i table = _mm_loadu_si128((const __m128i*)Hamming8EncodeTable);
+    const __m128i m0f = _mm_set1_epi8(0x0f);
+    unsigned int i=0;
+    for (;i+16<=length;i+=16)
+    {
+        __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*)(data+i)), m0f);
+        _mm_storeu_si128((__m128i*)(data+i), _mm_shuffle_epi8(table, v));
+    }
+    hammingScalar(data+i, length-i);
+}
+
+/* The low nibble of each byte becomes the reversed high nibble and vice versa */
+
+__attribute__((target("ssse3")))
+static void reverseSSSE3(uint8_t* dest, const uint8_t* src, unsigned int length)
+{
+    const __m128i low = _mm_loadu_si128((const __m128i*)ReverseNibbleLow);
+    const __m128i high = _mm_loadu_si128((const __m128i*)ReverseNibbleHigh);
+    const __m128i m0f = _mm_set1_epi8(0x0f);
+    unsigned int i=0;
+    for (;i+16<=length;i+=16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src+i));
+        __m128i r = _mm_or_si128(_mm_shuffle_epi8(high, _mm_and_si128(v, m0f)), _mm_shuffle_epi8(low, _mm_and_si128(_mm_srli_epi16(v, 4), m0f)));
+        _mm_storeu_si128((__m128i*)(dest+i), r);
+    }
+    reverseScalar(dest+i, src+i, length-i);
+}
+
+__attribute__((target("avx2")))
+static void parityAVX2(uint8_t* data, unsigned int length)
+{
+    const __m256i m7f = _mm256_set1_epi8(0x7f);
+    const __m256i m0f = _mm256_set1_epi8(0x0f);
+    const __m256i m03 = _mm256_set1_epi8(0x03);
+    const __m256i m01 = _mm256_set1_epi8(0x01);
+    unsigned int i=0;
+    for (;i+32<=length;i+=32)
+    {
+        __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(data+i)), m7f);
+        __m256i t = _mm256_xor_si256(v, _mm256_and_si256(_mm256_srli_epi16(v, 4), m0f));
+        t = _mm256_xor_si256(t, _mm256_and_si256(_mm256_srli_epi16(t, 2), m03));
+        t = _mm256_xor_si256(t, _mm256_srli_epi16(t, 1));
+        __m256i even = _mm256_andnot_si256(t, m01);
+        v = _mm256_or_si256(v, _mm256_slli_epi16(even, 7));
+        _mm256_storeu_si256((__m256i*)(data+i), v);
+    }
+    paritySSE2(data+i, length-i); // a 40 byte row leaves 8 bytes
+}
+
+__attribute__((target("avx2")))
+static void hammingAVX2(uint8_t* data, unsigned int length)
+{
+    const __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)Hamming8EncodeTable));
+    const __m256i m0f = _mm256_set1_epi8(0x0f);
+    unsigned int i=0;
+    for (;i+32<=length;i+=32)
+    {
+        __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(data+i)), m0f);
+        _mm256_storeu_si256((__m256i*)(data+i), _mm256_shuffle_epi8(table, v));
+    }
+    hammingSSSE3(data+i, length-i);
+}
+
+__attribute__((target("avx2")))
+static void reverseAVX2(uint8_t* dest, const uint8_t* src, unsigned int length)
+{
+    const __m256i low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)ReverseNibbleLow));
+    const __m256i high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)ReverseNibbleHigh));
+    const __m256i m0f = _mm256_set1_epi8(0x0f);
+    unsigned int i=0;
+    for (;i+32<=length;i+=32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src+i));
+        __m256i r = _mm256_or_si256(_mm256_shuffle_epi8(high, _mm256_and_si256(v, m0f)), _mm256_shuffle_epi8(low, _mm256_and_si256(_mm256_srli_epi16(v, 4), m0f)));
+        _mm256_storeu_si256((__m256i*)(dest+i), r);
+    }
+    reverseSSSE3(dest+i, src+i, length-i);
+}
+
+#endif // CODING_X86
+
+#ifdef CODING_NEON
+
+/* NEON can count the bits in each byte directly */
+
+static void parityNEON(uint8_t* data, unsigned int length)
+{
+    const uint8x16_t m7f = vdupq_n_u8(0x7f);
+    const uint8x16_t m01 = vdupq_n_u8(0x01);
+    unsigned int i=0;
+    for (;i+16<=length;i+=16)
+    {
+        uint8x16_t v = vandq_u8(vld1q_u8(data+i), m7f);
+        uint8x16_t even = vandq_u8(vmvnq_u8(vcntq_u8(v)), m01);
+        vst1q_u8(data+i, vorrq_u8(v, vshlq_n_u8(even, 7)));
+    }
+    parityScalar(data+i, length-i);
+}
+
+static void hammingNEON(uint8_t* data, unsigned int length)
+{
+    const uint8x16_t m0f = vdupq_n_u8(0x0f);
+#ifdef __aarch64__
+    const uint8x16_t table = vld1q_u8(Hamming8EncodeTable);
+#else
+    const uint8x8x2_t table = {{vld1_u8(Hamming8EncodeTable), vld1_u8(Hamming8EncodeTable+8)}};
+#endif
+    unsigned int i=0;
+    for (;i+16<=length;i+=16)
+    {
+        uint8x16_t v = vandq_u8(vld1q_u8(data+i), m0f);
+#ifdef __aarch64__
+        v = vqtbl1q_u8(table, v);
+#else
+        v = vcombine_u8(vtbl2_u8(table, vget_low_u8(v)), vtbl2_u8(table, vget_high_u8(v)));
+#endif
+        vst1q_u8(data+i, v);
+    }
+    hammingScalar(data+i, length-i);
+}
+
+static void reverseNEON(uint8_t* dest, const uint8_t* src, unsigned int length)
+{
+#ifndef __aarch64__
+    const uint8x8x2_t low = {{vld1_u8(ReverseNibbleLow), vld1_u8(ReverseNibbleLow+8)}};
+    const uint8x8x2_t high = {{vld1_u8(ReverseNibbleHigh), vld1_u8(ReverseNibbleHigh+8)}};
+    const uint8x8_t m0f = vdup_n_u8(0x0f);
+#endif
+    unsigned int i=0;
+    for (;i+16<=length;i+=16)
+    {
+        uint8x16_t v = vld1q_u8(src+i);
+#ifdef __aarch64__
+        v = vrbitq_u8(v); // AArch64 reverses bits directly
+#else
+        uint8x8_t a = vget_low_u8(v);
+        uint8x8_t b = vget_high_u8(v);
+        a = vorr_u8(vtbl2_u8(high, vand_u8(a, m0f)), vtbl2_u8(low, vshr_n_u8(a, 4)));
+        b = vorr_u8(vtbl2_u8(high, vand_u8(b, m0f)), vtbl2_u8(low, vshr_n_u8(b, 4)));
+        v = vcombine_u8(a, b);
+#endif
+        vst1q_u8(dest+i, v);
+    }
+    reverseScalar(dest+i, src+i, length-i);
+}
+
+#endif // CODING_NEON
+
+/* Find the versions the processor can run once at startup, slowest first, and use the fastest */
+
+#define MAX_KERNEL_SETS 5
+
+static CodingKernelSet supportedKernels[MAX_KERNEL_SETS + 1]; // ends with a set that has no name
+
+static CodingKernelSet selectKernels()
+{
+    unsigned int n = 0;
+    supportedKernels[n++] = {parityScalar, hammingScalar, reverseScalar, "scalar"};
+#if defined(CODING_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+    {
+        supportedKernels[n++] = {paritySSE2, hammingScalar, reverseScalar, "sse2"};
+        if (__builtin_cpu_supports("ssse3"))
+            supportedKernels[n++] = {paritySSE2, hammingSSSE3, reverseSSSE3, "sse2/ssse3"};
+    }
+    if (__builtin_cpu_supports("avx2"))
+        supportedKernels[n++] = {parityAVX2, hammingAVX2, reverseAVX2, "avx2"};
+#endif
+#if defined(CODING_NEON)
+    supportedKernels[n++] = {parityNEON, hammingNEON, reverseNEON, "neon"};
+#endif
+    supportedKernels[n] = {nullptr, nullptr, nullptr, nullptr};
+    return supportedKernels[n - 1];
+}
+
+static const CodingKernelSet kernels = selectKernels();
+
+void vbit::OddParityEncode(uint8_t* data, unsigned int length)
+{
+    kernels.parity(data, length);
+}
+
+void vbit::Hamming84Encode(uint8_t* data, unsigned int length)
+{
+    kernels.hamming(data, length);
+}
+
+void vbit::ReverseBits(uint8_t* dest, const uint8_t* src, unsigned int length)
+{
+    kernels.reverse(dest, src, length);
+}
+
+const char* vbit::CodingKernels()
+{
+    return kernels.name;
+}
+
+const CodingKernelSet* vbit::CodingKernelSets()
+{
+    return supportedKernels;
+}
+
+void vbit::Hamming2418Encode(uint8_t* out, uint32_t triplet)
+{
+    uint8_t Byte_0 = (Hamming24EncodeTable0[(triplet >> 0) & 0xFF] ^ Hamming24EncodeTable1[(triplet >> 8) & 0xFF] ^ Hamming24EncodeTable2[(triplet >> 16) & 0x03]);
+    uint8_t D5_D11 = (triplet >> 4) & 0x7F;
+    uint8_t D12_D18 = (triplet >> 11) & 0x7F;
+    uint8_t P5 = 0x80 & ~(Hamming24ParityTable[0][D12_D18] << 2);
+    uint8_t P6 = 0x80 & ((Hamming24ParityTable[0][Byte_0] ^ Hamming24ParityTable[0][D5_D11]) << 2);
+
+    out[0] = Byte_0;
+    out[1] = D5_D11 | P5;
+    out[2] = D12_D18 | P6;
+}
+
+void vbit::Hamming2418EncodeTriplets(uint8_t* data, unsigned int count)
+{
+    for (unsigned int i=0;i<count;i++,data+=3)
+    {
+        uint32_t triplet = data[0] & 0x3F;
+        triplet |= (data[1] & 0x3F) << 6;
+        triplet |= (data[2] & 0x3F) << 12;
+        Hamming2418Encode(data, triplet);
+    }
+}
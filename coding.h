@@ -0,0 +1,68 @@
+#ifndef _CODING_H_
+#define _CODING_H_
+
+#include <cstdint>
+
+/**
+ * Parity, Hamming 8/4 and Hamming 24/18 encoding of runs of bytes, and bit reversal.
+ * Parity, Hamming 8/4 and bit reversal are the innermost loops of packet generation and output
+ * so there are SSE2, AVX2 and NEON versions as well as plain table lookups. The fastest version
+ * the processor supports is chosen at startup. Every version gives the same results as
+ * OddParityTable, Hamming8EncodeTable and ReverseByteTab.
+ * Hamming 24/18 is only needed when an enhancement row is loaded so it just uses the tables.
+ */
+
+namespace vbit
+{
+    /** Set odd parity in bit 7 of each byte. The incoming bit 7 is ignored.
+     * @param data Bytes to encode in place
+     * @param length Number of bytes, e.g. a 40 byte row or a whole field of rows
+     */
+    void OddParityEncode(uint8_t* data, unsigned int length);
+
+    /** Hamming 8/4 encode the low nibble of each byte. The incoming high nibble is ignored.
+     * @param data Bytes to encode in place
+     * @param length Number of bytes
+     */
+    void Hamming84Encode(uint8_t* data, unsigned int length);
+
+    /** Reverse the order of the bits in each byte, for outputs that send the least significant bit first
+     * @param dest Where to put the reversed bytes. May be the same as src
+     * @param src Bytes to reverse
+     * @param length Number of bytes, e.g. a whole field of output
+     */
+    void ReverseBits(uint8_t* dest, const uint8_t* src, unsigned int length);
+
+    /** Hamming 24/18 encode one triplet
+     * @param out 3 bytes to receive the encoded triplet
+     * @param triplet D1..D18 in the low 18 bits
+     */
+    void Hamming2418Encode(uint8_t* out, uint32_t triplet);
+
+    /** Hamming 24/18 encode triplets that are written as three characters of 6 bits each,
+     *  least significant first, as they are in the enhancement rows of a tti file.
+     * @param data Three characters per triplet, encoded in place
+     * @param count Number of triplets
+     */
+    void Hamming2418EncodeTriplets(uint8_t* data, unsigned int count);
+
+    /** @return Name of the encoding versions in use, for logging */
+    const char* CodingKernels();
+
+    /** One version of each of the vectorised loops above */
+    struct CodingKernelSet
+    {
+        void (*parity)(uint8_t*, unsigned int);
+        void (*hamming)(uint8_t*, unsigned int);
+        void (*reverse)(uint8_t*, const uint8_t*, unsigned int);
+        const char* name;
+    };
+
+    /** Every version the processor can run, for checking and timing them against each other
+     *  (see tools/codingbench)
+     * @return The versions, slowest first, then one with a null name
+     */
+    const CodingKernelSet* CodingKernelSets();
+}
+
+#endif // _CODING_H_
@@ -33,9 +33,11 @@
 using namespace vbit;
 using namespace ttx;
 
-Command::Command(Configure *configure, PacketSubtitle* subtitle=nullptr, PageList *pageList=nullptr) :
-    _portNumber(configure->GetCommandPort()),
-    _client(subtitle, pageList)
+Command::Command(Configure *configure, PacketSubtitle* subtitle, PageList *pageList, uint16_t port) :
+    _portNumber(port ? port : configure->GetCommandPort()),
+    _subtitle(subtitle),
+    _pageList(pageList),
+    _epoll(-1)
 {
     // Constructor
     // Start a listener thread
@@ -54,29 +56,14 @@ void Command::DieWithError(std::string errorMessage)
 
 void Command::run()
 {
-    std::cerr << "[Command::run] Newfor subtitle listener started\n";
+    std::stringstream ss;
+    ss << "[Command::run] Newfor subtitle listener started on port " << _portNumber << "\n";
+    std::cerr << ss.str();
 
     int serverSock;                    /* Socket descriptor for server */
-    int clientSock;                    /* Socket descriptor for client */
     struct sockaddr_in echoServAddr; /* Local address */
-    struct sockaddr_in echoClntAddr; /* Client address */
     unsigned short echoServPort;     /* Server port */
 
-#ifdef WIN32
-    int clntLen;                     /* needs to be signed int for winsock */
-    WSADATA wsaData;
-    int iResult;
-
-    // Initialize Winsock
-    iResult = WSAStartup(MAKEWORD(2,2), &wsaData);
-    if (iResult != 0)
-    {
-        DieWithError("WSAStartup failed");
-    }
-#else
-    unsigned int clntLen;            /* Length of client address data structure */
-#endif
-
     echoServPort = _portNumber;  /* This is the local port */
 
     // System initialisations
@@ -87,7 +74,7 @@ void Command::run()
     echoServAddr.sin_port = htons(echoServPort);      /* Local port */
 
     /* Create socket for incoming connections */
-    if ((serverSock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
+    if ((serverSock = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP)) < 0)
         DieWithError("socket() failed\n");
 
     /* Bind to the local address */
@@ -98,21 +85,159 @@ void Command::run()
     if (listen(serverSock, MAXPENDING) < 0)
         DieWithError("listen() failed");
 
-    /* Set the size of the in-out parameter */
-    clntLen = sizeof(echoClntAddr);
+    if ((_epoll = epoll_create1(0)) < 0)
+        DieWithError("epoll_create1() failed");
 
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = serverSock;
+    if (epoll_ctl(_epoll, EPOLL_CTL_ADD, serverSock, &event) < 0)
+        DieWithError("epoll_ctl() failed");
+
+    std::cerr << "[Command::run] Ready for clients to connect\n";
+
+    struct epoll_event events[MAXCLIENTS + 1];
     while(1)
     {
-        std::cerr << "[Command::run] Ready for a client to connect\n";
+        int n = epoll_wait(_epoll, events, MAXCLIENTS + 1, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            DieWithError("epoll_wait() failed");
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            int sock = events[i].data.fd;
+            if (sock == serverSock)
+            {
+                _accept(serverSock);
+                continue;
+            }
+
+            std::map<int, Connection*>::iterator it = _connections.find(sock);
+            if (it == _connections.end())
+                continue; // closed earlier in this batch
+
+            bool open = true;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                open = _read(sock, it->second);
+            if (open && (events[i].events & EPOLLOUT))
+                open = _write(sock, it->second);
+            if (!open)
+                _close(sock);
+        }
+    }
+}
 
-        /* Wait for a client to connect */
-        if ((clientSock = accept(serverSock, (struct sockaddr *) &echoClntAddr, &clntLen)) < 0)
-            DieWithError("accept() failed");
-        
-        std::cerr << "[Command::run] Connected\n";
+void Command::_accept(int serverSock)
+{
+    while (1)
+    {
+        struct sockaddr_in echoClntAddr; /* Client address */
+        socklen_t clntLen = sizeof(echoClntAddr);
+        int clientSock = accept4(serverSock, (struct sockaddr *) &echoClntAddr, &clntLen, SOCK_NONBLOCK);
+        if (clientSock < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED && errno != EINTR)
+                perror("[Command::_accept] accept() failed");
+            return; // no more waiting
+        }
+
+        std::stringstream ss;
+        if (_connections.size() >= MAXCLIENTS)
+        {
+            ss << "[Command::_accept] port " << _portNumber << " refused " << inet_ntoa(echoClntAddr.sin_addr) << ", already " << _connections.size() << " clients\n";
+            std::cerr << ss.str();
+            close(clientSock);
+            continue;
+        }
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = clientSock;
+        if (epoll_ctl(_epoll, EPOLL_CTL_ADD, clientSock, &event) < 0)
+        {
+            perror("[Command::_accept] epoll_ctl() failed");
+            close(clientSock);
+            continue;
+        }
+        _connections[clientSock] = new Connection(_subtitle, _pageList);
+
+        ss << "[Command::_accept] port " << _portNumber << " connected " << inet_ntoa(echoClntAddr.sin_addr) << ", " << _connections.size() << " clients\n";
+        std::cerr << ss.str();
+    }
+}
 
-        /* clientSock is connected to a client! */
+bool Command::_read(int sock, Connection* connection)
+{
+    // One buffer at a time. epoll is level triggered so anything left over is read on the next pass, after the other clients
+    char buffer[4096];
+    ssize_t received = recv(sock, buffer, sizeof(buffer), 0);
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return true;
+    if (received <= 0)
+        return false; // zero indicates end of transmission, or the connection was reset
+
+    connection->client.Receive(buffer, received, &connection->output);
+    if (connection->output.size() > MAXOUTPUT)
+    {
+        std::stringstream ss;
+        ss << "[Command::_read] port " << _portNumber << " client isn't reading its replies\n";
+        std::cerr << ss.str();
+        return false; // while EPOLLOUT is awaited nothing else would stop the replies growing
+    }
+    return connection->writing || _write(sock, connection); // if it is already waiting then EPOLLOUT will send the replies
+}
 
-        _client.Handler(clientSock);
+bool Command::_write(int sock, Connection* connection)
+{
+    while (!connection->output.empty())
+    {
+        ssize_t sent = send(sock, connection->output.data(), connection->output.size(), MSG_NOSIGNAL);
+        if (sent > 0)
+        {
+            connection->output.erase(0, sent);
+            continue;
+        }
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        return false;
+    }
+
+    if (connection->output.size() > MAXOUTPUT)
+    {
+        std::stringstream ss;
+        ss << "[Command::_write] port " << _portNumber << " client isn't reading its replies\n";
+        std::cerr << ss.str();
+        return false;
     }
+
+    bool writing = !connection->output.empty();
+    if (writing != connection->writing)
+    {
+        // only ask to hear when the socket can take more while there is something waiting
+        struct epoll_event event;
+        event.events = writing ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        event.data.fd = sock;
+        if (epoll_ctl(_epoll, EPOLL_CTL_MOD, sock, &event) < 0)
+            return false;
+        connection->writing = writing;
+    }
+    return true;
+}
+
+void Command::_close(int sock)
+{
+    epoll_ctl(_epoll, EPOLL_CTL_DEL, sock, nullptr);
+    close(sock);    /* Close client socket */
+    delete _connections[sock];
+    _connections.erase(sock);
+
+    std::stringstream ss;
+    ss << "[Command::_close] port " << _portNumber << " disconnected, " << _connections.size() << " clients\n";
+    std::cerr << ss.str();
 }
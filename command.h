@@ -39,6 +39,7 @@
 
 #include <iostream>
 #include <cstring>
+#include <cerrno>
 #include <stdint.h>
 
 #ifdef WIN32
@@ -49,8 +50,14 @@
 
 #include <sys/socket.h> /* for socket(), bind(), and connect() */
 #include <arpa/inet.h>  /* for sockaddr_in and inet_ntoa() */
+#include <sys/epoll.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
+#include <map>
+#include <string>
+
 #include "pagelist.h"
 #include "TCPClient.h"
 
@@ -63,8 +70,9 @@ namespace vbit
              * @brief Constructor
              * @description Listens on port 5570 and accepts connections.
              * When connected it can be sent Newfor commands.
+             * @param port Port to listen on. 0 for the configured command port
              */
-            Command(ttx::Configure *configure, vbit::PacketSubtitle* subtitle, ttx::PageList* pageList);
+            Command(ttx::Configure *configure, vbit::PacketSubtitle* subtitle, ttx::PageList* pageList, uint16_t port=0);
 
             /**
              * @brief Destructor
@@ -73,20 +81,52 @@ namespace vbit
 
             /**
              * @brief Run the listener thread.
+             * Any number of clients up to MAXCLIENTS may be connected at once, e.g. a subtitler and a monitor.
+             * They are served from this one thread with epoll, so everything sent to the subtitle
+             * service still comes from a single thread. Each connection has its own parser state.
              */
             void run();
 
         private:
             int _portNumber; /// The port number is configurable. Default is 5570 for no oarticular reason.
-            TCPClient _client; /// Did I call this a client? It is where clients connect and get their commands executed.
+            vbit::PacketSubtitle* _subtitle;
+            ttx::PageList* _pageList;
+
+            /** A connected client. Replies that the socket won't take yet wait in output */
+            struct Connection
+            {
+                Connection(vbit::PacketSubtitle* subtitle, ttx::PageList* pageList) : client(subtitle, pageList), writing(false) {};
+                TCPClient client; /// Did I call this a client? It is where clients connect and get their commands executed.
+                std::string output;
+                bool writing; // waiting for the socket to take more output
+            };
+            std::map<int, Connection*> _connections; // by socket
+            int _epoll;
 
             /* Page init and subtitle data can respond with these standard codes */
             static const uint8_t ASCII_ACK=0x06;
             static const uint8_t ASCII_NACK=0x15;
             
-            static const uint8_t MAXPENDING=5;    /* Maximum outstanding connection requests */
+            static const uint8_t MAXPENDING=32;   /* Maximum outstanding connection requests */
+            static const uint8_t MAXCLIENTS=64;   /* Maximum connected clients */
+            static const uint32_t MAXOUTPUT=65536; /* Unsent replies a client may have before it is disconnected */
 
             void DieWithError(std::string errorMessage);  /* Error handling function */
+
+            /** Accept every waiting connection on the listening socket */
+            void _accept(int serverSock);
+
+            /** Read and parse everything waiting on a client socket
+             * @return false if the client has gone
+             */
+            bool _read(int sock, Connection* connection);
+
+            /** Send as much waiting output as the socket will take
+             * @return false if the client has gone or isn't reading its replies
+             */
+            bool _write(int sock, Connection* connection);
+
+            void _close(int sock);
     };
 }
 
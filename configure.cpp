@@ -1,6 +1,7 @@
 /** Configure
  */
 #include "configure.h"
+#include "tswriter.h"
 
 using namespace ttx;
 
@@ -41,6 +42,11 @@ Configure::Configure(int argc, char** argv) :
     _commandPort = 5570;
     _commandPortEnabled = false;
     
+    _subtitleFilePage = 0x888;
+    _subtitleFileStart = -1;
+    _subtitleReservedLines = 0;
+    _pageUploadSocket = ""; // disabled
+    
     _reverseBits = false;
     _debugLevel = 0;
 
@@ -50,11 +56,31 @@ Configure::Configure(int argc, char** argv) :
     _multiplexedSignalFlag = false; // using this would require changing all the line counting and a way to send full field through raspi-teletext - something for the distant future when everything else is done...
     
     _OutputFormat = T42; // t42 output is the default behaviour
+    _tsPID = 0x100;
     
     uint8_t priority[8]={9,3,3,6,3,3,5,6}; // 1=High priority,9=low. Note: priority[0] is mag 8
     
     for (int i=0; i<8; i++)
         _magazinePriority[i] = priority[i];
+    
+    _schedulerMode = Priority; // magazine_priority countdowns are the default behaviour
+    
+    for (int i=0; i<8; i++)
+        _magazineShare[i] = 0; // derive shares from magazine_priority unless configured
+    
+    _packet830Share = 5; // 8/30 goes out five times a second
+    _schedulerReportInterval = 60;
+    _outputReportInterval = 60;
+    
+    _deadlineScheduling = false;
+    _cycleSchedule = false;
+    for (int i=0; i<8; i++)
+        _magazineMaxInterval[i] = 0; // no deadline unless configured
+    
+    _magazineTuning = TuneOff;
+    for (int i=0; i<8; i++)
+        _magazineMaxCycle[i] = 0;
+    _magazineTuningInterval = 30;
 
     //Scan the command line for overriding the pages file.
     if (argc>1)
@@ -76,20 +102,7 @@ Configure::Configure(int argc, char** argv) :
             {
                 if (i + 1 < argc)
                 {
-                    arg = argv[++i];
-                    
-                    if (arg == "t42")
-                    {
-                        _OutputFormat = T42;
-                    }
-                    else if (arg == "raw")
-                    {
-                        _OutputFormat = Raw;
-                    }
-                    else if (arg == "PES")
-                    {
-                        _OutputFormat = PES;
-                    }
+                    _parseOutputFormat(argv[++i], &_OutputFormat);
                     
                     if (_reverseBits && _OutputFormat != T42)
                     {
@@ -141,6 +154,52 @@ Configure::Configure(int argc, char** argv) :
                     exit(EXIT_FAILURE);
                 }
             }
+            else if (arg == "--output")
+            {
+                if (i + 1 < argc)
+                {
+                    // format[,option...][:destination] - may be repeated to send the same packets to several places
+                    OutputSinkSpec spec;
+                    if (_parseOutputSink(argv[++i], &spec))
+                    {
+                        _outputSinks.push_back(spec);
+                    }
+                    else
+                    {
+                        std::cerr << "[Configure::Configure] invalid output argument " << argv[i] << "\n";
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                else
+                {
+                    std::cerr << "[Configure::Configure] --output requires an argument\n";
+                    exit(EXIT_FAILURE);
+                }
+            }
+            else if (arg == "--pid")
+            {
+                if (i + 1 < argc)
+                {
+                    // PID for teletext in transport stream output. Decimal, or hexadecimal with a 0x prefix
+                    errno = 0;
+                    char *end_ptr;
+                    long l = std::strtol(argv[++i], &end_ptr, 0);
+                    if (errno == 0 && *end_ptr == '\0' && l >= 0x20 && l <= 0x1FFE && l != TS_PMT_PID)
+                    {
+                        _tsPID = (uint16_t)l;
+                    }
+                    else
+                    {
+                        std::cerr << "[Configure::Configure] invalid PID argument\n";
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                else
+                {
+                    std::cerr << "[Configure::Configure] --pid requires an argument\n";
+                    exit(EXIT_FAILURE);
+                }
+            }
             else if (arg == "--debug")
             {
                 if (i + 1 < argc)
@@ -171,6 +230,13 @@ Configure::Configure(int argc, char** argv) :
         }
     }
     
+    if (_outputSinks.empty())
+    {
+        // without any --output arguments everything goes to stdout in the --format format
+        OutputSinkSpec spec = {_OutputFormat, "-", _reverseBits, false, 1, VBI_DEFAULT_SAMPLE_RATE, VBI_DEFAULT_SAMPLE_BITS};
+        _outputSinks.push_back(spec);
+    }
+    
     if (!DirExists(&_pageDir))
     {
         std::stringstream ss;
@@ -194,6 +260,114 @@ Configure::Configure(int argc, char** argv) :
     LoadConfigFile(path+".override"); // allow overriding main config file for local configuration where main config is in version control
 }
 
+std::vector<Configure::SubtitleServiceSpec> Configure::GetSubtitleServices()
+{
+    std::vector<SubtitleServiceSpec> services = _subtitleServices;
+    if (services.empty())
+    {
+        services.push_back({0x888, _commandPort, 10}); // the single service of older configurations
+    }
+    for (unsigned int i = 0; i < services.size(); i++)
+    {
+        if (services[i].repeats > 9)
+            services[i].repeats = _subtitleRepeats; // not given for this service
+    }
+    return services;
+}
+
+bool Configure::_parseOutputFormat(std::string arg, OutputFormat* format)
+{
+    if (arg == "t42")
+        *format = T42;
+    else if (arg == "raw")
+        *format = Raw;
+    else if (arg == "PES")
+        *format = PES;
+    else if (arg == "ts")
+        *format = TS;
+    else if (arg == "vbi")
+        *format = VBI;
+    else if (arg == "op47")
+        *format = OP47;
+    else if (arg == "st2031")
+        *format = ST2031;
+    else
+        return false;
+    return true;
+}
+
+bool Configure::_parseOutputSink(std::string arg, OutputSinkSpec* spec)
+{
+    spec->destination = "-";
+    spec->reverse = false;
+    spec->drop = false;
+    spec->bufferFields = 10;
+    spec->sampleRate = VBI_DEFAULT_SAMPLE_RATE;
+    spec->sampleBits = VBI_DEFAULT_SAMPLE_BITS;
+    
+    size_t colon = arg.find(':');
+    if (colon != std::string::npos)
+    {
+        spec->destination = arg.substr(colon + 1);
+        arg = arg.substr(0, colon);
+        if (spec->destination.empty())
+            return false;
+    }
+    
+    std::stringstream ss(arg);
+    std::string option;
+    std::getline(ss, option, ',');
+    if (!_parseOutputFormat(option, &spec->format))
+        return false;
+    
+    while (std::getline(ss, option, ','))
+    {
+        if (option == "reverse" && spec->format == T42)
+        {
+            spec->reverse = true;
+        }
+        else if (option == "block")
+        {
+            spec->drop = false;
+        }
+        else if (option == "drop")
+        {
+            spec->drop = true;
+        }
+        else if (option.compare(0, 7, "buffer=") == 0)
+        {
+            errno = 0;
+            char *end_ptr;
+            long l = std::strtol(option.c_str() + 7, &end_ptr, 10);
+            if (errno != 0 || *end_ptr != '\0' || l < 1 || l > 500)
+                return false;
+            spec->bufferFields = (int)l;
+        }
+        else if (option.compare(0, 5, "rate=") == 0 && spec->format == VBI)
+        {
+            errno = 0;
+            char *end_ptr;
+            long l = std::strtol(option.c_str() + 5, &end_ptr, 10);
+            if (errno != 0 || *end_ptr != '\0' || l < 10000000 || l > 100000000) // fast enough for the teletext spectrum
+                return false;
+            spec->sampleRate = (unsigned int)l;
+        }
+        else if (option == "bits=8" && spec->format == VBI)
+        {
+            spec->sampleBits = 8;
+        }
+        else if (option == "bits=16" && spec->format == VBI)
+        {
+            spec->sampleBits = 16;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 Configure::~Configure()
 {
     std::cerr << "[Configure] Destructor\n";
@@ -205,7 +379,7 @@ int Configure::LoadConfigFile(std::string filename)
 
     std::vector<std::string>::iterator iter;
     // these are all the valid strings for config lines
-    std::vector<std::string> nameStrings{ "header_template", "initial_teletext_page", "row_adaptive_mode", "network_identification_code", "country_network_identification", "full_field", "status_display", "subtitle_repeats","enable_command_port","command_port","lines_per_field","magazine_priority" };
+    std::vector<std::string> nameStrings{ "header_template", "initial_teletext_page", "row_adaptive_mode", "network_identification_code", "country_network_identification", "full_field", "status_display", "subtitle_repeats","enable_command_port","command_port","lines_per_field","magazine_priority","scheduler","magazine_share","packet830_share","scheduler_report_interval","deadline_scheduling","magazine_max_interval","page_max_interval","magazine_tuning","magazine_max_cycle","magazine_tuning_interval","page_repeats","output_report_interval","subtitle_services","subtitle_file","subtitle_file_start","subtitle_reserved_lines","page_upload_socket","cycle_schedule" };
 
     if (filein.is_open())
     {
@@ -472,6 +646,480 @@ int Configure::LoadConfigFile(std::string filename)
                                     _magazinePriority[i] = tmp[i];
                                 break;
                             }
+                            case 12: // "scheduler"
+                            {
+                                if (!value.compare("priority"))
+                                {
+                                    _schedulerMode = Priority;
+                                }
+                                else if (!value.compare("share"))
+                                {
+                                    _schedulerMode = Share;
+                                }
+                                else
+                                {
+                                    error = 1;
+                                }
+                                break;
+                            }
+                            case 13: // "magazine_share" - rows per second for each magazine
+                            {
+                                std::stringstream ss(value);
+                                std::string temps;
+                                int tmp[8];
+                                int i;
+                                for (i=0; i<8; i++)
+                                {
+                                    if (std::getline(ss, temps, ','))
+                                    {
+                                        try
+                                        {
+                                            tmp[i] = stoi(temps);
+                                        }
+                                        catch (const std::invalid_argument& ia)
+                                        {
+                                            error = 1;
+                                            break;
+                                        }
+                                        if (!(tmp[i] > 0 && tmp[i] < 10000))
+                                        {
+                                            error = 1;
+                                            break;
+                                        }
+                                    }
+                                    else
+                                    {
+                                        error = 1;
+                                        break;
+                                    }
+                                }
+                                if (!error)
+                                {
+                                    for (i=0; i<8; i++)
+                                        _magazineShare[i] = tmp[i];
+                                }
+                                break;
+                            }
+                            case 14: // "packet830_share" - rows per second for packet 8/30
+                            {
+                                if (value.size() > 0 && value.size() < 5)
+                                {
+                                    try
+                                    {
+                                        _packet830Share = stoi(std::string(value, 0, 4));
+                                    }
+                                    catch (const std::invalid_argument& ia)
+                                    {
+                                        error = 1;
+                                        break;
+                                    }
+                                    if (_packet830Share < 1)
+                                    {
+                                        _packet830Share = 5;
+                                        error = 1;
+                                    }
+                                }
+                                else
+                                {
+                                    error = 1;
+                                }
+                                break;
+                            }
+                            case 15: // "scheduler_report_interval" - seconds, 0 disables
+                            {
+                                if (value.size() > 0 && value.size() < 6)
+                                {
+                                    try
+                                    {
+                                        _schedulerReportInterval = stoi(std::string(value, 0, 5));
+                                    }
+                                    catch (const std::invalid_argument& ia)
+                                    {
+                                        error = 1;
+                                        break;
+                                    }
+                                }
+                                else
+                                {
+                                    error = 1;
+                                }
+                                break;
+                            }
+                            case 16: // "deadline_scheduling"
+                            {
+                                if (!value.compare("true"))
+                                {
+                                    _deadlineScheduling = true;
+                                }
+                                else if (!value.compare("false"))
+                                {
+                                    _deadlineScheduling = false;
+                                }
+                                else
+                                {
+                                    error = 1;
+                                }
+                                break;
+                            }
+                            case 17: // "magazine_max_interval" - seconds for each magazine, 0 for none
+                            {
+                                std::stringstream ss(value);
+                                std::string temps;
+                                int tmp[8];
+                                int i;
+                                for (i=0; i<8; i++)
+                                {
+                                    if (std::getline(ss, temps, ','))
+                                    {
+                                        try
+                                        {
+                                            tmp[i] = stoi(temps);
+                                        }
+                                        catch (const std::invalid_argument& ia)
+                                        {
+                                            error = 1;
+                                            break;
+                                        }
+                                        if (!(tmp[i] >= 0 && tmp[i] < 3600))
+                                        {
+                                            error = 1;
+                                            break;
+                                        }
+                                    }
+                                    else
+                                    {
+                                        error = 1;
+                                        break;
+                                    }
+                                }
+                                if (!error)
+                                {
+                                    for (i=0; i<8; i++)
+                                        _magazineMaxInterval[i] = tmp[i];
+                                }
+                                break;
+                            }
+                            case 18: // "page_max_interval" - comma separated list of mpp:seconds
+                            {
+                                std::stringstream ss(value);
+                                std::string temps;
+                                std::map<int, int> intervals;
+                                while (std::getline(ss, temps, ','))
+                                {
+                                    size_t idx;
+                                    int magpage;
+                                    int seconds;
+                                    if (temps.size() < 5 || temps.at(3) != ':')
+                                    {
+                                        error = 1;
+                                        break;
+                                    }
+                                    try
+                                    {
+                                        magpage = stoi(std::string(temps, 0, 3), &idx, 16);
+                                        seconds = stoi(std::string(temps, 4));
+                                    }
+                                    catch (const std::invalid_argument& ia)
+                                    {
+                                        error = 1;
+                                        break;
+                                    }
+                                    if (magpage < 0x100 || magpage > 0x8FF || (magpage & 0xFF) == 0xFF || seconds < 1 || seconds >= 3600)
+                                    {
+                                        error = 1;
+                                        break;
+                                    }
+                                    intervals[magpage] = seconds;
+                                }
+                                if (!error)
+                                {
+                                    _pageMaxInterval = intervals;
+                                }
+                                break;
+                            }
+                            case 19: // "magazine_tuning"
+                            {
+                                if (!value.compare("off"))
+                                {
+                                    _magazineTuning = TuneOff;
+                                }
+                                else if (!value.compare("equalise"))
+                                {
+                                    _magazineTuning = TuneEqualise;
+                                }
+                                else if (!value.compare("maximum"))
+                                {
+                                    _magazineTuning = TuneMaximum;
+                                }
+                                else
+                                {
+                                    error = 1;
+                                }
+                                break;
+                            }
+                            case 20: // "magazine_max_cycle" - seconds for each magazine, 0 for none
+                            {
+                                std::stringstream ss(value);
+                                std::string temps;
+                                int tmp[8];
+                                int i;
+                                for (i=0; i<8; i++)
+                                {
+                                    if (std::getline(ss, temps, ','))
+                                    {
+                                        try
+                                        {
+                                            tmp[i] = stoi(temps);
+                                        }
+                                        catch (const std::invalid_argument& ia)
+                                        {
+                                            error = 1;
+                                            break;
+                                        }
+                                        if (!(tmp[i] >= 0 && tmp[i] < 3600))
+                                        {
+                                            error = 1;
+                                            break;
+                                        }
+                                    }
+                                    else
+                                    {
+                                        error = 1;
+                                        break;
+                                    }
+                                }
+                                if (!error)
+                                {
+                                    for (i=0; i<8; i++)
+                                        _magazineMaxCycle[i] = tmp[i];
+                                }
+                                break;
+                            }
+                            case 21: // "magazine_tuning_interval" - seconds
+                            {
+                                if (value.size() > 0 && value.size() < 5)
+                                {
+                                    try
+                                    {
+                                        _magazineTuningInterval = stoi(std::string(value, 0, 4));
+                                    }
+                                    catch (const std::invalid_argument& ia)
+                                    {
+                                        error = 1;
+                                        break;
+                                    }
+                                    if (_magazineTuningInterval < 1)
+                                    {
+                                        _magazineTuningInterval = 30;
+                                        error = 1;
+                                    }
+                                }
+                                else
+                                {
+                                    error = 1;
+                                }
+                                break;
+                            }
+                            case 22: // "page_repeats" - comma separated list of mpp:repeats
+                            {
+                                std::stringstream ss(value);
+                                std::string temps;
+                                std::map<int, int> repeats;
+                                while (std::getline(ss, temps, ','))
+                                {
+                                    size_t idx;
+                                    int magpage;
+                                    int count;
+                                    if (temps.size() != 5 || temps.at(3) != ':')
+                                    {
+                                        error = 1;
+                                        break;
+                                    }
+                                    try
+                                    {
+                                        magpage = stoi(std::string(temps, 0, 3), &idx, 16);
+                                        count = stoi(std::string(temps, 4, 1));
+                                    }
+                                    catch (const std::invalid_argument& ia)
+                                    {
+                                        error = 1;
+                                        break;
+                                    }
+                                    if (magpage < 0x100 || magpage > 0x8FF || (magpage & 0xFF) == 0xFF || count < 1)
+                                    {
+                                        error = 1;
+                                        break;
+                                    }
+                                    repeats[magpage] = count;
+                                }
+                                if (!error)
+                                {
+                                    _pageRepeats = repeats;
+                                }
+                                break;
+                            }
+                            case 23: // "output_report_interval" - seconds, 0 disables
+                            {
+                                if (value.size() > 0 && value.size() < 6)
+                                {
+                                    try
+                                    {
+                                        _outputReportInterval = stoi(std::string(value, 0, 5));
+                                    }
+                                    catch (const std::invalid_argument& ia)
+                                    {
+                                        error = 1;
+                                        break;
+                                    }
+                                }
+                                else
+                                {
+                                    error = 1;
+                                }
+                                break;
+                            }
+                            case 24: // "subtitle_services" - comma separated list of mpp:port[:repeats]
+                            {
+                                std::stringstream ss(value);
+                                std::string temps;
+                                std::vector<SubtitleServiceSpec> services;
+                                while (std::getline(ss, temps, ','))
+                                {
+                                    SubtitleServiceSpec service;
+                                    size_t idx;
+                                    int magpage;
+                                    int port;
+                                    int repeats = 10; // the subtitle_repeats setting
+                                    if (temps.size() < 5 || temps.at(3) != ':')
+                                    {
+                                        error = 1;
+                                        break;
+                                    }
+                                    try
+                                    {
+                                        magpage = stoi(std::string(temps, 0, 3), &idx, 16);
+                                        port = stoi(std::string(temps, 4), &idx);
+                                        idx += 4;
+                                        if (idx < temps.size())
+                                        {
+                                            if (temps.at(idx) != ':' || temps.size() != idx + 2)
+                                            {
+                                                error = 1;
+                                                break;
+                                            }
+                                            repeats = stoi(std::string(temps, idx + 1, 1));
+                                        }
+                                    }
+                                    catch (const std::invalid_argument& ia)
+                                    {
+                                        error = 1;
+                                        break;
+                                    }
+                                    if (magpage < 0x100 || magpage > 0x8FF || (magpage & 0xFF) == 0xFF || port < 1 || port > 65535 || repeats < 0)
+                                    {
+                                        error = 1;
+                                        break;
+                                    }
+                                    for (unsigned int i = 0; i < services.size(); i++)
+                                    {
+                                        if (services[i].page == magpage || services[i].port == port)
+                                            error = 1; // each service needs its own page and its own input
+                                    }
+                                    if (error)
+                                        break;
+                                    service.page = magpage;
+                                    service.port = port;
+                                    service.repeats = repeats;
+                                    services.push_back(service);
+                                }
+                                if (!error)
+                                {
+                                    _subtitleServices = services;
+                                }
+                                break;
+                            }
+                            case 25: // "subtitle_file" - mpp:path of a SubRip or EBU-STL file. Relative paths are in the pages directory
+                            {
+                                int magpage;
+                                if (value.size() < 5 || value.at(3) != ':')
+                                {
+                                    error = 1;
+                                    break;
+                                }
+                                try
+                                {
+                                    magpage = stoi(std::string(value, 0, 3), nullptr, 16);
+                                }
+                                catch (const std::invalid_argument& ia)
+                                {
+                                    error = 1;
+                                    break;
+                                }
+                                if (magpage < 0x100 || magpage > 0x8FF || (magpage & 0xFF) == 0xFF)
+                                {
+                                    error = 1;
+                                    break;
+                                }
+                                _subtitleFilePage = magpage;
+                                _subtitleFile = value.substr(4);
+                                if (_subtitleFile.at(0) != '/')
+                                    _subtitleFile = _pageDir + "/" + _subtitleFile;
+                                break;
+                            }
+                            case 26: // "subtitle_file_start" - HH:MM:SS local time
+                            {
+                                int h, m, sec;
+                                if (value.size() == 8 && sscanf(value.c_str(), "%2d:%2d:%2d", &h, &m, &sec) == 3 && h < 24 && m < 60 && sec < 60)
+                                {
+                                    _subtitleFileStart = (h * 60 + m) * 60 + sec;
+                                }
+                                else
+                                {
+                                    error = 1;
+                                }
+                                break;
+                            }
+                            case 27: // "subtitle_reserved_lines" - lines per field held for subtitles, 0 for none
+                            {
+                                if (value.size() > 0 && value.size() < 4)
+                                {
+                                    try
+                                    {
+                                        _subtitleReservedLines = stoi(std::string(value, 0, 3));
+                                    }
+                                    catch (const std::invalid_argument& ia)
+                                    {
+                                        error = 1;
+                                        break;
+                                    }
+                                }
+                                else
+                                {
+                                    error = 1;
+                                }
+                                break;
+                            }
+                            case 28: // "page_upload_socket" - path of the UNIX socket for binary page uploads
+                            {
+                                _pageUploadSocket = value;
+                                break;
+                            }
+                            case 29: // "cycle_schedule"
+                            {
+                                if (!value.compare("true"))
+                                {
+                                    _cycleSchedule = true;
+                                }
+                                else if (!value.compare("false"))
+                                {
+                                    _cycleSchedule = false;
+                                }
+                                else
+                                {
+                                    error = 1;
+                                }
+                                break;
+                            }
                         }
                     }
                     else
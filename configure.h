@@ -13,6 +13,8 @@
 #include <cstring>
 #include <sys/stat.h>
 #include <vector>
+#include <array>
+#include <map>
 #include <algorithm>
 #include <stdexcept>
 
@@ -22,6 +24,9 @@
 
 #define MAXDEBUGLEVEL 3
 
+#define VBI_DEFAULT_SAMPLE_RATE 13500000 // ITU-R BT.601
+#define VBI_DEFAULT_SAMPLE_BITS 8
+
 namespace ttx
 
 {
@@ -32,7 +37,42 @@ class Configure
         {
             T42,
             Raw,
-            PES
+            PES,
+            TS,
+            VBI,
+            OP47,
+            ST2031
+        };
+        
+        struct OutputSinkSpec
+        {
+            OutputFormat format;
+            std::string destination; // "-" for stdout, "unix:<path>" for a UNIX socket, otherwise a file or fifo
+            bool reverse; // reverse the bits of t42 output
+            bool drop; // drop fields rather than wait when the destination can't keep up
+            int bufferFields; // fields that may wait for the destination before dropping
+            unsigned int sampleRate; // samples per second of vbi output
+            unsigned int sampleBits; // 8 or 16 bit samples of vbi output
+        };
+        
+        struct SubtitleServiceSpec
+        {
+            uint16_t page; // page number mpp, e.g. 0x888
+            uint16_t port; // command port for the Newfor input
+            uint8_t repeats; // number of times each subtitle is repeated
+        };
+        
+        enum SchedulerMode
+        {
+            Priority,
+            Share
+        };
+        
+        enum MagazineTuning
+        {
+            TuneOff,
+            TuneEqualise,
+            TuneMaximum
         };
         
         //Configure();
@@ -55,12 +95,34 @@ class Configure
         uint8_t GetSubtitleRepeats(){return _subtitleRepeats;}
         uint16_t GetCommandPort(){return _commandPort;}
         bool GetCommandPortEnabled(){return _commandPortEnabled;}
+        /** @return The subtitle services. Without subtitle_services this is page 888 on the command port */
+        std::vector<SubtitleServiceSpec> GetSubtitleServices();
+        std::string GetSubtitleFile(){return _subtitleFile;} // empty for none
+        uint16_t GetSubtitleFilePage(){return _subtitleFilePage;}
+        int GetSubtitleFileStart(){return _subtitleFileStart;} // seconds into the day, -1 for when vbit2 starts
+        int GetSubtitleReservedLines(){return _subtitleReservedLines;} // 0 when subtitles take any line they want
+        std::string GetPageUploadSocket(){return _pageUploadSocket;} // empty when uploads are disabled
         uint16_t GetLinesPerField(){return _linesPerField;}
         bool GetReverseFlag(){return _reverseBits;}
         int GetDebugLevel(){return _debugLevel;}
         int GetMagazinePriority(uint8_t mag){return _magazinePriority[mag];}
+        SchedulerMode GetSchedulerMode(){return _schedulerMode;}
+        int GetMagazineShare(uint8_t mag){return _magazineShare[mag];} // 0 means derive from priority
+        int GetPacket830Share(){return _packet830Share;}
+        int GetSchedulerReportInterval(){return _schedulerReportInterval;}
+        int GetOutputReportInterval(){return _outputReportInterval;}
+        bool GetDeadlineScheduling(){return _deadlineScheduling;}
+        bool GetCycleSchedule(){return _cycleSchedule;}
+        int GetMagazineMaxInterval(uint8_t mag){return _magazineMaxInterval[mag];} // seconds, 0 for none
+        std::map<int, int> GetPageMaxIntervals(){return _pageMaxInterval;} // seconds keyed by page number mpp
+        std::map<int, int> GetPageRepeats(){return _pageRepeats;} // transmissions per magazine cycle keyed by page number mpp
+        MagazineTuning GetMagazineTuning(){return _magazineTuning;}
+        int GetMagazineMaxCycle(uint8_t mag){return _magazineMaxCycle[mag];} // seconds, 0 for none
+        int GetMagazineTuningInterval(){return _magazineTuningInterval;}
         
         OutputFormat GetOutputFormat(){return _OutputFormat;}
+        uint16_t GetTSPID(){return _tsPID;}
+        std::vector<OutputSinkSpec> GetOutputSinks(){return _outputSinks;}
         
     private:
         int DirExists(std::string *path);
@@ -78,6 +140,19 @@ class Configure
         // settings for generation of packet 8/30
         bool _multiplexedSignalFlag; // false indicates teletext is multiplexed with video, true means full frame teletext.
         int _magazinePriority[8];
+        SchedulerMode _schedulerMode; /// How magazines and sources share the VBI lines
+        int _magazineShare[8]; /// Rows per second guaranteed to each magazine in Share mode
+        int _packet830Share; /// Rows per second guaranteed to packet 8/30 in Share mode
+        int _schedulerReportInterval; /// Seconds between scheduler rate reports. 0 to disable
+        int _outputReportInterval; /// Seconds between output timing reports. 0 to disable
+        bool _deadlineScheduling; /// Pick normal pages earliest deadline first rather than in page number order
+        bool _cycleSchedule; /// Record one cycle of the magazines and play it out again rather than generating every line
+        int _magazineMaxInterval[8]; /// Default maximum seconds between transmissions of each page in a magazine
+        std::map<int, int> _pageMaxInterval; /// Maximum seconds between transmissions of individual pages
+        std::map<int, int> _pageRepeats; /// Number of times individual pages go out in each magazine cycle
+        MagazineTuning _magazineTuning; /// How magazine priorities are adjusted at runtime
+        int _magazineMaxCycle[8]; /// Target maximum cycle time of each magazine in seconds
+        int _magazineTuningInterval; /// Seconds between magazine priority adjustments
         uint8_t _initialMag;
         uint8_t _initialPage;
         uint16_t _initialSubcode;
@@ -90,10 +165,21 @@ class Configure
         std::string _pageDir; /// Configuration file name --dir
         uint8_t _subtitleRepeats; /// Number of times a subtitle repeats (typically 1 or 2).
         bool _commandPortEnabled;
+        std::vector<SubtitleServiceSpec> _subtitleServices; /// repeats of 10 means use _subtitleRepeats
+        std::string _subtitleFile; /// Subtitle file to play out
+        uint16_t _subtitleFilePage; /// mpp that the subtitle file plays out on
+        int _subtitleFileStart; /// Local time of day in seconds that subtitle file times count from
+        int _subtitleReservedLines; /// Lines per field held for subtitles while one is waiting
+        std::string _pageUploadSocket; /// UNIX socket that PageUpload listens on
         bool _reverseBits;
         int _debugLevel;
         
         OutputFormat _OutputFormat;
+        uint16_t _tsPID; // PID of teletext in transport stream output
+        std::vector<OutputSinkSpec> _outputSinks;
+        
+        bool _parseOutputFormat(std::string arg, OutputFormat* format);
+        bool _parseOutputSink(std::string arg, OutputSinkSpec* spec);
     };
 }
 
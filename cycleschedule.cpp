@@ -0,0 +1,726 @@
+/** CycleSchedule
+ */
+#include "cycleschedule.h"
+#include "vbit2.h"
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+using namespace vbit;
+
+#define MAXCYCLEFIELDS 15000 // five minutes. Magazines that take longer to go round are left to live generation
+#define DERIVED 0xFF // index of fastext and X/28/0, which are made from the header fields rather than a row
+
+static void mix(uint64_t* hash, uint64_t value)
+{
+    *hash = (*hash ^ value) * 0x100000001b3ULL; // FNV-1a, a word at a time
+}
+
+CycleSchedule::CycleSchedule(ttx::Configure* configure, ttx::PageList* pageList, uint16_t linesPerField, std::vector<PacketSource*> timedSources) :
+    _configure(configure),
+    _pageList(pageList),
+    _linesPerField(linesPerField),
+    _timedSources(timedSources),
+    _state(IDLE),
+    _cursor(0),
+    _changes(0),
+    _fields(0),
+    _abandon(false),
+    _headers(0),
+    _releasing(false),
+    _released(0)
+{
+    PacketMag** mags = pageList->GetMagazines();
+    for (int mag = 0; mag < 8; mag++)
+    {
+        _mags[mag] = mags[mag];
+        _open[mag] = -1;
+        _specialRun[mag] = RUN_NONE;
+        _packet29Run[mag] = RUN_NONE;
+        _fastext[mag] = false;
+        _chain28[mag] = 0;
+    }
+
+    Packet filler(8,25,"                                        "); // the same quiet packet as Service
+    _filler = *filler.tx();
+}
+
+bool CycleSchedule::StartField()
+{
+    unsigned int changes = _countChanges();
+
+    switch (_state)
+    {
+        case IDLE:
+            break;
+        case RECORDING:
+        {
+            if (_abandon || changes != _changes)
+            {
+                _clear(); // start again with whatever changed
+                break;
+            }
+
+            _fields++;
+            _watchEvents();
+
+            if (_fields % 10 == 0 && _complete()) // packet 8/30 goes every 10 fields
+            {
+                _finish();
+                return true;
+            }
+
+            if (_fields >= MAXCYCLEFIELDS)
+            {
+                std::stringstream ss;
+                ss << "[CycleSchedule::StartField] the magazines didn't go round in " << MAXCYCLEFIELDS / 50 << " seconds, recording again\n";
+                std::cerr << ss.str();
+                _clear();
+                break;
+            }
+            return false;
+        }
+        case REPLAYING:
+        {
+            if (changes != _changes)
+            {
+                _release("pages were added or deleted, or changed type");
+                _changes = changes;
+            }
+
+            for (int mag = 0; mag < 8; mag++)
+            {
+                _mags[mag]->ApplyUpdates(); // uploaded rows change pages in place, which the headers pick up
+            }
+
+            if (_releasing && (_released & _headers) == _headers)
+            {
+                _clear(); // every magazine is generating live again
+                break;
+            }
+
+            if (_cursor >= _slots.size())
+            {
+                _cursor = 0;
+            }
+            return true;
+        }
+    }
+
+    if (_canRecord())
+    {
+        _startRecording(changes);
+    }
+    return false;
+}
+
+void CycleSchedule::Record(Packet* pkt, PacketSource* source)
+{
+    if (_state != RECORDING)
+        return;
+
+    uint32_t index = _slots.size();
+    Slot slot = {SLOT_STATIC, -1, 0, 0, -1, 0, nullptr};
+    _slots.push_back(slot);
+    _lines.push_back(_filler);
+
+    int mag = _magazine(source);
+    if (mag >= 0)
+    {
+        if (pkt == nullptr)
+        {
+            // nothing went out. In a carousel the magazine may have something for the line next time
+            if (_open[mag] >= 0 && _records[_open[mag]].carousel)
+            {
+                _slots[index].kind = SLOT_CAROUSEL;
+                _slots[index].mag = mag;
+            }
+            _slots[index].record = _open[mag];
+        }
+        else if (pkt->IsHeader())
+        {
+            _recordHeader(pkt, mag, index);
+        }
+        else if (pkt->GetRow() == 29)
+        {
+            _slots[index].mag = mag; // packet 29 goes out between pages
+            _setLine(index, pkt);
+        }
+        else if (_open[mag] >= 0)
+        {
+            _recordRow(pkt, mag, index);
+        }
+        // otherwise it is the end of a page that started before the recording, so it is left out
+    }
+    else if (std::find(_timedSources.begin(), _timedSources.end(), source) != _timedSources.end())
+    {
+        if (pkt)
+        {
+            _slots[index].kind = SLOT_SOURCE;
+            _slots[index].source = source;
+        }
+    }
+    else if (pkt)
+    {
+        _abandon = true; // e.g. a subtitle, which isn't part of any cycle
+    }
+
+    if (_slots[index].record >= 0)
+    {
+        _records[_slots[index].record].slots.push_back(index);
+    }
+}
+
+std::array<uint8_t, PACKETSIZE>* CycleSchedule::Replay(Packet* work, PacketSource** source)
+{
+    *source = nullptr;
+    if (_state != REPLAYING)
+        return &_filler;
+
+    if (_cursor >= _slots.size())
+    {
+        _cursor = 0;
+    }
+    uint32_t index = _cursor++;
+    Slot& slot = _slots[index];
+
+    PacketMag* mag = nullptr;
+    if (slot.mag >= 0)
+    {
+        mag = _mags[slot.mag];
+
+        if (_releasing && _isHeader(slot))
+        {
+            _released |= 1 << slot.mag;
+        }
+
+        if (_released & (1 << slot.mag))
+        {
+            // the magazine is generating live again and has the lines it had in the cycle
+            if (mag->IsReady(true) && mag->GetPacket(work) != nullptr)
+            {
+                *source = mag;
+                return work->tx();
+            }
+            return &_filler;
+        }
+
+        if (slot.kind != SLOT_CAROUSEL && mag->InPage())
+        {
+            // the carousel subpage has more lines than the one that was recorded
+            std::stringstream ss;
+            ss << "P" << std::hex << std::uppercase << (mag->GetPage()->GetPageNumber() >> 8) << " has a subpage too long for the cycle";
+            mag->EndPage();
+            _release(ss.str());
+        }
+    }
+
+    switch (slot.kind)
+    {
+        case SLOT_STATIC:
+        {
+            *source = mag;
+            return &_lines[index];
+        }
+        case SLOT_HEADER:
+        {
+            _check(_records[slot.record], work);
+            _records[slot.record].page->SetLastTxField(MasterClock::Instance()->GetFieldCount()); // for deadline scheduling when it is back to live generation
+
+            /* fallthrough */
+            [[gnu::fallthrough]];
+        }
+        case SLOT_LIVE:
+        {
+            *work = _live[slot.live];
+            *source = mag;
+            return work->tx();
+        }
+        case SLOT_SOURCE:
+        {
+            if (slot.source->IsReady() && slot.source->GetPacket(work) != nullptr)
+            {
+                *source = slot.source;
+                return work->tx();
+            }
+            break;
+        }
+        case SLOT_CAROUSEL_HEADER:
+        {
+            mag->ReplayPage(_records[slot.record].page);
+            if (mag->GetPacket(work) != nullptr)
+            {
+                *source = mag;
+                return work->tx();
+            }
+            break;
+        }
+        case SLOT_CAROUSEL:
+        {
+            if (mag->InPage() && mag->GetPacket(work) != nullptr)
+            {
+                *source = mag;
+                return work->tx();
+            }
+            break;
+        }
+    }
+    return &_filler;
+}
+
+void CycleSchedule::Stop()
+{
+    if (_state == REPLAYING)
+    {
+        std::cerr << "[CycleSchedule::Stop] back to live generation\n";
+    }
+    _clear();
+}
+
+unsigned int CycleSchedule::_countChanges()
+{
+    unsigned int changes = 0;
+    for (int mag = 0; mag < 8; mag++)
+    {
+        changes += _mags[mag]->GetPageSetChanges();
+    }
+    return changes;
+}
+
+bool CycleSchedule::_eventActive(int mag)
+{
+    // a magazine without packet 29 never clears its event
+    return _mags[mag]->GetEvent(EVENT_SPECIAL_PAGES) || (_mags[mag]->GetPacket29Flag() && _mags[mag]->GetEvent(EVENT_PACKET_29));
+}
+
+bool CycleSchedule::_canRecord()
+{
+    for (int mag = 0; mag < 8; mag++)
+    {
+        if (_mags[mag]->Get_pageSet()->empty())
+            continue; // nothing to send, and it never clears its events
+
+        if (_mags[mag]->HasPendingUpdates() || _eventActive(mag))
+            return false; // wait until things have settled down
+    }
+    return true;
+}
+
+void CycleSchedule::_startRecording(unsigned int changes)
+{
+    _clear();
+    _state = RECORDING;
+    _changes = changes;
+    _fields = 0;
+    _abandon = false;
+    for (int mag = 0; mag < 8; mag++)
+    {
+        _open[mag] = -1;
+        _sent[mag].clear();
+        _specialRun[mag] = RUN_NONE;
+        _packet29Run[mag] = RUN_NONE;
+    }
+}
+
+void CycleSchedule::_watchEvents()
+{
+    for (int mag = 0; mag < 8; mag++)
+    {
+        Run* runs[2] = {&_specialRun[mag], &_packet29Run[mag]};
+        bool active[2] = {_mags[mag]->GetEvent(EVENT_SPECIAL_PAGES), _mags[mag]->GetEvent(EVENT_PACKET_29)};
+        for (int i = 0; i < 2; i++)
+        {
+            if (*runs[i] == RUN_NONE && active[i])
+            {
+                *runs[i] = RUN_ACTIVE;
+            }
+            else if (*runs[i] == RUN_ACTIVE && !active[i])
+            {
+                *runs[i] = RUN_CLEARED; // done when the magazine's next header closes the last page
+            }
+        }
+    }
+}
+
+bool CycleSchedule::_complete()
+{
+    std::unique_lock<std::mutex> lock(_pageList->GetListMutex(), std::try_to_lock);
+    if (!lock.owns_lock())
+        return false; // the FileMonitor is changing the lists. Try again later
+
+    for (int mag = 0; mag < 8; mag++)
+    {
+        PacketMag* m = _mags[mag];
+        if (m->Get_pageSet()->empty())
+            continue;
+
+        if (_eventActive(mag))
+            return false;
+
+        if (m->GetSpecialPages()->GetPageCount() > 0 && _specialRun[mag] != RUN_DONE)
+            return false;
+
+        if (m->GetPacket29Flag() && _packet29Run[mag] != RUN_DONE)
+            return false;
+
+        if (!m->GetNormalPages()->AllSent(_sent[mag]))
+            return false;
+    }
+    return true;
+}
+
+void CycleSchedule::_finish()
+{
+    // The pages that the magazines are part way through are left out. Playing out starts each magazine at a header
+    for (int mag = 0; mag < 8; mag++)
+    {
+        if (_open[mag] >= 0)
+        {
+            _drop(_open[mag]);
+        }
+        _open[mag] = -1;
+        _mags[mag]->EndPage();
+    }
+
+    _headers = 0;
+    uint32_t copied = 0;
+    for (uint32_t i = 0; i < _slots.size(); i++)
+    {
+        if (_slots[i].mag >= 0 && _isHeader(_slots[i]))
+        {
+            _headers |= 1 << _slots[i].mag;
+        }
+        if (_slots[i].kind == SLOT_STATIC)
+        {
+            copied++;
+        }
+    }
+
+    uint32_t pages = 0;
+    for (uint32_t i = 0; i < _records.size(); i++)
+    {
+        if (_records[i].page)
+        {
+            pages++;
+        }
+    }
+
+    _state = REPLAYING;
+    _cursor = 0;
+    _releasing = false;
+    _released = 0;
+
+    std::stringstream ss;
+    ss << "[CycleSchedule::_finish] playing out a cycle of " << _fields << " fields with " << pages << " pages. ";
+    ss << std::fixed << std::setprecision(1) << (_slots.empty() ? 0 : copied * 100.0 / _slots.size()) << "% of lines are copied\n";
+    std::cerr << ss.str();
+}
+
+void CycleSchedule::_clear()
+{
+    _state = IDLE;
+    _slots.clear();
+    _lines.clear();
+    _live.clear();
+    _records.clear();
+    _cursor = 0;
+    _headers = 0;
+    _releasing = false;
+    _released = 0;
+}
+
+int CycleSchedule::_magazine(PacketSource* source)
+{
+    for (int mag = 0; mag < 8; mag++)
+    {
+        if (source == _mags[mag])
+            return mag;
+    }
+    return -1;
+}
+
+void CycleSchedule::_recordHeader(Packet* pkt, int mag, uint32_t index)
+{
+    if (_open[mag] >= 0)
+    {
+        _sent[mag].insert(_records[_open[mag]].page); // a header ends the magazine's last page
+    }
+    _open[mag] = -1;
+
+    if (_specialRun[mag] == RUN_CLEARED)
+    {
+        _specialRun[mag] = RUN_DONE;
+    }
+    if (_packet29Run[mag] == RUN_CLEARED)
+    {
+        _packet29Run[mag] = RUN_DONE;
+    }
+
+    Slot& slot = _slots[index];
+    slot.mag = mag;
+
+    TTXPageStream* page = _mags[mag]->GetPage();
+    if (page == nullptr)
+    {
+        _setLine(index, pkt); // a time filling header
+        return;
+    }
+
+    if (_mags[mag]->IsOneOff())
+    {
+        _abandon = true; // the page goes out differently next time
+        return;
+    }
+
+    PageRecord record;
+    record.page = page;
+    record.mag = mag;
+    record.carousel = page->IsCarousel() && !page->Special(); // special pages don't step through their subpages
+    record.header = 0;
+    record.content = 0;
+    record.rows = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        record.chain[i] = 0;
+    }
+
+    if (record.carousel)
+    {
+        slot.kind = SLOT_CAROUSEL_HEADER;
+    }
+    else
+    {
+        slot.kind = SLOT_HEADER;
+        slot.live = _live.size();
+        _live.push_back(*pkt);
+        record.header = _headerStamp(page);
+        record.content = _contentStamp(page);
+
+        int* links = page->IsCarousel() ? page->GetCarouselPage()->GetLinkSet() : page->GetLinkSet();
+        _fastext[mag] = (links[0] & links[1] & links[2] & links[3] & links[4] & links[5]) != 0x8FF;
+
+        _chain28[mag] = 0;
+        for (TTXLine* line = page->GetTxRow(28); line != nullptr; line = line->GetNextLine())
+        {
+            _chain28[mag]++;
+        }
+    }
+
+    slot.record = _records.size();
+    _open[mag] = slot.record;
+    _records.push_back(record);
+}
+
+void CycleSchedule::_recordRow(Packet* pkt, int mag, uint32_t index)
+{
+    Slot& slot = _slots[index];
+    PageRecord& record = _records[_open[mag]];
+    slot.mag = mag;
+    slot.record = _open[mag];
+
+    if (record.carousel)
+    {
+        slot.kind = SLOT_CAROUSEL;
+        return;
+    }
+
+    slot.row = pkt->GetRow();
+    if (slot.row == 27 && _fastext[mag])
+    {
+        _fastext[mag] = false; // fastext goes first
+        slot.index = DERIVED;
+    }
+    else if (slot.row == 28 && record.chain[2] >= _chain28[mag])
+    {
+        slot.index = DERIVED; // X/28/0 for the region
+    }
+    else if (slot.row > 25)
+    {
+        slot.index = record.chain[slot.row - 26]++;
+    }
+    else
+    {
+        record.rows |= 1 << slot.row;
+    }
+    _setLine(index, pkt);
+}
+
+void CycleSchedule::_setLine(uint32_t index, Packet* pkt)
+{
+    Slot& slot = _slots[index];
+    if (pkt->HasSubstitutions())
+    {
+        if (slot.kind == SLOT_LIVE)
+        {
+            _live[slot.live] = *pkt;
+        }
+        else
+        {
+            slot.kind = SLOT_LIVE;
+            slot.live = _live.size();
+            _live.push_back(*pkt);
+        }
+    }
+    else
+    {
+        slot.kind = SLOT_STATIC;
+        _lines[index] = pkt->Get_packet();
+    }
+}
+
+void CycleSchedule::_drop(int32_t record)
+{
+    for (uint32_t i = 0; i < _records[record].slots.size(); i++)
+    {
+        uint32_t index = _records[record].slots[i];
+        Slot slot = {SLOT_STATIC, -1, 0, 0, -1, 0, nullptr};
+        _slots[index] = slot;
+        _lines[index] = _filler;
+    }
+    _records[record].slots.clear();
+    _records[record].page = nullptr;
+}
+
+bool CycleSchedule::_isHeader(const Slot& slot)
+{
+    return slot.kind == SLOT_HEADER || slot.kind == SLOT_CAROUSEL_HEADER || (slot.kind == SLOT_LIVE && _live[slot.live].IsHeader());
+}
+
+void CycleSchedule::_check(PageRecord& record, Packet* work)
+{
+    if (_headerStamp(record.page) != record.header)
+    {
+        std::stringstream ss;
+        ss << "P" << std::hex << std::uppercase << (record.page->GetPageNumber() >> 8) << " has a different header";
+        _release(ss.str());
+        record.header = _headerStamp(record.page); // only say so once
+    }
+
+    uint64_t content = _contentStamp(record.page);
+    if (content == record.content)
+        return;
+    record.content = content;
+
+    TTXPageStream* page = record.page;
+    bool skipBlank = _configure->GetRowAdaptive() || page->GetPageFunction() != LOP; // as PacketMag does
+    for (uint32_t i = 0; i < record.slots.size(); i++)
+    {
+        uint32_t index = record.slots[i];
+        Slot& slot = _slots[index];
+        if (slot.row == 0 || slot.index == DERIVED)
+            continue; // the header, a line that had nothing, or a packet made from the header fields
+
+        TTXLine* line = page->GetTxRow(slot.row);
+        for (int n = 0; line != nullptr && slot.row > 25 && n < slot.index; n++)
+        {
+            line = line->GetNextLine();
+        }
+
+        if (line == nullptr || (slot.row < 26 && skipBlank && line->IsBlank()))
+        {
+            slot.kind = SLOT_STATIC;
+            _lines[index] = _filler; // _fits tells
+            continue;
+        }
+
+        PageCoding coding = page->GetPageCoding();
+        if (slot.row == 27)
+        {
+            coding = ((line->GetLine()[0] & 0xF) > 3) ? CODING_13_TRIPLETS : CODING_HAMMING_8_4;
+        }
+        else if (slot.row > 25)
+        {
+            coding = CODING_13_TRIPLETS;
+        }
+        work->SetRow(record.mag, slot.row, line, coding);
+        _setLine(index, work);
+    }
+
+    if (!_fits(record))
+    {
+        std::stringstream ss;
+        ss << "P" << std::hex << std::uppercase << (page->GetPageNumber() >> 8) << " has rows that don't fit its lines";
+        _release(ss.str());
+    }
+}
+
+bool CycleSchedule::_fits(PageRecord& record)
+{
+    TTXPageStream* page = record.page;
+    bool skipBlank = _configure->GetRowAdaptive() || page->GetPageFunction() != LOP;
+
+    uint32_t rows = 0;
+    for (int row = 1; row < 26; row++)
+    {
+        TTXLine* line = page->GetTxRow(row);
+        if (line != nullptr && !(skipBlank && line->IsBlank()))
+        {
+            rows |= 1 << row;
+        }
+    }
+    if (rows != record.rows)
+        return false;
+
+    for (int i = 0; i < 3; i++)
+    {
+        uint8_t count = 0;
+        for (TTXLine* line = page->GetTxRow(26 + i); line != nullptr; line = line->GetNextLine())
+        {
+            count++;
+        }
+        if (count != record.chain[i])
+            return false;
+    }
+    return true;
+}
+
+void CycleSchedule::_release(const std::string& reason)
+{
+    if (_releasing)
+        return;
+
+    std::stringstream ss;
+    ss << "[CycleSchedule::_release] " << reason << ", going back to live generation\n";
+    std::cerr << ss.str();
+    _releasing = true;
+    _released = 0;
+}
+
+uint64_t CycleSchedule::_headerStamp(TTXPageStream* page)
+{
+    TTXPage* p = page->IsCarousel() ? page->GetCarouselPage() : page; // what PacketMag takes the header from
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    mix(&hash, page->GetPageNumber());
+    mix(&hash, p->GetPageStatus());
+    mix(&hash, p->GetSubCode());
+    mix(&hash, p->GetRegion());
+    mix(&hash, page->GetPageCoding());
+    mix(&hash, page->GetPageFunction());
+    int* links = p->GetLinkSet();
+    for (int i = 0; i < 6; i++)
+    {
+        mix(&hash, links[i]);
+    }
+    if (page->Special())
+    {
+        mix(&hash, page->GetUpdateCount()); // special pages have these in their subcode
+        mix(&hash, p->GetLastPacket());
+    }
+    return hash;
+}
+
+uint64_t CycleSchedule::_contentStamp(TTXPageStream* page)
+{
+    // generations are never reused, so this changes whenever a row is changed, added or replaced
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int row = 1; row < 29; row++)
+    {
+        mix(&hash, row);
+        for (TTXLine* line = page->GetTxRow(row); line != nullptr; line = (row > 25) ? line->GetNextLine() : nullptr)
+        {
+            mix(&hash, line->GetGeneration());
+        }
+    }
+    return hash;
+}
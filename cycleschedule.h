@@ -0,0 +1,168 @@
+#ifndef _CYCLESCHEDULE_H_
+#define _CYCLESCHEDULE_H_
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <set>
+#include <string>
+
+#include "configure.h"
+#include "pagelist.h"
+#include "packet.h"
+#include "packetsource.h"
+#include "packetmag.h"
+
+/**
+ * Plays out a recording of one whole cycle of the magazines rather than generating every line.
+ *
+ * Service generates lines as usual while they are recorded, starting at a field boundary, until
+ * every magazine has sent each of its pages, and its special pages and packet 29, and a multiple
+ * of 10 fields has gone so that packet 8/30 and the debug packet stay on their lines. The
+ * page each magazine is part way through at either end is left out. The recording is then sent
+ * again and again, mostly by copying it.
+ *
+ * Headers and rows with substitutions are kept as packets and go through Packet::tx() every time,
+ * so clocks and page numbers stay live. Carousels go back to their magazine at their lines because
+ * their subpages change, and packet 8/30 and the debug packet come from their sources.
+ * When a page changes, its rows are encoded again in place when its header next comes round.
+ * Changes that don't fit the recording, such as a page being added or gaining a row, hand each
+ * magazine back to live generation when it next starts a page, and another cycle is recorded.
+ */
+
+namespace vbit
+{
+    class CycleSchedule
+    {
+        public:
+            /**
+             * @param configure
+             * @param pageList Its magazines are recorded and played out
+             * @param linesPerField
+             * @param timedSources Sources that send on particular fields, such as packet 8/30. They are asked for a packet at their lines
+             */
+            CycleSchedule(ttx::Configure* configure, ttx::PageList* pageList, uint16_t linesPerField, std::vector<PacketSource*> timedSources);
+
+            /** Call at the start of every field, after the sources have their events
+             *  @return true if the lines of this field come from Replay(), otherwise generate them and pass each one to Record()
+             */
+            bool StartField();
+
+            /** Record a line that was generated live
+             *  @param pkt The packet before tx(), or nullptr if nothing went out
+             *  @param source The source the line was asked from, or nullptr
+             */
+            void Record(Packet* pkt, PacketSource* source);
+
+            /** @param work A packet to build lines in
+             *  @param source Receives the source to count the line against, nullptr for a filler
+             *  @return The next line of the cycle
+             */
+            std::array<uint8_t, PACKETSIZE>* Replay(Packet* work, PacketSource** source);
+
+            /** Go back to live generation now, e.g. for a subtitle. Pages part way out are cut short */
+            void Stop();
+
+        private:
+            enum State {IDLE, RECORDING, REPLAYING};
+
+            enum SlotKind : uint8_t
+            {
+                SLOT_STATIC, // _lines holds the line
+                SLOT_LIVE, // _live holds a packet that goes through tx()
+                SLOT_HEADER, // as SLOT_LIVE, and the page is checked for changes
+                SLOT_SOURCE, // asked from a timed source
+                SLOT_CAROUSEL_HEADER, // the magazine sends the carousel
+                SLOT_CAROUSEL // the magazine sends the next line of the carousel
+            };
+
+            struct Slot
+            {
+                SlotKind kind;
+                int8_t mag; // magazine 0..7 the line belongs to, -1 for none
+                uint8_t row; // row of the page the line was made from, 0 for none
+                uint8_t index; // position in the chain of packets 26, 27 or 28
+                int32_t record; // index in _records of the page the line belongs to, -1 for none
+                uint32_t live; // index in _live
+                PacketSource* source; // for SLOT_SOURCE
+            };
+
+            /** One transmission of a page in the recording */
+            struct PageRecord
+            {
+                TTXPageStream* page; // nullptr once it is left out
+                uint8_t mag;
+                bool carousel;
+                uint64_t header; // hash of what goes into the header and the packets made from it
+                uint64_t content; // hash of the rows
+                uint32_t rows; // bit n for row n, 1..25, that went out
+                uint8_t chain[3]; // packets 26, 27 and 28 that went out
+                std::vector<uint32_t> slots;
+            };
+
+            enum Run {RUN_NONE, RUN_ACTIVE, RUN_CLEARED, RUN_DONE}; // progress of a special pages or packet 29 event
+
+            ttx::Configure* _configure;
+            ttx::PageList* _pageList;
+            PacketMag* _mags[8];
+            uint16_t _linesPerField;
+            std::vector<PacketSource*> _timedSources;
+            std::array<uint8_t, PACKETSIZE> _filler;
+
+            State _state;
+            std::vector<Slot> _slots; // one for each line of the cycle
+            std::vector<std::array<uint8_t, PACKETSIZE>> _lines;
+            std::vector<Packet> _live;
+            std::vector<PageRecord> _records;
+            uint32_t _cursor; // next slot to play out
+            unsigned int _changes; // page set changes counted by the magazines when the recording started
+
+            // while recording
+            uint32_t _fields;
+            bool _abandon; // something went out that won't go out the same way again
+            int32_t _open[8]; // record of the page each magazine is sending, -1 for none
+            std::set<TTXPageStream*> _sent[8]; // pages each magazine has sent all of
+            Run _specialRun[8];
+            Run _packet29Run[8];
+            bool _fastext[8]; // the next packet 27 is fastext made from the links
+            uint8_t _chain28[8]; // packets 28 in the page. Any more are X/28/0 made from the header
+
+            // while playing out
+            uint8_t _headers; // bit n set if magazine n has a header in the cycle
+            bool _releasing; // magazines go back to live generation as they start their next page
+            uint8_t _released; // bit n set if magazine n has gone back
+
+            unsigned int _countChanges();
+            bool _eventActive(int mag);
+            bool _canRecord();
+            void _startRecording(unsigned int changes);
+            void _watchEvents();
+            bool _complete();
+            void _finish();
+            void _clear();
+            int _magazine(PacketSource* source);
+            void _recordHeader(Packet* pkt, int mag, uint32_t index);
+            void _recordRow(Packet* pkt, int mag, uint32_t index);
+
+            /** Put a packet in a slot, as it is or for tx() */
+            void _setLine(uint32_t index, Packet* pkt);
+
+            /** Leave a page out of the cycle */
+            void _drop(int32_t record);
+
+            bool _isHeader(const Slot& slot);
+
+            /** Check a page for changes as its header goes out and encode its rows again if they have changed */
+            void _check(PageRecord& record, Packet* work);
+
+            /** @return true if the page has the rows it was recorded with */
+            bool _fits(PageRecord& record);
+
+            void _release(const std::string& reason);
+
+            static uint64_t _headerStamp(TTXPageStream* page);
+            static uint64_t _contentStamp(TTXPageStream* page);
+    };
+}
+
+#endif // _CYCLESCHEDULE_H_
@@ -53,12 +53,18 @@ void FileMonitor::run()
 
     while (true)
     {
-        _pageList->ClearFlags(); // Assume that no files exist
+        {
+            std::lock_guard<std::mutex> lock(_pageList->GetListMutex());
+            _pageList->ClearFlags(); // Assume that no files exist
+        }
         
         readDirectory(path);
         
-        // Delete pages that no longer exist (this blocks the thread until the pages are removed)
-        _pageList->DeleteOldPages();
+        {
+            // Delete pages that no longer exist (this blocks the thread until the pages are removed)
+            std::lock_guard<std::mutex> lock(_pageList->GetListMutex());
+            _pageList->DeleteOldPages();
+        }
 
         // Wait 5 seconds to avoid hogging cpu
         // Sounds like a job for a mutex.
@@ -117,12 +123,20 @@ int FileMonitor::readDirectory(std::string path)
         {
             // Now we want to process changes
             // 1) Is it a new page? Then add it.
-            TTXPageStream* q=_pageList->Locate(name);
+            TTXPageStream* q;
+            {
+                std::lock_guard<std::mutex> lock(_pageList->GetListMutex()); // the magazines add uploaded pages
+                q=_pageList->Locate(name);
+            }
             if (q) // File was found
             {
                 if (!(q->GetStatusFlag()==TTXPageStream::MARKED || q->GetStatusFlag()==TTXPageStream::GONE)) // file is not mid-deletion
                 {
-                    if (attrib.st_mtime!=q->GetModifiedTime()) // File exists. Has it changed?
+                    if (attrib.st_mtime!=q->GetModifiedTime() && _pageList->GetPageWriter()->IsOwnWrite(name, attrib))
+                    {
+                        q->SetModifiedTime(attrib.st_mtime); // saved from the page in memory, so there is nothing to load
+                    }
+                    else if (attrib.st_mtime!=q->GetModifiedTime()) // File exists. Has it changed?
                     {
                         // We just load the new page and update the modified time
                         // This isn't good enough.
@@ -134,6 +148,7 @@ int FileMonitor::readDirectory(std::string path)
                         q->GetPageCount(); // renumber the subpages
                         int mag=(q->GetPageNumber() >> 16) & 0x7;
                         
+                        std::lock_guard<std::mutex> lock(_pageList->GetListMutex());
                         if ((!(q->GetSpecialFlag())) && (q->Special()))
                         {
                             // page was not 'special' but now is, add to SpecialPages list
@@ -175,6 +190,11 @@ int FileMonitor::readDirectory(std::string path)
                         
                         _pageList->CheckForPacket29(q);
                         
+                        if (q->GetSpecialFlag() || q->GetCarouselFlag())
+                        {
+                            _pageList->GetMagazines()[mag]->PageSetChanged(); // special pages and carousels may not fit the lines they had
+                        }
+                        
                         q->SetModifiedTime(attrib.st_mtime);
                         // unlock
                     }
@@ -190,6 +210,7 @@ int FileMonitor::readDirectory(std::string path)
                 
                 if ((q=new TTXPageStream(name)))
                 {
+                    std::lock_guard<std::mutex> lock(_pageList->GetListMutex());
                     _pageList->AddPage(q);
                     if((q=_pageList->Locate(name))) // get pointer to copy in list
                     {
@@ -228,6 +249,7 @@ int FileMonitor::readDirectory(std::string path)
                         }
                         
                         _pageList->CheckForPacket29(q);
+                        _pageList->GetMagazines()[mag]->PageSetChanged();
                     }
                     else
                     {
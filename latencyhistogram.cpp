@@ -0,0 +1,73 @@
+/** LatencyHistogram
+ */
+#include "latencyhistogram.h"
+
+#include <sstream>
+#include <cmath>
+#include <iomanip>
+
+using namespace vbit;
+
+LatencyHistogram::LatencyHistogram()
+{
+    Reset();
+}
+
+void LatencyHistogram::Reset()
+{
+    _buckets.fill(0);
+    _count = 0;
+    _max = 0;
+}
+
+void LatencyHistogram::Add(uint64_t microseconds)
+{
+    unsigned int bucket = 0;
+    while (bucket < _buckets.size() - 1 && (microseconds >> bucket))
+        bucket++;
+    _buckets[bucket]++;
+    _count++;
+    if (microseconds > _max)
+        _max = microseconds;
+}
+
+uint64_t LatencyHistogram::Percentile(double fraction)
+{
+    if (_count == 0)
+        return 0;
+
+    uint64_t target = std::ceil(fraction * _count); // the sample that at least this fraction are no later than
+    if (target < 1)
+        target = 1;
+
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < _buckets.size(); i++)
+    {
+        seen += _buckets[i];
+        if (seen >= target)
+        {
+            uint64_t top = (i == 0) ? 0 : ((uint64_t)1 << i) - 1;
+            return (top < _max) ? top : _max;
+        }
+    }
+    return _max;
+}
+
+std::string LatencyHistogram::Summary()
+{
+    std::stringstream ss;
+    ss << "p50 " << Format(Percentile(0.5)) << " p99 " << Format(Percentile(0.99)) << " max " << Format(_max);
+    return ss.str();
+}
+
+std::string LatencyHistogram::Format(uint64_t microseconds)
+{
+    std::stringstream ss;
+    if (microseconds < 1000)
+        ss << microseconds << "us";
+    else if (microseconds < 1000000)
+        ss << std::fixed << std::setprecision(1) << microseconds / 1000.0 << "ms";
+    else
+        ss << std::fixed << std::setprecision(2) << microseconds / 1000000.0 << "s";
+    return ss.str();
+}
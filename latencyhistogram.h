@@ -0,0 +1,49 @@
+#ifndef _LATENCYHISTOGRAM_H_
+#define _LATENCYHISTOGRAM_H_
+
+#include <cstdint>
+#include <array>
+#include <string>
+
+/**
+ * Histogram of latencies in microseconds.
+ * Bucket n holds values from 2^(n-1) up to 2^n-1 so that adding a value is cheap enough
+ * to do for every field. Percentiles are therefore rounded up to the next power of two,
+ * except that they never exceed the largest value seen.
+ */
+
+namespace vbit
+{
+    class LatencyHistogram
+    {
+        public:
+            LatencyHistogram();
+
+            /** Count one latency */
+            void Add(uint64_t microseconds);
+
+            void Reset();
+
+            uint64_t GetCount(){return _count;};
+
+            uint64_t GetMax(){return _max;};
+
+            /** @param fraction e.g. 0.99 for the 99th percentile
+             *  @return Latency that fraction of the values are no greater than, or 0 if there are none
+             */
+            uint64_t Percentile(double fraction);
+
+            /** @return p50, p99 and max formatted for a log line */
+            std::string Summary();
+
+            /** @return A latency formatted in us, ms or s */
+            static std::string Format(uint64_t microseconds);
+
+        private:
+            std::array<uint64_t, 40> _buckets;
+            uint64_t _count;
+            uint64_t _max;
+    };
+}
+
+#endif // _LATENCYHISTOGRAM_H_
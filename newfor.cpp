@@ -16,8 +16,6 @@
 
 // Packet Subtitles are stored here
 
-static uint8_t _page; /// Page number (in hex). This is set by Page Init
-static uint8_t _rowcount; /// Number of rows in this subtitle
 // static char packet[PACKETSIZE];
 
 using namespace vbit;
@@ -31,7 +29,10 @@ vbi_unham8 (unsigned int c)
 
 
 Newfor::Newfor(PacketSubtitle* subtitle) :
-    _subtitle(subtitle)
+    _subtitle(subtitle),
+    _received(0),
+    _page(0),
+    _rowcount(0)
 {
     ttxpage.SetSubCode(0);
 }
@@ -85,7 +86,8 @@ void Newfor::SubtitleOnair(char* response)
 {
     strcpy(response,"Response not implemented, sorry\n");
     // Send the page to the subtitle object in the service thread, then clear the lines.
-    _subtitle->SendSubtitle(&ttxpage);
+    _subtitle->SendSubtitle(&ttxpage, 0, 0, _received, PacketSubtitle::Timestamp());
+    _received=0;
 
     for (int i=0;i<24;i++) // Some broadcasters sent the subs out more than once. We don't.
     {
@@ -95,7 +97,8 @@ void Newfor::SubtitleOnair(char* response)
 
 void Newfor::SubtitleOffair()
 {
-    _subtitle->SendSubtitle(&ttxpage); // OnAir will already have cleared out these lines so just send the page again
+    _subtitle->SendSubtitle(&ttxpage, 0, 0, _received, PacketSubtitle::Timestamp()); // OnAir will already have cleared out these lines so just send the page again
+    _received=0;
 }
 
 /**
@@ -63,6 +63,13 @@ namespace vbit
             */
             void saveSubtitleRow(uint8_t mag, uint8_t row, char* cmd);
 
+            /**
+            * Note when the first byte of a subtitle arrived, for latency measurement.
+            * Only the first call after a subtitle has gone to the service counts.
+            * @param timestamp PacketSubtitle::Timestamp() of the byte
+            */
+            void Received(uint64_t timestamp){if (!_received) _received=timestamp;};
+
         private:
             // Constants
             static const uint8_t SUBTITLEPACKETCOUNT=8;
@@ -88,6 +95,9 @@ namespace vbit
             // instead of this we populate a ttxpage onject
             // extern bufferpacket packetCache[1]; // Commands are read into here, and transferred out when OnAir
             PacketSubtitle* _subtitle;
+            uint64_t _received; // Timestamp() of the first byte of the subtitle being built, 0 if none yet
+            uint16_t _page; /// Page number (in hex). This is set by Page Init
+            uint8_t _rowcount; /// Number of rows in this subtitle
     };
 }
 #endif
@@ -1,6 +1,8 @@
 
 #include "normalpages.h"
 
+#include <algorithm>
+
 using namespace vbit;
 
 NormalPages::NormalPages()
@@ -8,6 +10,8 @@ NormalPages::NormalPages()
     _iter=_NormalPagesList.begin();
     _page=nullptr;
     _needSorting = false;
+    _nextRepeat = 0;
+    _position = 0;
 }
 
 NormalPages::~NormalPages()
@@ -33,11 +37,21 @@ TTXPageStream* NormalPages::NextPage()
         }
         _iter=_NormalPagesList.begin();
         _page = *_iter;
+        _position = 0;
+        scheduleRepeats();
     }
     else
     {
+        while (_nextRepeat < _repeats.size() && _repeats[_nextRepeat].first <= _position)
+        {
+            // an extra transmission of a repeated page is due before carrying on through the list
+            TTXPageStream* p = _repeats[_nextRepeat++].second;
+            if (p && p->GetStatusFlag() != TTXPageStream::MARKED && !p->Special())
+                return p;
+        }
         ++_iter;
         _page = *_iter;
+        ++_position;
     }
 
 loop:
@@ -49,31 +63,158 @@ loop:
     if (_page)
     {
         /* remove pointers from this list if the pages are marked for deletion */
-        
-        if (_page->GetStatusFlag()==TTXPageStream::MARKED && _page->GetNormalFlag()) // only remove it once
+        if (checkRemoved(_page))
         {
-            std::stringstream ss;
-            ss << "[NormalPages::NextPage] Deleted " << _page->GetSourcePage() << "\n";
-            std::cerr << ss.str();
             _iter = _NormalPagesList.erase(_iter);
-            _page->SetNormalFlag(false);
-            if (!(_page->GetSpecialFlag() || _page->GetCarouselFlag() || _page->GetUpdatedFlag()))
-                _page->SetState(TTXPageStream::GONE); // if we are last mark it gone
             _page = *_iter;
             goto loop; // jump back to try for the next page
         }
+    }
+    
+    return _page;
+}
+
+TTXPageStream* NormalPages::NextPageByDeadline(uint64_t field, uint64_t lead, std::map<int, uint64_t> &intervals, uint64_t defaultInterval)
+{
+    if (_needSorting)
+    {
+        // keep the list in page number order so that ties go in page order
+        _NormalPagesList.sort(pageLessThan<TTXPageStream>());
+        _needSorting = false;
+    }
+    
+    TTXPageStream* due = nullptr; // page with the earliest deadline that needs to go now
+    uint64_t dueDeadline = 0;
+    TTXPageStream* oldest = nullptr; // page that was sent longest ago
+    uint64_t oldestAge = 0;
+    
+    for (std::list<TTXPageStream*>::iterator it=_NormalPagesList.begin(); it!=_NormalPagesList.end();)
+    {
+        TTXPageStream* p = *it;
         
-        if (_page->Special())
+        if (checkRemoved(p))
         {
-            std::stringstream ss;
-            ss << "[NormalPages::NextPage] page became Special"  << std::hex << _page->GetPageNumber() << "\n";
-            std::cerr << ss.str();
-            _iter = _NormalPagesList.erase(_iter);
-            _page->SetNormalFlag(false);
-            _page = *_iter;
-            goto loop; // jump back to try for the next page
+            it = _NormalPagesList.erase(it);
+            continue;
+        }
+        
+        int status = p->IsCarousel() ? p->GetCarouselPage()->GetPageStatus() : p->GetPageStatus();
+        if (!(status & PAGESTATUS_TRANSMITPAGE))
+        {
+            // PacketMag won't send it so it never gets a new lastTxField, and would always be the most overdue
+            ++it;
+            continue;
+        }
+        
+        uint64_t interval = defaultInterval;
+        std::map<int, uint64_t>::iterator found = intervals.find((p->GetPageNumber() >> 8) & 0xFF);
+        if (found != intervals.end())
+        {
+            interval = found->second;
         }
+        
+        if (interval)
+        {
+            uint64_t deadline = p->GetLastTxField() + interval;
+            if (deadline <= field + lead && (due == nullptr || deadline < dueDeadline))
+            {
+                due = p;
+                dueDeadline = deadline;
+            }
+        }
+        
+        uint64_t age = (field - std::min(field, p->GetLastTxField())) * getRepeats(p);
+        if (oldest == nullptr || age > oldestAge)
+        {
+            oldest = p;
+            oldestAge = age;
+        }
+        ++it;
     }
     
-    return _page;
+    _page = nullptr; // sequential iteration has to start again if the mode ever changes
+    
+    return due ? due : oldest;
+}
+
+bool NormalPages::AllSent(const std::set<TTXPageStream*> &pages)
+{
+    for (std::list<TTXPageStream*>::iterator it=_NormalPagesList.begin(); it!=_NormalPagesList.end(); ++it)
+    {
+        TTXPageStream* p = *it;
+        if (p->GetStatusFlag() == TTXPageStream::MARKED || p->Special())
+            continue; // on its way out of the list
+        
+        int status = p->IsCarousel() ? p->GetCarouselPage()->GetPageStatus() : p->GetPageStatus();
+        if ((status & PAGESTATUS_TRANSMITPAGE) && pages.find(p) == pages.end())
+            return false;
+    }
+    return true;
+}
+
+bool NormalPages::checkRemoved(TTXPageStream* p)
+{
+    if (p->GetStatusFlag()==TTXPageStream::MARKED && p->GetNormalFlag()) // only remove it once
+    {
+        std::stringstream ss;
+        ss << "[NormalPages::checkRemoved] Deleted " << p->GetSourcePage() << "\n";
+        std::cerr << ss.str();
+        p->SetNormalFlag(false);
+        if (!(p->GetSpecialFlag() || p->GetCarouselFlag() || p->GetUpdatedFlag()))
+            p->SetState(TTXPageStream::GONE); // if we are last mark it gone
+        removeRepeats(p); // the page may be deleted before the cycle ends
+        return true;
+    }
+    
+    if (p->Special())
+    {
+        std::stringstream ss;
+        ss << "[NormalPages::NextPage] page became Special"  << std::hex << p->GetPageNumber() << "\n";
+        std::cerr << ss.str();
+        p->SetNormalFlag(false);
+        removeRepeats(p);
+        return true;
+    }
+    
+    return false;
+}
+
+int NormalPages::getRepeats(TTXPageStream* p)
+{
+    std::map<int, int>::iterator found = _repeatCounts.find((p->GetPageNumber() >> 8) & 0xFF);
+    if (found != _repeatCounts.end())
+        return found->second;
+    return 1;
+}
+
+void NormalPages::scheduleRepeats()
+{
+    _repeats.clear();
+    _nextRepeat = 0;
+    
+    if (_repeatCounts.empty())
+        return;
+    
+    int size = _NormalPagesList.size();
+    int index = 0;
+    for (std::list<TTXPageStream*>::iterator it=_NormalPagesList.begin(); it!=_NormalPagesList.end(); ++it, ++index)
+    {
+        int count = getRepeats(*it);
+        for (int i = 1; i < count; i++)
+        {
+            // space the extra transmissions evenly from the page's normal position, wrapping round to the start of the cycle
+            _repeats.push_back(std::make_pair((index + (i * size) / count) % size, *it));
+        }
+    }
+    std::stable_sort(_repeats.begin(), _repeats.end(),
+        [](const std::pair<int, TTXPageStream*> &a, const std::pair<int, TTXPageStream*> &b){ return a.first < b.first; });
+}
+
+void NormalPages::removeRepeats(TTXPageStream* p)
+{
+    for (unsigned int i = _nextRepeat; i < _repeats.size(); i++)
+    {
+        if (_repeats[i].second == p)
+            _repeats[i].second = nullptr;
+    }
 }
@@ -2,6 +2,9 @@
 #define _NORMALPAGES_H
 
 #include <list>
+#include <map>
+#include <set>
+#include <vector>
 
 #include "ttxpagestream.h"
 
@@ -20,16 +23,60 @@ class NormalPages
 
         TTXPageStream* NextPage();
 
+        /** Deadline scheduling
+         *  A page with a maximum interval is due that many fields after it was last sent.
+         *  Any page that will be due within lead fields goes next, earliest deadline first.
+         *  Otherwise the page that was sent longest ago goes next, with the time since a
+         *  page was sent multiplied by its repeat count.
+         *  @param field The current field count
+         *  @param lead Fields to allow for sending a page
+         *  @param intervals Maximum fields between transmissions keyed by page number (00..ff)
+         *  @param defaultInterval Used for pages that are not in intervals. 0 for no deadline
+         *  @return The page to send or nullptr if there are no pages
+         */
+        TTXPageStream* NextPageByDeadline(uint64_t field, uint64_t lead, std::map<int, uint64_t> &intervals, uint64_t defaultInterval);
+
         void addPage(TTXPageStream* p);
+        
+        /** Set how many times pages go out in each cycle
+         *  Extra transmissions are spread evenly through the cycle.
+         *  @param repeats Transmissions per cycle keyed by page number (00..ff)
+         */
+        void SetRepeats(std::map<int, int> repeats){ _repeatCounts = repeats; };
+        
+        int GetPageCount(){ return _NormalPagesList.size(); };
+        
+        /** @param pages Pages that have been sent
+         *  @return true if every page in the list that is transmitted is in pages
+         */
+        bool AllSent(const std::set<TTXPageStream*> &pages);
 
     protected:
 
     private:
+        /** Tidy up pages that have been deleted or become special
+         *  @return true if the page should be removed from this list
+         */
+        bool checkRemoved(TTXPageStream* p);
+        
+        /** Build the list of extra transmissions for the cycle that is starting */
+        void scheduleRepeats();
+        
+        /** Drop any outstanding extra transmissions of a page */
+        void removeRepeats(TTXPageStream* p);
+        
+        int getRepeats(TTXPageStream* p);
+        
         std::list<TTXPageStream*> _NormalPagesList;
         std::list<TTXPageStream*>::iterator _iter;
         TTXPageStream* _page;
         bool _needSorting;
         
+        std::map<int, int> _repeatCounts;
+        std::vector<std::pair<int, TTXPageStream*>> _repeats; // extra transmissions ordered by position in the cycle
+        unsigned int _nextRepeat; // index of the next entry in _repeats
+        int _position; // position of _page in the current cycle
+        
         template <typename TTXPageStream>
         struct pageLessThan
         {
@@ -0,0 +1,269 @@
+/** OutputSink
+ */
+#include "outputsink.h"
+#include "vbit2.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#ifndef WIN32
+#include <poll.h>
+#include <climits>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+using namespace vbit;
+
+OutputSink::OutputSink(std::string format, std::string destination, Backpressure policy, unsigned int bufferFields, unsigned int fieldBytes) :
+    _destination(destination),
+    _policy(policy),
+    _isOpen(false),
+    _fd(-1),
+    _ring(nullptr),
+    _start(0),
+    _end(0),
+    _fieldStart(0),
+    _dropping(false),
+    _droppedFields(0),
+    _droppedReported(0),
+    _writtenFields(0),
+    _stalls(0)
+{
+    _open(format, bufferFields, fieldBytes);
+    
+    if (_ring)
+        return; // fields are built in the ring
+    
+    if (_policy == Block)
+        bufferFields = 1; // everything is written out at the end of each field
+    _buffer.resize((bufferFields + 1) * fieldBytes); // room for the waiting fields and the one being built
+}
+
+OutputSink::~OutputSink()
+{
+    if (_fd > STDERR_FILENO)
+        close(_fd);
+    delete _ring;
+}
+
+void OutputSink::_open(std::string format, unsigned int bufferFields, unsigned int fieldBytes)
+{
+    if (_destination.compare(0, 4, "shm:") == 0)
+    {
+        _ring = new ShmRing(_destination.substr(4), format, bufferFields, fieldBytes);
+        _isOpen = _ring->IsOpen(); // there is no file descriptor
+        return;
+    }
+    else if (_destination == "-")
+    {
+        _fd = STDOUT_FILENO;
+    }
+#ifndef WIN32
+    else if (_destination.compare(0, 5, "unix:") == 0)
+    {
+        std::string path = _destination.substr(5);
+        struct sockaddr_un addr;
+        if (path.size() >= sizeof(addr.sun_path))
+        {
+            _close("socket path is too long");
+            return;
+        }
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strcpy(addr.sun_path, path.c_str());
+
+        _fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (_fd < 0 || connect(_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+        {
+            _close(std::strerror(errno));
+            return;
+        }
+    }
+#endif
+    else
+    {
+        _fd = open(_destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (_fd < 0)
+        {
+            _close(std::strerror(errno));
+            return;
+        }
+    }
+
+#ifndef WIN32
+    if (_policy == Drop && _fd != STDOUT_FILENO)
+    {
+        // never wait for the destination. stdout's file description is shared with the shell that started us so it is polled instead
+        fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) | O_NONBLOCK);
+    }
+#endif
+    _isOpen = true;
+}
+
+void OutputSink::_close(std::string reason)
+{
+    std::stringstream ss;
+    ss << "[OutputSink] " << _destination << " closed: " << reason << "\n";
+    std::cerr << ss.str();
+
+    if (_fd > STDERR_FILENO)
+        close(_fd);
+    _fd = -1;
+    _isOpen = false;
+}
+
+uint8_t* OutputSink::_claim(unsigned int length)
+{
+    if (_dropping || !_isOpen)
+        return nullptr;
+    
+    if (_ring)
+    {
+        if (_end + length > _ring->GetSlotSize())
+        {
+            _dropping = true;
+            return nullptr;
+        }
+        return _ring->GetData() + _end; // straight into the slot that readers will see
+    }
+
+    if (_end + length > _buffer.size() && _start > 0)
+    {
+        // move the bytes still waiting for the destination down to make room
+        std::memmove(_buffer.data(), _buffer.data() + _start, _end - _start);
+        _end -= _start;
+        _fieldStart -= _start;
+        _start = 0;
+    }
+
+    if (_end + length > _buffer.size())
+    {
+        _dropping = true; // no room so lose the rest of this field
+        return nullptr;
+    }
+
+    return _buffer.data() + _end;
+}
+
+void OutputSink::_commit(unsigned int length)
+{
+    if (!_dropping)
+        _end += length;
+}
+
+void OutputSink::_append(const uint8_t* data, unsigned int length)
+{
+    uint8_t* p = _claim(length);
+    if (p)
+    {
+        std::memcpy(p, data, length);
+        _commit(length);
+    }
+}
+
+uint8_t* OutputSink::_getField(unsigned int* length)
+{
+    *length = 0;
+    if (_dropping || !_isOpen)
+        return nullptr;
+    
+    if (_ring)
+    {
+        *length = _end;
+        return _ring->GetData();
+    }
+    
+    *length = _end - _fieldStart;
+    return _buffer.data() + _fieldStart;
+}
+
+void OutputSink::_endField()
+{
+    if (!_isOpen)
+        return;
+
+    if (_dropping)
+    {
+        // throw away the part of the field that did fit so that the output stays aligned to whole fields
+        _end = _fieldStart;
+        _dropping = false;
+        if (_droppedFields++ == _droppedReported)
+        {
+            std::stringstream ss;
+            ss << "[OutputSink] " << _destination << " is not keeping up, dropping fields\n";
+            std::cerr << ss.str();
+        }
+    }
+
+    if (_ring)
+    {
+        if (_end)
+        {
+            vbit::MasterClock *mc = mc->Instance();
+            _ring->Publish(_end, mc->GetFieldCount() - 1); // the field before the one that is starting
+            _writtenFields++;
+        }
+        _end = 0;
+        _fieldStart = 0;
+        return;
+    }
+    
+    if (_end > _fieldStart)
+        _writtenFields++; // counted once it is queued, even if the destination takes it later
+    
+    bool writing = _start < _end;
+    std::chrono::steady_clock::time_point writeStart = std::chrono::steady_clock::now();
+    
+    while (_start < _end)
+    {
+        size_t length = _end - _start;
+#ifndef WIN32
+        if (_policy == Drop && _fd == STDOUT_FILENO)
+        {
+            struct pollfd pfd = {_fd, POLLOUT, 0};
+            if (poll(&pfd, 1, 0) == 0)
+                break; // leave the rest in the buffer for next time
+            if (length > PIPE_BUF)
+                length = PIPE_BUF; // a pipe that polls writable takes this much without blocking
+        }
+#endif
+        ssize_t n = write(_fd, _buffer.data() + _start, length);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break; // leave the rest in the buffer for next time
+            _close(std::strerror(errno));
+            return;
+        }
+        _start += n;
+    }
+    
+    if (writing)
+    {
+        uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - writeStart).count();
+        _writeLatency.Add(us);
+        if (us > OUTPUT_STALL_MICROSECONDS)
+            _stalls++;
+    }
+
+    if (_start == _end)
+    {
+        _start = 0;
+        _end = 0;
+        
+        if (_droppedFields != _droppedReported)
+        {
+            std::stringstream ss;
+            ss << "[OutputSink] " << _destination << " caught up after dropping " << (_droppedFields - _droppedReported) << " fields\n";
+            std::cerr << ss.str();
+            _droppedReported = _droppedFields;
+        }
+    }
+
+    _fieldStart = _end;
+}
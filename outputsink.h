@@ -0,0 +1,120 @@
+#ifndef _OUTPUTSINK_H_
+#define _OUTPUTSINK_H_
+
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <array>
+
+#include "packet.h"
+#include "shmring.h"
+#include "latencyhistogram.h"
+
+#define OUTPUT_STALL_MICROSECONDS 20000 // a write that takes longer than a field has held up the service
+
+/**
+ * Output sink.
+ * Base class for everything that the service can send its packets to.
+ * A sink collects one field of output in its own buffer and passes it on to its
+ * destination at the end of the field. The destination is stdout, a file or fifo,
+ * a UNIX stream socket, or a shared memory ring that local readers map directly.
+ * Fields are assembled in place in the ring, which never waits for its readers.
+ * When the destination can't keep up a sink either waits for it, which holds up
+ * the whole service, or drops whole fields once its buffer is full.
+ * Each sink times its writes so that a slow destination shows up in the output report.
+ */
+
+namespace vbit
+{
+    class OutputSink
+    {
+        public:
+            enum Backpressure
+            {
+                Block,
+                Drop
+            };
+
+            /** Constructor
+             * @param format Name of the output format, recorded in a shared memory ring
+             * @param destination "-" for stdout, "unix:<path>" for a UNIX socket, "shm:<name>" for a shared memory ring, otherwise a file path
+             * @param policy What to do when the destination can't keep up
+             * @param bufferFields Number of fields that may wait in the buffer with the Drop policy, or fields in a shared memory ring
+             * @param fieldBytes Largest amount of output for one field
+             */
+            OutputSink(std::string format, std::string destination, Backpressure policy, unsigned int bufferFields, unsigned int fieldBytes);
+
+            /** Default destructor */
+            virtual ~OutputSink();
+
+            /** Output one packet
+             * @param packet Transmission ready packet from Packet::tx(). The same packet goes to every sink
+             * @param line VBI line within the field. Line 0 is the start of a new field
+             * @param field Field counter 0..49
+             */
+            virtual void AddPacket(std::array<uint8_t, PACKETSIZE>* packet, uint16_t line, uint8_t field) = 0;
+
+            /** @return false if the destination couldn't be opened or has gone away */
+            bool IsOpen(){return _isOpen;};
+
+            std::string GetDestination(){return _destination;};
+
+            uint64_t GetDroppedFields(){return _droppedFields;};
+
+            /** @return Number of fields passed on to the destination */
+            uint64_t GetWrittenFields(){return _writtenFields;};
+
+            /** @return Number of fields whose write took longer than OUTPUT_STALL_MICROSECONDS */
+            uint64_t GetStalls(){return _stalls;};
+
+            /** @return Time taken to write each field since the histogram was last reset */
+            LatencyHistogram* GetWriteLatency(){return &_writeLatency;};
+
+        protected:
+            /** Get space at the end of the current field
+             * @param length Number of bytes that will be written
+             * @return Where to write them, or nullptr if this field is being dropped
+             */
+            uint8_t* _claim(unsigned int length);
+
+            /** Add the bytes written after _claim to the current field */
+            void _commit(unsigned int length);
+
+            /** Copy bytes on to the end of the current field */
+            void _append(const uint8_t* data, unsigned int length);
+
+            /** Get the current field as built so far, e.g. to transform it in place before _endField
+             * @param length Receives the number of bytes in the field
+             * @return Start of the field, or nullptr if it is being dropped
+             */
+            uint8_t* _getField(unsigned int* length);
+
+            /** The current field is complete. Pass everything that is waiting on to the destination */
+            void _endField();
+
+        private:
+            std::string _destination;
+            Backpressure _policy;
+            bool _isOpen; // the destination was opened and hasn't failed since
+            int _fd; // not used for a shared memory ring
+            ShmRing* _ring; // shared memory ring destination
+
+            std::vector<uint8_t> _buffer; // complete fields waiting for the destination then the field being built
+            unsigned int _start; // first byte not yet written to the destination
+            unsigned int _end; // end of the field being built
+            unsigned int _fieldStart; // start of the field being built
+            bool _dropping; // current field didn't fit in the buffer
+            uint64_t _droppedFields;
+            uint64_t _droppedReported;
+            uint64_t _writtenFields;
+            uint64_t _stalls;
+            LatencyHistogram _writeLatency;
+
+            void _open(std::string format, unsigned int bufferFields, unsigned int fieldBytes);
+            void _close(std::string reason);
+    };
+}
+
+#endif // _OUTPUTSINK_H_
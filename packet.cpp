@@ -1,6 +1,7 @@
 #include "packet.h"
 #include "version.h"
 #include "vbit2.h"
+#include "coding.h"
 
 using namespace vbit;
 
@@ -65,44 +66,24 @@ void Packet::SetRow(int mag, int row, std::string val, PageCoding coding)
             // bits in b0-b5.
             // designation code is 8/4 hamming coded by first switch statement
             /* 0x0a and 0x00 in the hammed output is causing a problem so disable this until they are fixed (output will be gibberish) */
-            int triplet;
-            for (int i = 1; i<=13; i++)
-            {
-                triplet = _packet[i*3+3] & 0x3F;
-                triplet |= (_packet[i*3+4] & 0x3F) << 6;
-                triplet |= (_packet[i*3+5] & 0x3F) << 12;
-                Hamming24EncodeTriplet(i, triplet);
-            }
+            // Rows loaded from pages are already encoded by TTXPage::SetRow so this only
+            // runs for packets that are built on the fly
+            Hamming2418EncodeTriplets(_packet.data()+6, 13);
             break;
         }
         case CODING_HAMMING_8_4:
         {
             // first byte already hamming 8/4 coded by first switch statement
-            for (int i = 1; i<40; i++)
-            {
-                _packet[5+i] = Hamming8EncodeTable[_packet[5+i] & 0x0F];
-            }
+            Hamming84Encode(_packet.data()+6, 39);
             break;
         }
         case CODING_HAMMING_7BIT_GROUPS:
         {
             // first byte already hamming 8/4 coded by first switch statement
-            for (int i = 1; i<8; i++)
-            {
-                _packet[5+i] = Hamming8EncodeTable[_packet[5+i] & 0x0F];
-            }
-            for (int i = 8; i<20; i++)
-            {
-                _packet[5+i] = OddParityTable[(uint8_t)(_packet[5+i]&0x7f)];
-            }
-            for (int i = 20; i<28; i++)
-            {
-                _packet[5+i] = Hamming8EncodeTable[_packet[5+i] & 0x0F];
-            }
-            for (int i = 28; i<40; i++)
-            {
-                _packet[5+i] = OddParityTable[(uint8_t)(_packet[5+i]&0x7f)];
-            }
+            Hamming84Encode(_packet.data()+6, 7);
+            OddParityEncode(_packet.data()+13, 12);
+            Hamming84Encode(_packet.data()+25, 8);
+            OddParityEncode(_packet.data()+33, 12);
             break;
         }
         case CODING_8BIT_DATA:
@@ -113,6 +94,28 @@ void Packet::SetRow(int mag, int row, std::string val, PageCoding coding)
     }
 }
 
+void Packet::SetRow(int mag, int row, TTXLine* line, PageCoding coding)
+{
+    int encodedCoding;
+    if (line->GetEncoded(coding, _packet.data() + 5, &encodedCoding))
+    {
+        SetMRAG(mag, row);
+        _coding = (PageCoding)encodedCoding;
+        return;
+    }
+
+    unsigned int generation = line->GetGeneration(); // before the line is read
+    SetRow(mag, row, line->GetLine(), coding);
+    line->SetEncoded(generation, coding, _packet.data() + 5, _coding);
+}
+
+void Packet::SetRowEncoded(int mag, int row, const uint8_t* data, PageCoding coding)
+{
+    SetMRAG(mag, row);
+    std::copy_n(data, 40, _packet.begin() + 5);
+    _coding = coding;
+}
+
 void Packet::SetPacketRaw(std::vector<uint8_t> data)
 {
     data.resize(40, 0x00); // ensure correct length
@@ -184,8 +187,16 @@ int Packet::GetOffsetOfSubstition(std::string string)
 /* Perform translations on packet for header substitution etc.
  * return pointer to 45 byte packet data vector
  */
+bool Packet::HasSubstitutions()
+{
+    return _isHeader || (_coding == CODING_7BIT_TEXT && memchr(_packet.data() + 5, '%', 40) != nullptr); // every substitution starts with a %
+}
+
 std::array<uint8_t, PACKETSIZE>* Packet::tx()
 {
+    if (!HasSubstitutions())
+        return &_packet;
+    
     // get master clock singleton
     vbit::MasterClock *mc = mc->Instance();
     time_t t = mc->GetMasterClock();
@@ -418,11 +429,12 @@ void Packet::Header(uint8_t mag, uint8_t page, uint16_t subcode, uint16_t contro
     _page=page;
 }
 
-void Packet::HeaderText(std::string val)
+void Packet::HeaderText(const std::string& val)
 {
     _isHeader=true; // Because it must be a header
-    val.resize(32);
-    std::copy_n(val.begin(),32,_packet.begin() + 13);
+    size_t n=std::min(val.size(), (size_t)32);
+    std::copy_n(val.begin(),n,_packet.begin() + 13);
+    std::fill(_packet.begin() + 13 + n, _packet.end(), 0);
 }
 
 /**
@@ -431,12 +443,8 @@ void Packet::HeaderText(std::string val)
  */
 void Packet::Parity(uint8_t offset)
 {
-    int i;
-    //uint8_t c;
-    for (i=offset;i<PACKETSIZE;i++)
-    {
-        _packet[i]=OddParityTable[_packet[i] & 0x7f];
-    }
+    if (offset < PACKETSIZE)
+        OddParityEncode(_packet.data()+offset, PACKETSIZE-offset);
 }
 
 void Packet::Fastext(int* links, int mag)
@@ -648,20 +656,5 @@ void Packet::Hamming24EncodeTriplet(uint8_t index, uint32_t triplet)
 {
     if (index<1) return;
     
-    uint8_t D5_D11;
-    uint8_t D12_D18;
-    uint8_t P5, P6;
-    uint8_t Byte_0;
-
-    Byte_0 = (Hamming24EncodeTable0[(triplet >> 0) & 0xFF] ^ Hamming24EncodeTable1[(triplet >> 8) & 0xFF] ^ Hamming24EncodeTable2[(triplet >> 16) & 0x03]);
-    _packet[index*3+3] = Byte_0;
-
-    D5_D11 = (triplet >> 4) & 0x7F;
-    D12_D18 = (triplet >> 11) & 0x7F;
-
-    P5 = 0x80 & ~(Hamming24ParityTable[0][D12_D18] << 2);
-    _packet[index*3+4] = D5_D11 | P5;
-
-    P6 = 0x80 & ((Hamming24ParityTable[0][Byte_0] ^ Hamming24ParityTable[0][D5_D11]) << 2);
-    _packet[index*3+5] = D12_D18 | P6;
+    Hamming2418Encode(_packet.data()+index*3+3, triplet);
 }
@@ -5,6 +5,7 @@
 #include <algorithm>
 #include <iostream>
 #include <vector>
+#include <array>
 #include <iomanip>
 #include <cstring>
 #include <ctime>
@@ -49,6 +50,12 @@ namespace vbit
              */
             std::array<uint8_t, PACKETSIZE>* tx();
 
+            /** HasSubstitutions
+             * @return true if tx() fills in anything, such as the time or the page number.
+             * A packet without substitutions goes out exactly as it is
+             */
+            bool HasSubstitutions();
+
             /** SetMRAG
              * Sets the first five bytes of the packet
              * Namely Two clock run in, one framing code, and two for magazine/row address group
@@ -69,7 +76,7 @@ namespace vbit
              * Sets last 32 bytes. This is the caption part
              * @param val String of exactly 32 characters.
              */
-            void HeaderText(std::string val);
+            void HeaderText(const std::string& val);
 
             /** Parity
              * Sets the parity of the bytes starting from offset
@@ -83,6 +90,9 @@ namespace vbit
              */
             bool IsHeader(){return _isHeader;};
 
+            /** @return The row number 0..31 from the last SetRow, SetMRAG or Header */
+            uint8_t GetRow(){return _row;};
+
             /** Create a Fastext packet
              * Requires a list of six links
              * @param links Array of six link values (0x100 to 0x8FF)
@@ -120,6 +130,24 @@ namespace vbit
              */
             void SetRow(int mag, int row, std::string val, PageCoding coding);
 
+            /**
+             * @brief Same as SetRow but copies the line's cached encoding when it has one
+             * @param mag - Magazine number 0..7 where 0 is magazine 8
+             * @param row - Row 0..31
+             * @param line - The row to send. Its encoding cache is filled if needed
+             * @param coding -
+             */
+            void SetRow(int mag, int row, TTXLine* line, PageCoding coding);
+
+            /**
+             * @brief Same as SetRow but for a row that is already encoded for transmission
+             * @param mag - Magazine number 0..7 where 0 is magazine 8
+             * @param row - Row 0..31
+             * @param data - 40 encoded bytes
+             * @param coding - The coding that data was encoded with
+             */
+            void SetRowEncoded(int mag, int row, const uint8_t* data, PageCoding coding);
+
         protected:
         
         private:
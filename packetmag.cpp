@@ -2,10 +2,11 @@
  */
 
 #include "packetmag.h"
+#include "vbit2.h"
 
 using namespace vbit;
 
-PacketMag::PacketMag(uint8_t mag, std::list<TTXPageStream>* pageSet, ttx::Configure *configure, uint8_t priority) :
+PacketMag::PacketMag(uint8_t mag, std::list<TTXPageStream>* pageSet, std::mutex* listMutex, ttx::Configure *configure, uint8_t priority) :
     _pageSet(pageSet),
     _configure(configure),
     _page(nullptr),
@@ -19,17 +20,60 @@ PacketMag::PacketMag(uint8_t mag, std::list<TTXPageStream>* pageSet, ttx::Config
     _hasPacket29(false),
     _magRegion(0),
     _specialPagesFlipFlop(false),
-    _waitingForField(0)
+    _waitingForField(0),
+    _deadlineScheduling(configure->GetDeadlineScheduling()),
+    _magMaxInterval(configure->GetMagazineMaxInterval(mag) * 50),
+    _lastHeaderField(0),
+    _fieldsPerPage(2),
+    _cycleStartField(0),
+    _cycleFields(0),
+    _missedDeadlines(0),
+    _worstLateness(0),
+    _listMutex(listMutex),
+    _replayPage(nullptr),
+    _oneOff(false),
+    _pageSetChanges(0),
+    _padCarousels(configure->GetCycleSchedule()),
+    _padding(false),
+    _padRows(0),
+    _padFastext(false),
+    _chainCount(0)
 {
     //ctor
     for (int i=0;i<MAXPACKET29TYPES;i++)
     {
         _packet29[i]=nullptr;
     }
+    for (int i=0;i<3;i++)
+    {
+        _padChain[i]=0;
+    }
+    
+    // pick out the page deadlines for this magazine and convert them to fields
+    std::map<int, int> intervals = configure->GetPageMaxIntervals();
+    for (std::map<int, int>::iterator it=intervals.begin(); it!=intervals.end(); ++it)
+    {
+        if (((it->first >> 8) & 0x7) == mag)
+        {
+            _maxInterval[it->first & 0xFF] = it->second * 50;
+        }
+    }
 
     _carousel=new vbit::Carousel();
     _specialPages=new vbit::SpecialPages();
     _normalPages=new vbit::NormalPages();
+    
+    // pick out the pages in this magazine that go more than once per cycle
+    std::map<int, int> repeats = configure->GetPageRepeats();
+    std::map<int, int> magRepeats;
+    for (std::map<int, int>::iterator it=repeats.begin(); it!=repeats.end(); ++it)
+    {
+        if (((it->first >> 8) & 0x7) == mag)
+        {
+            magRepeats[it->first & 0xFF] = it->second;
+        }
+    }
+    _normalPages->SetRepeats(magRepeats);
     _updatedPages=new vbit::UpdatedPages();
 }
 
@@ -61,7 +105,10 @@ Packet* PacketMag::GetPacket(Packet* p)
     {
         case PACKETSTATE_HEADER: // Start to send out a new page, which may be a simple page or one of a carousel
         {
-            if (GetEvent(EVENT_PACKET_29) && _hasPacket29)
+            _oneOff=false;
+            _padding=false;
+            _chainCount=0;
+            if (GetEvent(EVENT_PACKET_29) && _hasPacket29 && !_replayPage)
             {
                 if (_mtx.try_lock()) // skip if unable to get lock
                 {
@@ -77,7 +124,7 @@ Packet* PacketMag::GetPacket(Packet* p)
                     }
                     else
                     {
-                        p->SetRow(_magNumber, 29, _packet29[_nextPacket29DC]->GetLine(), CODING_13_TRIPLETS);
+                        p->SetRow(_magNumber, 29, _packet29[_nextPacket29DC], CODING_13_TRIPLETS);
                         _nextPacket29DC++;
                         _mtx.unlock(); // unlock before we return!
                         return p;
@@ -86,7 +133,7 @@ Packet* PacketMag::GetPacket(Packet* p)
                 }
             }
             _specialPagesFlipFlop = !_specialPagesFlipFlop; // toggle the flag so that we interleave special pages and regular pages during the special pages event so that rolling headers aren't stopped completely
-            if (GetEvent(EVENT_SPECIAL_PAGES) && _specialPagesFlipFlop)
+            if (GetEvent(EVENT_SPECIAL_PAGES) && _specialPagesFlipFlop && !_replayPage)
             {
                 _page=_specialPages->NextPage();
                 
@@ -128,8 +175,12 @@ Packet* PacketMag::GetPacket(Packet* p)
             }
             else
             {
-                _page=_updatedPages->NextPage(); // Get the next updated page (if there is one)
-                if (_page)
+                if (_replayPage)
+                {
+                    _page=_replayPage; // the cycle schedule has this page here
+                    _replayPage=nullptr;
+                }
+                else if ((_page=_updatedPages->NextPage())) // Get the next updated page (if there is one)
                 {
                     // updated page
                     updatedFlag=true; // use our own flag because the pagestream's _isUpdated flag gets cleared by NextPage
@@ -145,7 +196,27 @@ Packet* PacketMag::GetPacket(Packet* p)
                     else
                     {
                         // no urgent carousels
-                        _page=_normalPages->NextPage();  // Get the next normal page (if there is one)
+                        if (_deadlineScheduling)
+                        {
+                            vbit::MasterClock *mc = mc->Instance();
+                            _page=_normalPages->NextPageByDeadline(mc->GetFieldCount(), (uint64_t)(_fieldsPerPage + 0.5), _maxInterval, _magMaxInterval); // Get the page that is due soonest
+                        }
+                        else
+                        {
+                            _page=_normalPages->NextPage();  // Get the next normal page (if there is one)
+                            
+                            if (_page == nullptr)
+                            {
+                                // the end of the list is the end of a magazine cycle
+                                vbit::MasterClock *mc = mc->Instance();
+                                uint64_t field = mc->GetFieldCount();
+                                if (_cycleStartField)
+                                {
+                                    _cycleFields = field - _cycleStartField;
+                                }
+                                _cycleStartField = field;
+                            }
+                        }
                     }
                 }
                 
@@ -176,6 +247,10 @@ Packet* PacketMag::GetPacket(Packet* p)
                     }
                     thisSubcode=_page->GetCarouselPage()->GetSubCode();
                     _region=_page->GetCarouselPage()->GetRegion();
+                    if (_padCarousels)
+                    {
+                        _padCarousel();
+                    }
                 }
                 else
                 {
@@ -193,12 +268,14 @@ Packet* PacketMag::GetPacket(Packet* p)
                     
                     // Also set the erase flag in output. This will allow left over rows in adaptive transmission to be cleared without leaving the erase flag set causing flickering.
                     _status|=PAGESTATUS_C4_ERASEPAGE;
+                    _oneOff=true;
                 }
                 
                 if (updatedFlag)
                 {
                     // page is updated set interrupted sequence flag and clear UpdatedFlag
                     _status|=PAGESTATUS_C9_INTERRUPTED;
+                    _oneOff=true;
                 }
             }
             
@@ -214,6 +291,8 @@ Packet* PacketMag::GetPacket(Packet* p)
             
             _waitingForField = 2; // enforce 20ms page erasure interval
             
+            _pageSent();
+            
             // clear a flag we use to prevent duplicated X/28/0 packets
             _hasX28Region = false;
             p->Header(_magNumber,thisPageNum,thisSubcode,_status);// loads of stuff to do here!
@@ -231,7 +310,7 @@ Packet* PacketMag::GetPacket(Packet* p)
             {
                 links=_page->GetLinkSet();
             }
-            if ((links[0] & links[1] & links[2] & links[3] & links[4] & links[5]) != 0x8FF) // only create if links were initialised
+            if ((links[0] & links[1] & links[2] & links[3] & links[4] & links[5]) != 0x8FF || (_padding && _padFastext)) // only create if links were initialised
             {
                 _state=PACKETSTATE_FASTEXT;
                 break;
@@ -248,12 +327,19 @@ Packet* PacketMag::GetPacket(Packet* p)
             if (_lastTxt)
             {
                 if ((_lastTxt->GetLine()[0] & 0xF) > 3) // designation codes > 3
-                    p->SetRow(_magNumber, 27, _lastTxt->GetLine(), CODING_13_TRIPLETS); // enhancement linking
+                    p->SetRow(_magNumber, 27, _lastTxt, CODING_13_TRIPLETS); // enhancement linking
                 else
-                    p->SetRow(_magNumber, 27, _lastTxt->GetLine(), CODING_HAMMING_8_4); // navigation packets (TODO: CRC in DC=0 is wrong)
+                    p->SetRow(_magNumber, 27, _lastTxt, CODING_HAMMING_8_4); // navigation packets (TODO: CRC in DC=0 is wrong)
                 _lastTxt=_lastTxt->GetNextLine();
+                _chainCount++;
                 break;
             }
+            if (_padding && _chainCount < _padChain[1])
+            {
+                _chainCount++;
+                return nullptr;
+            }
+            _chainCount=0;
             _lastTxt=_page->GetTxRow(28); // Get _lastTxt ready for packet 28 processing
             _state=PACKETSTATE_PACKET28; //  // Intentional fall through to PACKETSTATE_PACKET28
             /* fallthrough */
@@ -263,12 +349,18 @@ Packet* PacketMag::GetPacket(Packet* p)
         {
             if (_lastTxt)
             {
-                p->SetRow(_magNumber, 28, _lastTxt->GetLine(), CODING_13_TRIPLETS);
+                p->SetRow(_magNumber, 28, _lastTxt, CODING_13_TRIPLETS);
                 if ((_lastTxt->GetCharAt(0) & 0xF) == 0 || (_lastTxt->GetCharAt(0) & 0xF) == 4)
                     _hasX28Region = true; // don't generate an X/28/0 for a RE line
                 _lastTxt=_lastTxt->GetNextLine();
+                _chainCount++;
                 break;
             }
+            else if (_padding && _chainCount < _padChain[2])
+            {
+                _chainCount++;
+                return nullptr;
+            }
             else if (!(_hasX28Region) && (_region != _magRegion))
             {
                 // create X/28/0 packet for pages which have a region set with RE in file
@@ -282,6 +374,7 @@ Packet* PacketMag::GetPacket(Packet* p)
                 val.replace(3,1,1,((triplet & 0x3F000) >> 12) | 0x40);
                 p->SetRow(_magNumber, 28, val, CODING_13_TRIPLETS);
                 _lastTxt=_page->GetTxRow(26); // Get _lastTxt ready for packet 26 processing
+                _chainCount=0;
                 _state=PACKETSTATE_PACKET26;
                 break;
             }
@@ -289,6 +382,7 @@ Packet* PacketMag::GetPacket(Packet* p)
             {
                 // X/26 packets next in normal pages
                 _lastTxt=_page->GetTxRow(26); // Get _lastTxt ready for packet 26 processing
+                _chainCount=0;
                 _state=PACKETSTATE_PACKET26; // Intentional fall through to PACKETSTATE_PACKET26
             }
             else
@@ -304,11 +398,17 @@ Packet* PacketMag::GetPacket(Packet* p)
         {
             if (_lastTxt)
             {
-                p->SetRow(_magNumber, 26, _lastTxt->GetLine(), CODING_13_TRIPLETS);
+                p->SetRow(_magNumber, 26, _lastTxt, CODING_13_TRIPLETS);
                 // Do we have another line?
                 _lastTxt=_lastTxt->GetNextLine();
+                _chainCount++;
                 break;
             }
+            if (_padding && _chainCount < _padChain[0])
+            {
+                _chainCount++;
+                return nullptr;
+            }
             if (_page->GetPageCoding() == CODING_7BIT_TEXT)
             {
                 _state=PACKETSTATE_TEXTROW; // Intentional fall through to PACKETSTATE_TEXTROW
@@ -329,12 +429,12 @@ Packet* PacketMag::GetPacket(Packet* p)
             for (_thisRow++;_thisRow<26;_thisRow++)
             {
                 _lastTxt=_page->GetTxRow(_thisRow);
-                if (_lastTxt!=NULL)
+                if (_lastTxt!=NULL || (_padding && (_padRows & (1 << _thisRow))))
                     break;
             }
 
             // Didn't find? End of this page.
-            if (_thisRow>25 || _lastTxt==NULL)
+            if (_thisRow>25)
             {
                 if(_page->GetPageCoding() == CODING_7BIT_TEXT)
                 {
@@ -346,10 +446,15 @@ Packet* PacketMag::GetPacket(Packet* p)
                 {
                     // otherwise go on to X/26
                     _lastTxt=_page->GetTxRow(26);
+                    _chainCount=0;
                     _state=PACKETSTATE_PACKET26;
                 }
                 return nullptr;
             }
+            else if (_lastTxt==NULL)
+            {
+                return nullptr; // another subpage has this row
+            }
             else
             {
             //_outp("J");
@@ -360,7 +465,7 @@ Packet* PacketMag::GetPacket(Packet* p)
                 else
                 {
                     // Assemble the packet
-                    p->SetRow(_magNumber, _thisRow, _lastTxt->GetLine(), _page->GetPageCoding());
+                    p->SetRow(_magNumber, _thisRow, _lastTxt, _page->GetPageCoding());
                     assert(p->IsHeader()!=true);
                 }
             }
@@ -368,7 +473,6 @@ Packet* PacketMag::GetPacket(Packet* p)
         }
         case PACKETSTATE_FASTEXT:
         {
-            p->SetMRAG(_magNumber,27);
             if (_page->IsCarousel())
             {
                 links=_page->GetCarouselPage()->GetLinkSet();
@@ -377,9 +481,14 @@ Packet* PacketMag::GetPacket(Packet* p)
             {
                 links=_page->GetLinkSet();
             }
-            p->Fastext(links,_magNumber);
             _lastTxt=_page->GetTxRow(27); // Get _lastTxt ready for packet 27 processing
             _state=PACKETSTATE_PACKET27; // makes no attempt to prevent an FL row and an X/27/0 both being sent
+            if ((links[0] & links[1] & links[2] & links[3] & links[4] & links[5]) == 0x8FF)
+            {
+                return nullptr; // another subpage has links
+            }
+            p->SetMRAG(_magNumber,27);
+            p->Fastext(links,_magNumber);
             break;
         }
         default:
@@ -403,6 +512,9 @@ bool PacketMag::IsReady(bool force)
     // We can always send something unless
     // 1) We have just sent out a header and are waiting on a new field
     // 2) There are no pages
+    if (_state==PACKETSTATE_HEADER)
+        _applyUpdates();
+    
     if (GetEvent(EVENT_FIELD))
     {
         ClearEvent(EVENT_FIELD);
@@ -432,10 +544,139 @@ bool PacketMag::IsReady(bool force)
     }
 };
 
+bool PacketMag::SendUpdate(const PageUpdate& update)
+{
+    PageUpdate* slot=_updates.Claim();
+    if (!slot)
+        return false;
+    *slot=update;
+    _updates.Publish();
+    return true;
+}
+
+void PacketMag::_applyUpdates()
+{
+    if (!_updates.Front())
+        return;
+    
+    std::unique_lock<std::mutex> lock(*_listMutex, std::try_to_lock);
+    if (!lock.owns_lock())
+        return; // don't hold up the service thread, the FileMonitor will soon be done
+    
+    PageUpdate* update;
+    while ((update=_updates.Front()))
+    {
+        TTXPageStream* q=nullptr;
+        for (std::list<TTXPageStream>::iterator it=_pageSet->begin(); it!=_pageSet->end(); ++it)
+        {
+            if ((it->GetPageNumber() >> 8) == update->page && it->GetStatusFlag()!=TTXPageStream::MARKED && it->GetStatusFlag()!=TTXPageStream::GONE)
+            {
+                q=&(*it);
+                break;
+            }
+        }
+        
+        if (update->type==PageUpdate::DELETE)
+        {
+            if (q && q->GetSourcePage().empty()) // pages from files come and go with their files
+            {
+                q->SetState(TTXPageStream::MARKED); // the page lists let go of it, then the FileMonitor deletes it
+                PageSetChanged();
+            }
+            _updates.Pop();
+            continue;
+        }
+        
+        if (q && (q->IsCarousel() || q->Special()))
+        {
+            std::stringstream ss;
+            ss << "[PacketMag::_applyUpdates] P" << std::hex << update->page << " is not a single page, update ignored\n";
+            std::cerr << ss.str();
+            _updates.Pop();
+            continue;
+        }
+        
+        if (!q)
+        {
+            // a new page that has no file, so FileMonitor leaves it alone
+            _pageSet->emplace_back();
+            q=&_pageSet->back();
+            q->SetSourcePage("");
+            q->SetPageNumber(update->page << 8);
+            q->SetPageStatus(PAGESTATUS_TRANSMITPAGE);
+            q->SetNormalFlag(true);
+            _normalPages->addPage(q);
+            PageSetChanged();
+        }
+        
+        if (update->type==PageUpdate::PAGE)
+            q->SetPageStatus(update->status);
+        
+        for (int row=1; row<25; row++)
+        {
+            if (update->rowMask & (1 << row))
+            {
+                q->SetRow(row, std::string((char*)update->text[row], 40));
+                q->GetRow(row)->SetEncoded(q->GetRow(row)->GetGeneration(), CODING_7BIT_TEXT, update->data[row], CODING_7BIT_TEXT); // PacketMag only has to copy it
+            }
+            else if (update->type==PageUpdate::PAGE)
+            {
+                q->SetRow(row, ""); // blank
+            }
+        }
+        
+        if (!q->GetUpdatedFlag())
+        {
+            _updatedPages->addPage(q); // goes out next
+            q->SetUpdatedFlag(true);
+        }
+        _updates.Pop();
+    }
+}
+
+void PacketMag::_pageSent()
+{
+    vbit::MasterClock *mc = mc->Instance();
+    uint64_t field = mc->GetFieldCount();
+    
+    if (_lastHeaderField)
+    {
+        _fieldsPerPage = (_fieldsPerPage * 15 + (field - _lastHeaderField)) / 16; // smooth over the last few pages
+    }
+    _lastHeaderField = field;
+    
+    uint64_t interval = _magMaxInterval;
+    std::map<int, uint64_t>::iterator found = _maxInterval.find((_page->GetPageNumber() >> 8) & 0xFF);
+    if (found != _maxInterval.end())
+    {
+        interval = found->second;
+    }
+    
+    uint64_t last = _page->GetLastTxField();
+    if (interval && last && field > last + interval)
+    {
+        // page took longer than its maximum interval to come round again
+        _missedDeadlines++;
+        if (field - (last + interval) > _worstLateness)
+        {
+            _worstLateness = field - (last + interval);
+        }
+    }
+    
+    _page->SetLastTxField(field);
+    
+    if (_deadlineScheduling)
+    {
+        // deadline scheduling has no fixed cycle so estimate one from the rate pages are going out
+        _cycleFields = _normalPages->GetPageCount() * _fieldsPerPage;
+    }
+}
+
 void PacketMag::SetPacket29(int i, TTXLine *line)
 {
     _packet29[i] = line;
     _hasPacket29 = true;
+    PageSetChanged();
     
     if (_packet29[0])
     {
@@ -460,4 +701,41 @@ void PacketMag::DeletePacket29()
     }
     _hasPacket29 = false;
     _mtx.unlock();
+    PageSetChanged();
+}
+
+void PacketMag::_padCarousel()
+{
+    _padding=true;
+    _padRows=0;
+    _padFastext=false;
+    for (int i=0;i<3;i++)
+    {
+        _padChain[i]=0;
+    }
+    
+    for (TTXPage* subpage=_page; subpage!=nullptr; subpage=subpage->Getm_SubPage())
+    {
+        for (int row=1;row<26;row++)
+        {
+            if (subpage->GetRow(row)!=nullptr)
+            {
+                _padRows|=1<<row;
+            }
+        }
+        for (int i=0;i<3;i++)
+        {
+            uint8_t count=0;
+            for (TTXLine* line=subpage->GetRow(26+i); line!=nullptr; line=line->GetNextLine())
+            {
+                count++;
+            }
+            _padChain[i]=std::max(_padChain[i], count);
+        }
+        int* links=subpage->GetLinkSet();
+        if ((links[0] & links[1] & links[2] & links[3] & links[4] & links[5]) != 0x8FF)
+        {
+            _padFastext=true;
+        }
+    }
 }
@@ -1,7 +1,9 @@
 #ifndef PACKETMAG_H
 #define PACKETMAG_H
 #include <list>
+#include <map>
 #include <mutex>
+#include <atomic>
 #include <packetsource.h>
 #include "ttxpagestream.h"
 #include "carousel.h"
@@ -9,18 +11,34 @@
 #include "normalpages.h"
 #include "updatedpages.h"
 #include "configure.h"
+#include "spscqueue.h"
 
 #define MAXPACKET29TYPES 3
+#define PAGE_UPDATE_QUEUE_LENGTH 16 // page updates that may wait for the magazine to finish a page. Must be a power of two
 
 namespace vbit
 {
     enum PacketState {PACKETSTATE_HEADER, PACKETSTATE_FASTEXT, PACKETSTATE_PACKET26, PACKETSTATE_PACKET27, PACKETSTATE_PACKET28, PACKETSTATE_TEXTROW};
 
+    /** New content for a page, on its way from PageUpload to the service thread.
+     *  Rows are held as page text and also already encoded for transmission as 7 bit text.
+     */
+    struct PageUpdate
+    {
+        enum Type {ROWS, PAGE, DELETE};
+        Type type; // ROWS changes the rows in rowMask, PAGE replaces the page, DELETE removes a page that came from PageUpload
+        uint16_t page; // mpp
+        uint16_t status; // page status word, for PAGE
+        uint32_t rowMask; // bit n for row n, 1..24
+        uint8_t text[25][40]; // as TTXLine keeps it
+        uint8_t data[25][40]; // with parity
+    };
+
     class PacketMag : public PacketSource
     {
         public:
             /** Default constructor */
-            PacketMag(uint8_t mag, std::list<TTXPageStream>* pageSet, ttx::Configure *configure, uint8_t priority);
+            PacketMag(uint8_t mag, std::list<TTXPageStream>* pageSet, std::mutex* listMutex, ttx::Configure *configure, uint8_t priority);
             /** Default destructor */
             virtual ~PacketMag();
 
@@ -40,13 +58,52 @@ namespace vbit
             Packet* GetPacket(Packet* p) override;
 
             void SetPriority(uint8_t priority) { _priority = priority; }
+            uint8_t GetPriority() { return _priority; }
+
+            /** The time taken to send every normal page once, in fields.
+             *  0 until a full cycle has been measured.
+             */
+            uint64_t GetCycleTime() { return _cycleFields; }
 
             bool IsReady(bool force=false);
 
+            /** Deadline statistics since the last ResetDeadlineStats
+             *  Only pages with a maximum interval configured can miss a deadline
+             */
+            uint32_t GetMissedDeadlines() { return _missedDeadlines; }
+            uint64_t GetWorstLateness() { return _worstLateness; } // fields
+            void ResetDeadlineStats() { _missedDeadlines = 0; _worstLateness = 0; }
+
+            /**
+             * @brief Hand a page update to the service thread
+             * It is applied between pages so that a page never goes out partly old and partly new.
+             * Only one thread may send updates.
+             * @return false if the queue is full
+             */
+            bool SendUpdate(const PageUpdate& update);
+
             void SetPacket29(int i, TTXLine *line);
             bool GetPacket29Flag() { return _hasPacket29; };
             void DeletePacket29();
 
+            /** For the CycleSchedule, which records what the magazine sends and plays it out again.
+             *  Carousels still go through the magazine when they are played out because their subpages change.
+             */
+            TTXPageStream* GetPage() { return _page; } // page of the last header, nullptr after a time filling header
+            bool IsOneOff() { return _oneOff; } // the last header was for an updated page or had C8 set, so it goes out differently next time
+            bool InPage() { return _state != PACKETSTATE_HEADER; } // a header has gone and the rest of its page hasn't
+            void EndPage() { _state = PACKETSTATE_HEADER; _thisRow = 0; } // drop the rest of the page
+            void ReplayPage(TTXPageStream* page) { _replayPage = page; } // the next header is for this page, whatever is waiting
+            void ApplyUpdates() { if (_state == PACKETSTATE_HEADER) _applyUpdates(); } // IsReady does this for live generation
+            bool HasPendingUpdates() { return _updatedPages->waiting() || _updates.Front() != nullptr; } // service thread only
+            
+            /** Count a change to the set of pages, or to how they are sent, that a recorded cycle can't follow
+             *  Pages being added or deleted, becoming special or a carousel, and packet 29 changing are counted.
+             *  The content of pages is not.
+             */
+            void PageSetChanged() { _pageSetChanges++; }
+            unsigned int GetPageSetChanges() { return _pageSetChanges; }
+
         protected:
 
         private:
@@ -78,6 +135,45 @@ namespace vbit
             bool _hasX28Region;
             bool _specialPagesFlipFlop; // toggle to alternate between special pages and normal pages
             int _waitingForField;
+
+            bool _deadlineScheduling; // pick normal pages earliest deadline first
+            std::map<int, uint64_t> _maxInterval; // maximum fields between transmissions of configured pages in this magazine
+            uint64_t _magMaxInterval; // default maximum fields between transmissions. 0 for none
+            uint64_t _lastHeaderField; // field count when the last page header went out
+            double _fieldsPerPage; // running average of the fields it takes to send a page
+            uint64_t _cycleStartField; // field count at the start of the current magazine cycle
+            uint64_t _cycleFields; // length of the last complete magazine cycle
+            uint32_t _missedDeadlines;
+            uint64_t _worstLateness;
+
+            SpscQueue<PageUpdate, PAGE_UPDATE_QUEUE_LENGTH> _updates;
+            std::mutex* _listMutex; // shared with the FileMonitor, held while pages are added to the lists
+
+            TTXPageStream* _replayPage; // page for the next header given by ReplayPage
+            bool _oneOff;
+            std::atomic<unsigned int> _pageSetChanges;
+            
+            /** With cycle_schedule every subpage of a carousel takes the same lines, so that it fits the
+             *  lines recorded for whichever subpage was sent then. A subpage gives up a line wherever
+             *  another subpage has a row, an enhancement packet or fastext links that it doesn't.
+             */
+            bool _padCarousels;
+            bool _padding; // the page being sent is padded
+            uint32_t _padRows; // bit n for row n, 1..25, that some subpage has
+            uint8_t _padChain[3]; // most packets 26, 27 and 28 in any subpage
+            bool _padFastext; // some subpage has fastext links
+            uint8_t _chainCount; // packets sent, or padded, from the current 26, 27 or 28 chain
+
+            /** Record that _page is going out and check it against its deadline */
+            void _pageSent();
+
+            /** Work out the padding for the carousel in _page */
+            void _padCarousel();
+            
+            /** Apply the updates that are waiting. Only call this between pages.
+             *  If the FileMonitor is changing the page lists they wait for the next page
+             */
+            void _applyUpdates();
     };
 }
 
@@ -1,14 +1,25 @@
 #include "packetsubtitle.h"
+#include "coding.h"
+#include "vbit2.h"
 
 using namespace vbit;
 
-PacketSubtitle::PacketSubtitle(ttx::Configure *configure) :
-    _swap(0),
+PacketSubtitle::PacketSubtitle(ttx::Configure *configure, uint16_t page, uint8_t repeats) :
+    _snapshot(nullptr),
+    _clearing(false),
+    _cues(0),
+    _lateCues(0),
+    _overflows(0),
+    _timing(false),
+    _publishPending(false),
     _state(SUBTITLE_STATE_IDLE),
     _rowCount(0),
     _configure(configure),
-    _repeatCount(_configure->GetSubtitleRepeats()),
-    _C8Flag(true)
+    _pageNumber(page),
+    _repeats(repeats),
+    _repeatCount(repeats),
+    _C8Flag(true),
+    _headerText("XENOXXX INDUSTRIES         CLOCK") // Only Jason will see this if he decodes a tape.
 {
     //ctor
 }
@@ -20,11 +31,9 @@ PacketSubtitle::~PacketSubtitle()
 
 Packet* PacketSubtitle::GetPacket(Packet* p)
 {
-    // @todo Put these values into the configuration or better still, decoded from the Newfor feed instead of being hard wired
-    uint8_t mag=8 & 0x07; // 0 is mag 8!
-    uint8_t page=0x88;    // These are in hex
-    
-    _mtx.lock(); // lock the critical section
+    uint8_t mag=(_pageNumber >> 8) & 0x07; // 0 is mag 8!
+    uint8_t page=_pageNumber & 0xFF;
+
     switch (_state)
     {
         case SUBTITLE_STATE_IDLE : // This can not happen. We can't put out a packet if we are in idle.
@@ -34,7 +43,6 @@ Packet* PacketSubtitle::GetPacket(Packet* p)
         }
         case SUBTITLE_STATE_HEADER:
         {
-            std::cerr << "[PacketSubtitle::GetPacket] Header. repeat count=" << (int)_repeatCount << std::endl;
             // Construct the header packet and then wait for a field
             {
                 uint16_t status=PAGESTATUS_C4_ERASEPAGE | PAGESTATUS_C6_SUBTITLE; // Erase page + Subtitle
@@ -46,26 +54,33 @@ Packet* PacketSubtitle::GetPacket(Packet* p)
                 }
                 p->Header(mag, page, 0, status); // Create the header
             }
-            p->HeaderText("XENOXXX INDUSTRIES         CLOCK"); // Only Jason will see this if he decodes a tape.
+            p->HeaderText(_headerText);
             ClearEvent(EVENT_FIELD);
             _state=SUBTITLE_STATE_TEXT_ROW;
-            _rowCount=1; // Set up iterator for page rows
+            _rowCount=0; // Set up iterator for page rows
+            if (_timing)
+            {
+                uint64_t now=Timestamp();
+                _headerLatency.Add(now-_snapshot->completed);
+                _totals[1].Add(now-_snapshot->completed);
+                if (_snapshot->rowCount==0)
+                    _addLatency(now); // the header is all there is
+            }
             break;
         }
         case SUBTITLE_STATE_TEXT_ROW:
         {
-            // 1) Copy the next non-null row to p
-            if (_rowCount<24)
+            // Rows were encoded when the subtitle arrived so they only need copying
+            if (!_clearing && _rowCount<_snapshot->rowCount)
             {
-                std::cerr << "[PacketSubtitle::GetPacket] Sending row=" << (int) _rowCount << " string=#" << _page[_swap].GetRow(_rowCount)->GetLine() << "#" << std::endl;
-                p->SetRow(mag,_rowCount,_page[_swap].GetRow(_rowCount)->GetLine(),CODING_7BIT_TEXT);
+                p->SetRowEncoded(mag, _snapshot->rowNumber[_rowCount], _snapshot->data[_rowCount], CODING_7BIT_TEXT);
                 _rowCount++;
-                // Don't do parity here! Packet::tx does it.
+                if (_timing && _rowCount==_snapshot->rowCount)
+                    _addLatency(Timestamp());
             }
             else // Out of rows? Terminate
             {
                 _state=SUBTITLE_STATE_IDLE;
-                // @todo. Note that this is the wrong place to terminate as we have no packet to send
                 // @todo Check that IsReady prevents this branch from ever being taken
             }
             break;
@@ -76,7 +91,6 @@ Packet* PacketSubtitle::GetPacket(Packet* p)
             break;
         }
     }
-    _mtx.unlock(); // unlock the critical section
     return p;
 }
 
@@ -88,17 +102,64 @@ bool PacketSubtitle::IsReady(bool force)
     // Must call GetPacket if this returns true
     (void)force; // silence error about unused parameter
     bool result=false;
-    _mtx.lock(); // lock the critical section
+    if (_publishPending)
+        _publish();
     switch (_state)
     {
-        case SUBTITLE_STATE_IDLE : // Process starts with EVENT_SUBTITLE
+        case SUBTITLE_STATE_IDLE : // Process starts when a cue in the queue is due
         {
-            if (GetEvent(EVENT_SUBTITLE))
+            vbit::MasterClock *mc = mc->Instance();
+            uint64_t now=mc->GetFieldTime();
+
+            if (_snapshot)
             {
-                ClearEvent(EVENT_SUBTITLE);
-                _state=SUBTITLE_STATE_HEADER;
-                result=true;
+                // The cue at the front of the queue has just gone out, or is on screen waiting for its clear time
+                SubtitleSnapshot* next=_queue.At(1);
+                if (!next || next->onAirField>now || (next->clearField && next->clearField<=now)) // nothing due to replace it. A cue past its clear time never goes on air
+                {
+                    if (_repeatCount>0)
+                    {
+                        _repeatCount--; // Set up to repeat transmission
+                        _state=SUBTITLE_STATE_HEADER;
+                        result=true;
+                        break;
+                    }
+                    if (_snapshot->clearField && !_clearing)
+                    {
+                        if (now<_snapshot->clearField)
+                            break; // leave it on screen
+
+                        _clearing=true; // send the header again without the rows to clear the screen
+                        _repeatCount=_repeats;
+                        _C8Flag=true;
+                        _state=SUBTITLE_STATE_HEADER;
+                        result=true;
+                        break;
+                    }
+                }
+                _queue.Pop(); // the next cue replaces it, or it is done
+                _snapshot=nullptr;
+                _clearing=false;
             }
+
+            SubtitleSnapshot* cue;
+            while ((cue=_queue.Front()) && cue->clearField && cue->clearField<=now)
+            {
+                _lateCues++; // it was due to be cleared before it could go on air
+                _queue.Pop();
+            }
+            if (!cue || cue->onAirField>now)
+                break;
+
+            if (cue->onAirField && cue->onAirField<now)
+                _lateCues++;
+            _cues++;
+            _snapshot=cue;
+            _timing=(cue->completed!=0); // latency is measured on the first transmission
+            _repeatCount=_repeats; // transmission repeat counter
+            _C8Flag=true; // New subtitle sets C8 flag
+            _state=SUBTITLE_STATE_HEADER;
+            result=true;
             break;
         }
         case SUBTITLE_STATE_HEADER:
@@ -111,50 +172,14 @@ bool PacketSubtitle::IsReady(bool force)
         }
         case SUBTITLE_STATE_TEXT_ROW:
         {
-            // Iterate through to the next non blank row.
-            for (;_rowCount<24;_rowCount++)
-            {
-                if (!_page[_swap].GetRow(_rowCount)->IsBlank())
-                {
-                    std::cerr << "[PacketSubtitle::IsReady] found non blank row=" << (int) _rowCount << std::endl;
-                    std::cerr << "[PacketSubtitle::IsReady] row=" << _page[_swap].GetRow(_rowCount)->GetLine() << std::endl;
-                    /**
-                    for (int i=0;i<40;i++)
-                    {
-                        std::cerr << std::setfill('0') << std::setw(2) << std::hex << " " << (int) _page[_swap].GetRow(_rowCount)->GetCharAt(i);
-                    }
-                    std::cerr << std::endl;
-
-                    for (int i=0;i<40;i++)
-                    {
-                        char ch=_page[_swap].GetRow(_rowCount)->GetCharAt(i);
-                        if (ch<' ') ch='*';
-                        if (ch>'~') ch='*';
-                        std::cerr << " " << ch << "  ";
-                    }
-                    std::cerr << std::endl;
-                    */
-                    break;
-                }
-            }
             // Return false and reset state machine if there are no more rows
-            if (_rowCount<24)
+            if (!_clearing && _rowCount<_snapshot->rowCount)
             {
                 result=true;
             }
             else
             {
-                _state=SUBTITLE_STATE_IDLE; // Subtitle is done so state is idle
-                if (_repeatCount==0)
-                {
-                    result=false; // No more repeats
-                }
-                else
-                {
-                    _repeatCount--;
-                    SetEvent(EVENT_SUBTITLE); // Set up to repeat transmission
-                    result=true;
-                }
+                _state=SUBTITLE_STATE_IDLE; // Subtitle is done so state is idle. Repeats start from there
             }
             break;
         }
@@ -164,24 +189,111 @@ bool PacketSubtitle::IsReady(bool force)
             break;
         }
     }
-    _mtx.unlock(); // unlock the critical section
     return result;
 }
 
-void PacketSubtitle::SendSubtitle(TTXPage* page)
+uint8_t PacketSubtitle::GetLinesToSend()
 {
-    _mtx.lock(); // lock the critical section
-    std::cerr << "[PacketSubtitle::SendSubtitle] Got page: " << std::endl;
-    
-    _swap=(_swap+1)%2; // swap the double buffering
-    _page[_swap].Copy(page); // deep copy page
-    
-    std::cerr << "[PacketSubtitle::SendSubtitle] End of page: " << std::endl;
-    SetEvent(EVENT_SUBTITLE);
+    uint8_t rows=(_snapshot && !_clearing) ? _snapshot->rowCount : 0;
+    switch (_state)
+    {
+        case SUBTITLE_STATE_HEADER:
+            return 1+rows;
+        case SUBTITLE_STATE_TEXT_ROW:
+            return (_rowCount<rows) ? rows-_rowCount : 0;
+        default:
+            return 0;
+    }
+}
+
+SubtitleSnapshot* PacketSubtitle::_claim()
+{
+    SubtitleSnapshot* snapshot=_queue.Claim();
+    if (!snapshot)
+    {
+        std::stringstream ss;
+        ss << "[PacketSubtitle::_claim] P" << std::hex << _pageNumber << std::dec << " queue is full, subtitle dropped. " << ++_overflows << " dropped so far\n";
+        std::cerr << ss.str();
+    }
+    return snapshot;
+}
 
-    _repeatCount=_configure->GetSubtitleRepeats(); // transmission repeat counter
+bool PacketSubtitle::SendSubtitle(TTXPage* page, uint64_t onAirField, uint64_t clearField, uint64_t received, uint64_t completed)
+{
+    SubtitleSnapshot* snapshot=_claim();
+    if (!snapshot)
+        return false;
+
+    snapshot->onAirField=onAirField;
+    snapshot->clearField=clearField;
+    snapshot->received=received;
+    snapshot->completed=completed;
+    EncodeSnapshot(page, snapshot);
+    _queue.Publish();
+    return true;
+}
+
+bool PacketSubtitle::SendSnapshot(const SubtitleSnapshot& cue)
+{
+    SubtitleSnapshot* snapshot=_claim();
+    if (!snapshot)
+        return false;
 
-    _C8Flag=true; // New subtitle sets C8 flag
+    *snapshot=cue;
+    _queue.Publish();
+    return true;
+}
 
-    _mtx.unlock(); // unlock the critical section
+void PacketSubtitle::EncodeSnapshot(TTXPage* page, SubtitleSnapshot* cue)
+{
+    // Keep the rows that aren't blank, encoded ready to send
+    cue->rowCount=0;
+    for (uint8_t row=1; row<24; row++)
+    {
+        TTXLine* line=page->GetRow(row);
+        if (line->IsBlank())
+            continue;
+
+        std::string text=line->GetLine();
+        text.resize(40, ' ');
+        std::copy_n(text.begin(), 40, cue->data[cue->rowCount]);
+        OddParityEncode(cue->data[cue->rowCount], 40);
+        cue->rowNumber[cue->rowCount]=row;
+        cue->rowCount++;
+    }
+}
+
+void PacketSubtitle::_addLatency(uint64_t now)
+{
+    _timing=false;
+    if (_snapshot->received)
+    {
+        _inputLatency.Add(_snapshot->completed-_snapshot->received);
+        _totalLatency.Add(now-_snapshot->received);
+        _totals[0].Add(_snapshot->completed-_snapshot->received);
+        _totals[2].Add(now-_snapshot->received);
+    }
+    _publish();
+}
+
+void PacketSubtitle::_publish()
+{
+    _publishPending=true;
+    if (_totalsMutex.try_lock()) // the command port may be reading them. Try again next line if so
+    {
+        for (int i=0; i<3; i++)
+            _published[i]=_totals[i];
+        _totalsMutex.unlock();
+        _publishPending=false;
+    }
+}
+
+std::string PacketSubtitle::LatencyReport()
+{
+    std::lock_guard<std::mutex> lock(_totalsMutex);
+    std::stringstream ss;
+    ss << _published[1].GetCount();
+    for (int i=0; i<3; i++)
+        ss << " " << _published[i].Percentile(0.5) << " " << _published[i].Percentile(0.99) << " " << _published[i].GetMax();
+    return ss.str();
 }
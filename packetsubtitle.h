@@ -3,12 +3,17 @@
 #ifndef _PACKETSUBTITLE_H_
 #define _PACKETSUBTITLE_H_
 
-#include <thread>
+#include <atomic>
+#include <chrono>
 #include <mutex>
 
 #include "packetsource.h"
 #include "ttxpage.h"
 #include "configure.h"
+#include "spscqueue.h"
+#include "latencyhistogram.h"
+
+#define SUBTITLE_QUEUE_LENGTH 64 // cues that may wait for their on air time. Must be a power of two
 
 namespace vbit{
     /** Subtitles state machine
@@ -21,17 +26,43 @@ namespace vbit{
         SUBTITLE_STATE_NUMBER_ITEMS
     };
 
+    /** A subtitle cue ready to go out.
+     *  Only the rows that aren't blank are kept, already encoded for transmission.
+     *  Times are on the field clock, MasterClock::GetFieldTime().
+     */
+    struct SubtitleSnapshot
+    {
+        uint64_t onAirField; // first field the cue may go out in. 0 for straight away
+        uint64_t clearField; // field to clear the screen in, unless another cue has replaced it. 0 for never
+        uint64_t received; // Timestamp() of the first byte of input, 0 if not known
+        uint64_t completed; // Timestamp() when the input was complete, 0 if not known
+        uint8_t rowCount;
+        uint8_t rowNumber[23]; // rows 1..23
+        uint8_t data[23][40];
+    };
+
+    /** One subtitle service.
+     *  Several can run at once, e.g. a page for each language and one for audio description.
+     *  Each has its own Newfor input and repeat count and Service interleaves them a page at a time.
+     *
+     *  Subtitles are encoded on the command thread and handed to the service thread through
+     *  a lock free queue, so the service thread never waits for subtitle input.
+     *  Cues go out in the order they were sent, each at the start of its on air field.
+     *  A cue is repeated until its repeats are done or the next cue is due, and is
+     *  sent again without its rows at its clear time.
+     */
     class PacketSubtitle : public PacketSource
     {
         public:
-            /** Default constructor */
-            PacketSubtitle(ttx::Configure *configure);
+            /** Constructor
+             * @param configure Configuration settings
+             * @param page Page number mpp that the subtitles go out on, e.g. 0x888
+             * @param repeats Number of times each subtitle is sent again after the first transmission
+             */
+            PacketSubtitle(ttx::Configure *configure, uint16_t page, uint8_t repeats);
             /** Default destructor */
             virtual ~PacketSubtitle();
 
-            /** @todo Routines to link Newfor subtitles to here
-             */
-
             Packet* GetPacket(Packet* p) override;
 
             /**
@@ -42,21 +73,106 @@ namespace vbit{
 
             /**
              * @brief Accept a page from another thread
+             * Only one thread may send subtitles to each service.
              * @param page - Pointer to another page object
+             * @param onAirField - Field clock time to put the subtitle on air. 0 for as soon as possible
+             * @param clearField - Field clock time to clear it. 0 to leave it until the next subtitle
+             * @param received - Timestamp() of the first byte of the subtitle from its source, 0 if not known
+             * @param completed - Timestamp() when the source finished the subtitle, 0 if not known
+             * @return false if the queue was full and the subtitle was dropped
+             */
+            bool SendSubtitle(TTXPage* page, uint64_t onAirField=0, uint64_t clearField=0, uint64_t received=0, uint64_t completed=0);
+
+            /**
+             * @brief Queue a cue that is already encoded
+             * Only one thread may send subtitles to each service.
+             * @param cue - The cue, with its times on the field clock
+             * @return false if the queue was full and the cue was dropped
+             */
+            bool SendSnapshot(const SubtitleSnapshot& cue);
+
+            /**
+             * @brief Encode the rows of a page that aren't blank
+             * @param page - The subtitle page
+             * @param cue - Receives the rows. The times are left alone
+             */
+            static void EncodeSnapshot(TTXPage* page, SubtitleSnapshot* cue);
+
+            /** @return Number of cues that have gone on air */
+            uint32_t GetCues(){return _cues;};
+
+            /** @return Number of cues that went on air after their on air field */
+            uint32_t GetLateCues(){return _lateCues;};
+
+            /** @return Number of cues dropped because the queue was full */
+            uint32_t GetOverflows(){return _overflows.load(std::memory_order_relaxed);};
+
+            /** Latencies of the subtitles with timestamps since the histograms were last reset. Service thread only
+             *  Input is from the first byte received to the subtitle being complete,
+             *  header from complete to its header going out, and total from the first byte to its last row going out.
              */
-            void SendSubtitle(TTXPage* page);
+            LatencyHistogram* GetInputLatency(){return &_inputLatency;};
+            LatencyHistogram* GetHeaderLatency(){return &_headerLatency;};
+            LatencyHistogram* GetTotalLatency(){return &_totalLatency;};
+
+            /**
+             * @brief Latencies since the start, for the command port. Safe to call from any thread
+             * @return count then p50, p99 and max in microseconds of the input, header and total latencies
+             */
+            std::string LatencyReport();
+
+            /** @return Microseconds on the steady clock, for the received and completed times of a subtitle */
+            static uint64_t Timestamp(){return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();};
+
+            /** @return Page number mpp that the subtitles go out on */
+            uint16_t GetPageNumber(){return _pageNumber;};
+
+            /**
+             * @return true once the header of a subtitle has gone out and its rows are still to follow.
+             * Nothing else in the magazine may send a header until the page is complete.
+             */
+            bool InPage(){return GetLinesToSend()>0 && _state==SUBTITLE_STATE_TEXT_ROW;};
+
+            /**
+             * @return Lines the page going out still needs, counting its header if that hasn't gone yet.
+             * A page that is about to start is only known once IsReady has returned true.
+             */
+            uint8_t GetLinesToSend();
 
         protected:
 
         private:
-            std::mutex _mtx; // Mutex to interlock Mewfor thread
-            TTXPage _page[2];
-            uint8_t _swap;
+            /** @return Where to put the next cue, or nullptr if the queue is full */
+            SubtitleSnapshot* _claim();
+
+            /** Count the latencies of the cue whose last row has just gone out */
+            void _addLatency(uint64_t now);
+
+            /** Copy _totals for LatencyReport unless it is being read */
+            void _publish();
+
+            SpscQueue<SubtitleSnapshot, SUBTITLE_QUEUE_LENGTH> _queue; // subtitles from the command thread
+            SubtitleSnapshot* _snapshot; // cue at the front of the queue that is on air, or nullptr
+            bool _clearing; // the cue is being sent again without its rows
+            uint32_t _cues;
+            uint32_t _lateCues;
+            std::atomic<uint32_t> _overflows; // cues thrown away because the queue was full
+            bool _timing; // the first transmission of a cue with timestamps is under way
+            LatencyHistogram _inputLatency;
+            LatencyHistogram _headerLatency;
+            LatencyHistogram _totalLatency;
+            std::mutex _totalsMutex; // the service thread never waits for this
+            LatencyHistogram _totals[3]; // input, header and total since the start. Copied to _published for LatencyReport
+            LatencyHistogram _published[3];
+            bool _publishPending; // _totals has changed since it was last copied
             SubtitleState _state; // Subtitle state machine
             uint8_t _rowCount;  // Used to iterate through the rows of the subtitle page
             ttx::Configure* _configure; /// Configuration object
+            uint16_t _pageNumber; /// mpp
+            uint8_t _repeats; /// Number of repeat transmissions of each subtitle
             uint8_t _repeatCount; /// Counts repeat transmissions
             bool _C8Flag;         /// C8 Update flag. Set when new sub comes in, cleared when first header goes out.
+            const std::string _headerText;
     };
 }
 
@@ -0,0 +1,339 @@
+#include "packetsubtitlefile.h"
+#include "vbit2.h"
+
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+
+using namespace vbit;
+
+PacketSubtitleFile::PacketSubtitleFile(ttx::Configure *configure, uint16_t page, uint8_t repeats, std::string filename, int start) :
+    PacketSubtitle(configure, page, repeats),
+    _next(0),
+    _startField(0),
+    _start(start),
+    _fedField(0)
+{
+    std::vector<Cue> cues;
+    std::string extension = filename.substr(filename.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    bool loaded = (extension == "stl") ? _loadSTL(filename, &cues) : _loadSRT(filename, &cues);
+    if (!loaded)
+        return;
+
+    _cues.resize(cues.size());
+    for (unsigned int i = 0; i < cues.size(); i++)
+    {
+        _encode(cues[i], &_cues[i]);
+    }
+
+    std::stringstream ss;
+    ss << "[PacketSubtitleFile::PacketSubtitleFile] " << filename << ": " << _cues.size() << " cues on P" << std::hex << std::uppercase << page << "\n";
+    std::cerr << ss.str();
+}
+
+PacketSubtitleFile::~PacketSubtitleFile()
+{
+    //dtor
+}
+
+bool PacketSubtitleFile::IsReady(bool force)
+{
+    vbit::MasterClock *mc = mc->Instance();
+    uint64_t now = mc->GetFieldTime();
+
+    if (mc->GetMasterClock() != 0 && now != _fedField) // once a field when the clock has been set
+    {
+        if (_startField == 0)
+        {
+            if (_start < 0)
+            {
+                _startField = now;
+            }
+            else
+            {
+                time_t t = mc->GetMasterClock();
+                struct tm* timeinfo = localtime(&t);
+                timeinfo->tm_hour = _start / 3600;
+                timeinfo->tm_min = (_start / 60) % 60;
+                timeinfo->tm_sec = _start % 60;
+                _startField = (uint64_t)mktime(timeinfo) * 50;
+            }
+
+            // skip the cues that were already over before the service started
+            while (_next < _cues.size() && _cues[_next].clearField && _startField + _cues[_next].clearField <= now)
+            {
+                _next++;
+            }
+        }
+
+        // queue the cues that are nearly due
+        while (_next < _cues.size() && _startField + _cues[_next].onAirField <= now + SUBTITLE_FILE_LOOKAHEAD)
+        {
+            SubtitleSnapshot cue = _cues[_next];
+            cue.onAirField += _startField;
+            if (cue.clearField)
+                cue.clearField += _startField;
+            if (!SendSnapshot(cue))
+                break; // try again next field
+            _next++;
+        }
+
+        _fedField = now;
+    }
+
+    return PacketSubtitle::IsReady(force);
+}
+
+/** Convert a line of UTF-8 text to teletext characters */
+static std::string teletextText(const std::string& utf8)
+{
+    std::string text;
+    for (unsigned int i = 0; i < utf8.size(); i++)
+    {
+        uint8_t ch = utf8[i];
+        if (ch == '<' || ch == '{')
+        {
+            // drop formatting tags such as <i> and {\an8}
+            size_t end = utf8.find((ch == '<') ? '>' : '}', i);
+            if (end != std::string::npos)
+            {
+                i = end;
+                continue;
+            }
+        }
+
+        if (ch >= 0x20 && ch < 0x7f)
+        {
+            text += ch;
+        }
+        else if (ch == 0xc2 && i + 1 < utf8.size() && (uint8_t)utf8[i + 1] == 0xa3)
+        {
+            text += '#'; // £ is where # is in the English character set
+            i++;
+        }
+        else if (ch >= 0xc0)
+        {
+            text += '?'; // no teletext equivalent in the English character set
+            while (i + 1 < utf8.size() && ((uint8_t)utf8[i + 1] & 0xc0) == 0x80)
+                i++;
+        }
+    }
+    return text;
+}
+
+/** Parse hh:mm:ss,mmm
+ * @return Field of the frame that the time falls in, or -1 if the time is not valid
+ */
+static int64_t srtTime(const std::string& s)
+{
+    int h, m, sec, ms;
+    if (sscanf(s.c_str(), "%d:%d:%d%*[,.]%d", &h, &m, &sec, &ms) != 4)
+        return -1;
+    int64_t milliseconds = (((int64_t)h * 60 + m) * 60 + sec) * 1000 + ms;
+    return (milliseconds * 25 / 1000) * 2; // start of the frame
+}
+
+bool PacketSubtitleFile::_loadSRT(std::string filename, std::vector<Cue>* cues)
+{
+    std::ifstream filein(filename.c_str());
+    if (!filein.is_open())
+    {
+        std::stringstream ss;
+        ss << "[PacketSubtitleFile::_loadSRT] can't open " << filename << "\n";
+        std::cerr << ss.str();
+        return false;
+    }
+
+    std::string line;
+    Cue cue;
+    bool inCue = false;
+    while (std::getline(filein, line))
+    {
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+        if (line.compare(0, 3, "\xef\xbb\xbf") == 0)
+            line.erase(0, 3); // byte order mark
+
+        size_t arrow = line.find("-->");
+        if (!inCue && arrow != std::string::npos)
+        {
+            int64_t onAir = srtTime(line.substr(0, arrow));
+            int64_t clear = srtTime(line.substr(arrow + 3));
+            if (onAir < 0 || clear <= onAir)
+            {
+                std::stringstream ss;
+                ss << "[PacketSubtitleFile::_loadSRT] invalid cue time: " << line << "\n";
+                std::cerr << ss.str();
+                continue;
+            }
+            cue.onAirField = onAir;
+            cue.clearField = clear;
+            cue.lines.clear();
+            cue.row = 0;
+            inCue = true;
+        }
+        else if (inCue)
+        {
+            if (line.empty())
+            {
+                cues->push_back(cue);
+                inCue = false;
+            }
+            else
+            {
+                cue.lines.push_back(teletextText(line));
+            }
+        }
+        // anything else is a cue number
+    }
+    if (inCue)
+        cues->push_back(cue);
+
+    filein.close();
+    return true;
+}
+
+bool PacketSubtitleFile::_loadSTL(std::string filename, std::vector<Cue>* cues)
+{
+    std::ifstream filein(filename.c_str(), std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(filein)), std::istreambuf_iterator<char>());
+    if (data.size() < 1024 || std::memcmp(&data[3], "STL", 3) != 0)
+    {
+        std::stringstream ss;
+        ss << "[PacketSubtitleFile::_loadSTL] " << filename << " is not an EBU-STL file\n";
+        std::cerr << ss.str();
+        return false;
+    }
+
+    // General Subtitle Information block
+    int fps = (std::memcmp(&data[3], "STL30.01", 8) == 0) ? 30 : 25;
+    bool teletext = (data[11] == '1' || data[11] == '2'); // display standard code: '1' and '2' are teletext levels 1 and 2, '0' or blank are open subtitles laid out like SubRip
+    int64_t startFrame = 0;
+    int h, m, s, f;
+    if (sscanf(std::string((char*)&data[256], 8).c_str(), "%2d%2d%2d%2d", &h, &m, &s, &f) == 4)
+        startFrame = (((int64_t)h * 60 + m) * 60 + s) * fps + f; // time code of the start of the programme
+
+    Cue cue;
+    std::string line;
+    bool inCue = false;
+    for (size_t block = 1024; block + 128 <= data.size(); block += 128)
+    {
+        const uint8_t* tti = &data[block];
+        uint8_t ebn = tti[3];
+        if (ebn == 0xfe || tti[15] != 0)
+            continue; // user data or comment
+
+        if (!inCue)
+        {
+            int64_t onAir = (((int64_t)tti[5] * 60 + tti[6]) * 60 + tti[7]) * fps + tti[8] - startFrame;
+            int64_t clear = (((int64_t)tti[9] * 60 + tti[10]) * 60 + tti[11]) * fps + tti[12] - startFrame;
+            cue.onAirField = (onAir * 50 / fps) & ~(int64_t)1; // start of the frame
+            cue.clearField = (clear * 50 / fps) & ~(int64_t)1;
+            cue.row = (teletext && tti[13] >= 1 && tti[13] <= 23) ? tti[13] : 0;
+            cue.lines.clear();
+            line.clear();
+            inCue = (onAir >= 0 && clear > onAir);
+            if (!inCue)
+            {
+                std::stringstream ss;
+                ss << "[PacketSubtitleFile::_loadSTL] cue " << (tti[1] | (tti[2] << 8)) << " has an invalid time\n";
+                std::cerr << ss.str();
+                continue;
+            }
+        }
+
+        for (int i = 16; i < 128; i++)
+        {
+            uint8_t ch = tti[i];
+            if (ch == 0x8f) // unused space
+                break;
+            if (ch == 0x8a) // new line
+            {
+                cue.lines.push_back(line);
+                line.clear();
+            }
+            else if (ch < 0x20)
+            {
+                if (teletext)
+                    line += (char)(ch | 0x80); // teletext spacing attribute
+                else
+                    line += ' ';
+            }
+            else if (ch < 0x7f)
+            {
+                line += ch;
+            }
+            else if (ch == 0xa3)
+            {
+                line += '#'; // £ is where # is in the English character set
+            }
+            else if (ch >= 0xa0)
+            {
+                line += '?';
+            }
+            // 0x80..0x85 italics, underline and boxing have no teletext equivalent
+        }
+
+        if (ebn == 0xff) // last block of the subtitle
+        {
+            if (!line.empty())
+                cue.lines.push_back(line);
+            for (unsigned int i = 0; i < cue.lines.size(); i++)
+            {
+                if (cue.lines[i].find_first_not_of(' ') != std::string::npos)
+                {
+                    cues->push_back(cue); // ignore subtitles with nothing in them
+                    break;
+                }
+            }
+            inCue = false;
+        }
+    }
+
+    return true;
+}
+
+void PacketSubtitleFile::_encode(const Cue& cue, SubtitleSnapshot* snapshot)
+{
+    // lines are double height with a box around them, so each one takes two rows
+    std::vector<std::string> lines;
+    for (unsigned int i = 0; i < cue.lines.size(); i++)
+    {
+        if (cue.lines[i].find_first_not_of(' ') != std::string::npos)
+            lines.push_back(cue.lines[i]);
+    }
+    if (lines.size() > 5)
+        lines.resize(5);
+
+    TTXPage page;
+    int row = cue.row;
+    if (row == 0)
+        row = 24 - 2 * (int)lines.size(); // bottom of the screen
+    for (unsigned int i = 0; i < lines.size() && row < 24; i++)
+    {
+        std::string text = lines[i];
+        bool doubleHeight = true;
+        if (cue.row == 0)
+        {
+            // centre the text with double height and start box before it and end box after it
+            if (text.size() > 35)
+                text.resize(35);
+            text = std::string((35 - text.size()) / 2, ' ') + "\x8d\x8b\x8b" + text + "\x8a\x8a";
+        }
+        else
+        {
+            doubleHeight = (text.find('\x8d') != std::string::npos);
+        }
+        page.SetRow(row, text);
+        row += doubleHeight ? 2 : 1;
+    }
+
+    snapshot->onAirField = cue.onAirField;
+    snapshot->clearField = cue.clearField;
+    snapshot->received = 0; // file cues aren't timed
+    snapshot->completed = 0;
+    EncodeSnapshot(&page, snapshot);
+}
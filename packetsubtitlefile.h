@@ -0,0 +1,68 @@
+/** Plays subtitles from a file
+ */
+#ifndef _PACKETSUBTITLEFILE_H_
+#define _PACKETSUBTITLEFILE_H_
+
+#include <vector>
+#include <string>
+
+#include "packetsubtitle.h"
+
+#define SUBTITLE_FILE_LOOKAHEAD 250 // fields of cues to queue ahead of time
+
+namespace vbit{
+    /** A subtitle service that plays out a subtitle file instead of taking Newfor.
+     *  SubRip (.srt) and EBU-STL (.stl) files are read and every cue is encoded when the
+     *  service is created. Cue times count from the start time, which is a time of day or
+     *  else the first field the service sends. Cues are fed to the subtitle queue from the
+     *  service thread as they come within SUBTITLE_FILE_LOOKAHEAD fields of their on air time,
+     *  and go out through the same path as Newfor subtitles.
+     *  Times in the file are rounded to the start of a frame.
+     */
+    class PacketSubtitleFile : public PacketSubtitle
+    {
+        public:
+            /** Constructor
+             * @param configure Configuration settings
+             * @param page Page number mpp that the subtitles go out on, e.g. 0x888
+             * @param repeats Number of times each subtitle is sent again after the first transmission
+             * @param filename The subtitle file
+             * @param start Local time of day in seconds that the cue times count from, or -1 to start straight away
+             */
+            PacketSubtitleFile(ttx::Configure *configure, uint16_t page, uint8_t repeats, std::string filename, int start);
+            /** Default destructor */
+            virtual ~PacketSubtitleFile();
+
+            bool IsReady(bool force=false) override;
+
+            /** @return false if the file couldn't be read or had no cues in it */
+            bool IsLoaded(){return !_cues.empty();};
+
+        private:
+            /** A cue with times in fields from the start of the file */
+            struct Cue
+            {
+                uint64_t onAirField;
+                uint64_t clearField; // 0 for none
+                std::vector<std::string> lines;
+                int row; // teletext row of the first line, or 0 to put the lines at the bottom of the screen
+            };
+
+            std::vector<SubtitleSnapshot> _cues; // encoded, with times from the start of the file
+            unsigned int _next; // next cue to queue
+            uint64_t _startField; // field clock time of the start of the file, 0 until the service starts
+            int _start;
+            uint64_t _fedField; // field clock time that cues were last queued for
+
+            /** Read a SubRip file */
+            bool _loadSRT(std::string filename, std::vector<Cue>* cues);
+
+            /** Read an EBU-STL file */
+            bool _loadSTL(std::string filename, std::vector<Cue>* cues);
+
+            /** Lay out the lines of a cue on a page and encode it */
+            void _encode(const Cue& cue, SubtitleSnapshot* snapshot);
+    };
+}
+
+#endif // _PACKETSUBTITLEFILE_H_
@@ -7,7 +7,8 @@ using namespace ttx;
 PageList::PageList(Configure *configure) :
     _configure(configure),
     _iterMag(0),
-    _iterSubpage(nullptr)
+    _iterSubpage(nullptr),
+    _pageWriter(new vbit::PageWriter())
 {
     for (int i=0;i<8;i++)
     {
@@ -30,7 +31,7 @@ int PageList::LoadPageList(std::string filepath)
     // Create PacketMags before loading
     for (int i=0;i<8;i++)
     {
-        _mag[i]=new vbit::PacketMag(i, &_pageList[i], _configure, 9); // this creates the eight PacketMags that Service will use. Priority will be set in Service later
+        _mag[i]=new vbit::PacketMag(i, &_pageList[i], &_listMutex, _configure, 9); // this creates the eight PacketMags that Service will use. Priority will be set in Service later
     }
     
     // Load files
@@ -217,7 +218,7 @@ int PageList::Match(char* pageNumber)
             {
                 matchCount++;
             }
-            ptr->SetSelected(match);
+            p->SetSelected(match); // ptr has run off the end of the carousel
         }
     }
     // Set up the iterator for commands that use pages selected by the Page Identity
@@ -248,7 +249,7 @@ TTXPageStream* PageList::NextPage()
     {
         ++_iter; // Next page
     }
-    if (_iter==_pageList[_iterMag].end()) // end of mag?
+    while (_iter==_pageList[_iterMag].end()) // end of mag? Magazines with no pages are passed over
     {
         if (_iterMag<7)
         {
@@ -258,6 +259,7 @@ TTXPageStream* PageList::NextPage()
         else
         {
             more=false; // End of last mag
+            break;
         }
     }
 
@@ -304,10 +306,11 @@ TTXPageStream* PageList::FirstPage()
     // Reset the iterators
     _iterMag=0;
     _iter=_pageList[_iterMag].begin();
-    _iterSubpage=&(*_iter);
+    _iterSubpage=nullptr;
+    TTXPageStream* first=(_iter!=_pageList[_iterMag].end()) ? (_iterSubpage=&(*_iter)) : NextPage(); // magazine 8 may have no pages
     // Iterate through all the pages
     std::cerr << "[PageList::FirstPage] about to find if there is a selected page" << std::endl;
-    for (TTXPageStream* p=_iterSubpage; p!=nullptr; p=NextPage())
+    for (TTXPageStream* p=first; p!=nullptr; p=NextPage())
     {
         if (p->Selected()) // If the page is selected, return a pointer to it
         {
@@ -359,6 +362,8 @@ void PageList::ClearFlags()
         {
             TTXPageStream* ptr;
             ptr=&(*p);
+            if (ptr->GetSourcePage().empty())
+                continue; // came from PageUpload so there is no file to find
             // Don't unmark a file that was MARKED. Once condemned it won't be pardoned
             if (ptr->GetStatusFlag()==TTXPageStream::FOUND || ptr->GetStatusFlag()==TTXPageStream::NEW)
             {
@@ -373,7 +378,7 @@ void PageList::DeleteOldPages()
     // This is called from the FileMonitor thread
     for (int mag=0;mag<8;mag++)
     {
-        for (std::list<TTXPageStream>::iterator p=_pageList[mag].begin();p!=_pageList[mag].end();++p)
+        for (std::list<TTXPageStream>::iterator p=_pageList[mag].begin();p!=_pageList[mag].end();)
         {
             TTXPageStream* ptr;
             ptr=&(*p);
@@ -386,19 +391,23 @@ void PageList::DeleteOldPages()
                     std::cerr << "[PageList::DeleteOldPages] Removing packet 29 from magazine " << ((mag == 0)?8:mag) << std::endl;
                 }
                 // page has been removed from lists
-                _pageList[mag].remove(*p--);
+                // erase just this one. remove() would take every page with the same file, and uploaded pages have none
+                p=_pageList[mag].erase(p);
 
                 if (_iterMag == mag)
                 {
                     // _iter is iterating _pageList[mag]
                     _iter=_pageList[_iterMag].begin(); // reset it?
                 }
+                continue;
             }
             else if (ptr->GetStatusFlag()==TTXPageStream::NOTFOUND)
             {
                 // Pages marked here get deleted in the Service thread
                 ptr->SetState(TTXPageStream::MARKED);
+                _mag[mag]->PageSetChanged();
             }
+            ++p;
         }
     }
 }
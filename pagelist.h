@@ -7,10 +7,12 @@
 #include <errno.h>
 #include <vector>
 #include <list>
+#include <mutex>
 
 #include "configure.h"
 #include "ttxpagestream.h"
 #include "packetmag.h"
+#include "pagewriter.h"
 
 namespace ttx
 {
@@ -88,6 +90,25 @@ namespace ttx
             */
             TTXPageStream* FirstPage();
 
+            /** \brief The page in the list that the iterator is on
+            *  When NextPage() has stepped into a carousel this is the carousel, not the subpage
+            *  \return The page, which is only valid after FirstPage() or NextPage() returned one
+            */
+            TTXPageStream* GetIteratorPage(){return &(*_iter);};
+
+            /** There is one page selection and one iterator, so commands from different
+             *  command ports must hold this while they use them
+             */
+            std::mutex& GetSelectionMutex(){return _selectionMutex;};
+
+            /** Pages are added to and removed from the lists by the FileMonitor and by the
+             *  magazines when they apply uploaded pages, so both hold this while they do it
+             */
+            std::mutex& GetListMutex(){return _listMutex;};
+
+            /** Saves pages that are edited through the command port */
+            vbit::PageWriter* GetPageWriter(){return _pageWriter;};
+
             void CheckForPacket29(TTXPageStream* page);
 
         private:
@@ -105,6 +126,9 @@ namespace ttx
             uint8_t _iterMag;  /// Magazine number for the iterator
             std::list<TTXPageStream>::iterator _iter;  /// pages in a magazine
             TTXPageStream* _iterSubpage;    /// Subpages in a carousel
+            std::mutex _selectionMutex;
+            std::mutex _listMutex;
+            vbit::PageWriter* _pageWriter;
     };
 }
 
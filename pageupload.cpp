@@ -0,0 +1,320 @@
+#include "pageupload.h"
+#include "coding.h"
+
+using namespace vbit;
+using namespace ttx;
+
+PageUpload::PageUpload(Configure *configure, PageList* pageList) :
+    _path(configure->GetPageUploadSocket()),
+    _pageList(pageList),
+    _epoll(-1)
+{
+    //ctor
+}
+
+PageUpload::~PageUpload()
+{
+    //dtor
+}
+
+void PageUpload::run()
+{
+    struct sockaddr_un addr;
+    if (_path.size() >= sizeof(addr.sun_path))
+    {
+        std::cerr << "[PageUpload::run] socket path is too long\n";
+        return;
+    }
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, _path.c_str());
+
+    unlink(_path.c_str()); // left over from the last run
+    int serverSock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (serverSock < 0 || bind(serverSock, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(serverSock, MAXPENDING) < 0)
+    {
+        perror("[PageUpload::run] can't listen");
+        return;
+    }
+
+    if ((_epoll = epoll_create1(0)) < 0)
+    {
+        perror("[PageUpload::run] epoll_create1() failed");
+        return;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = serverSock;
+    epoll_ctl(_epoll, EPOLL_CTL_ADD, serverSock, &event);
+
+    std::stringstream ss;
+    ss << "[PageUpload::run] Page upload listener started on " << _path << "\n";
+    std::cerr << ss.str();
+
+    struct epoll_event events[MAXCLIENTS + 1];
+    while (1)
+    {
+        // updates that a magazine couldn't take are offered again after a short wait
+        int n = epoll_wait(_epoll, events, MAXCLIENTS + 1, _pending.empty() ? -1 : RETRYMS);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("[PageUpload::run] epoll_wait() failed");
+            return;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            int sock = events[i].data.fd;
+            if (sock == serverSock)
+            {
+                _accept(serverSock);
+                continue;
+            }
+
+            std::map<int, Connection*>::iterator it = _connections.find(sock);
+            if (it == _connections.end())
+                continue; // closed earlier in this batch
+
+            bool open = true;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                open = _read(sock, it->second);
+            if (open && (events[i].events & EPOLLOUT))
+                open = _write(sock, it->second);
+            if (!open)
+                _close(sock);
+        }
+
+        // everything in this batch for a page has been merged, so the magazine gets it in one go
+        _flush();
+    }
+}
+
+void PageUpload::_accept(int serverSock)
+{
+    while (1)
+    {
+        int clientSock = accept4(serverSock, nullptr, nullptr, SOCK_NONBLOCK);
+        if (clientSock < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED && errno != EINTR)
+                perror("[PageUpload::_accept] accept() failed");
+            return; // no more waiting
+        }
+
+        std::stringstream ss;
+        if (_connections.size() >= MAXCLIENTS)
+        {
+            ss << "[PageUpload::_accept] refused a client, already " << _connections.size() << " clients\n";
+            std::cerr << ss.str();
+            close(clientSock);
+            continue;
+        }
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = clientSock;
+        if (epoll_ctl(_epoll, EPOLL_CTL_ADD, clientSock, &event) < 0)
+        {
+            perror("[PageUpload::_accept] epoll_ctl() failed");
+            close(clientSock);
+            continue;
+        }
+        _connections[clientSock] = new Connection();
+
+        ss << "[PageUpload::_accept] connected, " << _connections.size() << " clients\n";
+        std::cerr << ss.str();
+    }
+}
+
+bool PageUpload::_read(int sock, Connection* connection)
+{
+    char buffer[8192];
+    ssize_t received = recv(sock, buffer, sizeof(buffer), 0);
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return true;
+    if (received <= 0)
+        return false; // zero indicates end of transmission, or the connection was reset
+
+    connection->input.append(buffer, received);
+
+    size_t used = 0;
+    while (connection->input.size() - used >= 3)
+    {
+        const uint8_t* message = (const uint8_t*)connection->input.data() + used;
+        uint16_t length = message[1] | (message[2] << 8);
+        if (length > MAXMESSAGE)
+        {
+            std::stringstream ss;
+            ss << "[PageUpload::_read] message of " << length << " bytes, client is out of step\n";
+            std::cerr << ss.str();
+            return false; // can't tell where the next message starts
+        }
+        if (connection->input.size() - used < 3u + length)
+            break; // wait for the rest
+
+        connection->output += _message(message[0], message + 3, length) ? ASCII_ACK : ASCII_NACK;
+        used += 3 + length;
+    }
+    connection->input.erase(0, used);
+
+    if (connection->output.size() > MAXOUTPUT)
+    {
+        std::cerr << "[PageUpload::_read] client isn't reading its replies\n";
+        return false; // while EPOLLOUT is awaited nothing else would stop the replies growing
+    }
+    return connection->writing || _write(sock, connection);
+}
+
+bool PageUpload::_write(int sock, Connection* connection)
+{
+    while (!connection->output.empty())
+    {
+        ssize_t sent = send(sock, connection->output.data(), connection->output.size(), MSG_NOSIGNAL);
+        if (sent > 0)
+        {
+            connection->output.erase(0, sent);
+            continue;
+        }
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        return false;
+    }
+
+    if (connection->output.size() > MAXOUTPUT)
+    {
+        std::cerr << "[PageUpload::_write] client isn't reading its replies\n";
+        return false;
+    }
+
+    bool writing = !connection->output.empty();
+    if (writing != connection->writing)
+    {
+        struct epoll_event event;
+        event.events = writing ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        event.data.fd = sock;
+        if (epoll_ctl(_epoll, EPOLL_CTL_MOD, sock, &event) < 0)
+            return false;
+        connection->writing = writing;
+    }
+    return true;
+}
+
+void PageUpload::_close(int sock)
+{
+    epoll_ctl(_epoll, EPOLL_CTL_DEL, sock, nullptr);
+    close(sock);
+    delete _connections[sock];
+    _connections.erase(sock);
+
+    std::stringstream ss;
+    ss << "[PageUpload::_close] disconnected, " << _connections.size() << " clients\n";
+    std::cerr << ss.str();
+}
+
+bool PageUpload::_message(uint8_t type, const uint8_t* data, uint16_t length)
+{
+    if (length < 2)
+        return false;
+    uint16_t mpp = data[0] | (data[1] << 8);
+    if (mpp < 0x100 || mpp > 0x8ff || (mpp & 0xff) == 0xff)
+        return false; // not a page that can be displayed
+
+    std::map<uint16_t, PageUpdate>::iterator it = _pending.find(mpp);
+    switch (type)
+    {
+        case 'P':
+        {
+            if (length < 5)
+                return false;
+            PageUpdate update;
+            update.type = PageUpdate::PAGE;
+            update.page = mpp;
+            update.status = data[2] | (data[3] << 8);
+            update.rowMask = 0;
+            if (!_rows(&update, data + 5, length - 5, data[4]))
+                return false;
+            _pending[mpp] = update; // whatever was waiting is out of date
+            return true;
+        }
+        case 'R':
+        {
+            if (length < 3)
+                return false;
+            if (it == _pending.end())
+            {
+                PageUpdate update;
+                update.type = PageUpdate::ROWS;
+                update.page = mpp;
+                update.status = PAGESTATUS_TRANSMITPAGE;
+                update.rowMask = 0;
+                if (!_rows(&update, data + 3, length - 3, data[2]))
+                    return false;
+                _pending[mpp] = update;
+                return true;
+            }
+            if (it->second.type == PageUpdate::DELETE)
+            {
+                // the page is deleted and then rows are put on a blank page
+                it->second.type = PageUpdate::PAGE;
+                it->second.status = PAGESTATUS_TRANSMITPAGE;
+                it->second.rowMask = 0;
+            }
+            PageUpdate update = it->second;
+            if (!_rows(&update, data + 3, length - 3, data[2]))
+                return false; // the waiting update is left as it was
+            it->second = update;
+            return true;
+        }
+        case 'D':
+        {
+            if (length != 2)
+                return false;
+            PageUpdate& update = _pending[mpp];
+            update.type = PageUpdate::DELETE;
+            update.page = mpp;
+            update.rowMask = 0;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+bool PageUpload::_rows(PageUpdate* update, const uint8_t* data, uint16_t length, uint8_t count)
+{
+    if (length != count * 41)
+        return false;
+    for (int i = 0; i < count; i++, data += 41)
+    {
+        uint8_t row = data[0];
+        if (row < 1 || row > 24)
+            return false;
+        for (int j = 0; j < 40; j++)
+        {
+            uint8_t ch = data[1 + j] & 0x7f;
+            update->text[row][j] = (ch < 0x20) ? (ch | 0x80) : ch; // the way TTXLine keeps control codes
+            update->data[row][j] = ch;
+        }
+        OddParityEncode(update->data[row], 40);
+        update->rowMask |= 1 << row;
+    }
+    return true;
+}
+
+void PageUpload::_flush()
+{
+    vbit::PacketMag **magList = _pageList->GetMagazines();
+    std::map<uint16_t, PageUpdate>::iterator it = _pending.begin();
+    while (it != _pending.end())
+    {
+        if (magList[(it->first >> 8) & 0x7]->SendUpdate(it->second))
+            it = _pending.erase(it);
+        else
+            ++it; // magazine is busy, try again later
+    }
+}
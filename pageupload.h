@@ -0,0 +1,107 @@
+/** Binary page upload over a UNIX socket
+ */
+#ifndef _PAGEUPLOAD_H_
+#define _PAGEUPLOAD_H_
+
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+
+#include "configure.h"
+#include "pagelist.h"
+#include "packetmag.h"
+
+namespace vbit
+{
+    /** Takes whole pages and row updates from a local client, e.g. a newsroom system, without
+     *  going through files. Each message is
+     *      type (1 byte), length of the rest (2 bytes), then the rest
+     *  with numbers little endian:
+     *      'P' mpp(2) status(2) count(1) then count rows of row number(1) and 40 characters. Replaces the page
+     *      'R' mpp(2) count(1) then count rows. Changes just those rows
+     *      'D' mpp(2). Deletes a page that was uploaded
+     *  Rows are 1 to 24 and characters are 7 bit with control codes as they go on air.
+     *  Every message is answered with ACK or NACK.
+     *
+     *  Rows are encoded here, off the service thread. Messages for the same page that arrive
+     *  before the magazine can take them are merged so that only the latest version of the
+     *  page is applied. Each page goes to its magazine whole and is applied between pages,
+     *  so a page never goes out half updated.
+     *  Pages that don't exist are created, and aren't touched by the FileMonitor.
+     */
+    class PageUpload
+    {
+        public:
+            PageUpload(ttx::Configure *configure, ttx::PageList* pageList);
+            ~PageUpload();
+
+            /** Run the listener thread. Clients are served from this one thread with epoll */
+            void run();
+
+        private:
+            std::string _path;
+            ttx::PageList* _pageList;
+            int _epoll;
+
+            /** A connected client. Part of a message waits in input until the rest arrives */
+            struct Connection
+            {
+                Connection() : writing(false) {};
+                std::string input;
+                std::string output;
+                bool writing; // waiting for the socket to take more output
+            };
+            std::map<int, Connection*> _connections; // by socket
+
+            std::map<uint16_t, PageUpdate> _pending; // by mpp, until the magazine takes them
+
+            static const uint8_t ASCII_ACK=0x06;
+            static const uint8_t ASCII_NACK=0x15;
+
+            static const uint8_t MAXPENDING=32;   /* Maximum outstanding connection requests */
+            static const uint8_t MAXCLIENTS=16;   /* Maximum connected clients */
+            static const uint32_t MAXOUTPUT=65536; /* Unsent replies a client may have before it is disconnected */
+            static const uint16_t MAXMESSAGE=5+24*41; /* A whole page */
+            static const int RETRYMS=20; /* How often to offer updates to a magazine that is full */
+
+            /** Accept every waiting connection on the listening socket */
+            void _accept(int serverSock);
+
+            /** Read and act on everything waiting on a client socket
+             * @return false if the client has gone or sent something that isn't a message
+             */
+            bool _read(int sock, Connection* connection);
+
+            /** Send as much waiting output as the socket will take
+             * @return false if the client has gone or isn't reading its replies
+             */
+            bool _write(int sock, Connection* connection);
+
+            void _close(int sock);
+
+            /** Decode a message and merge it into _pending
+             * @return false if the message is not valid
+             */
+            bool _message(uint8_t type, const uint8_t* data, uint16_t length);
+
+            /** Encode rows into an update
+             * @return false if a row number is not valid
+             */
+            bool _rows(PageUpdate* update, const uint8_t* data, uint16_t length, uint8_t count);
+
+            /** Offer the pending updates to their magazines */
+            void _flush();
+    };
+}
+
+#endif
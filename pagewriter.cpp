@@ -0,0 +1,121 @@
+#include "pagewriter.h"
+
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace vbit;
+
+PageWriter::PageWriter()
+{
+    //ctor
+}
+
+PageWriter::~PageWriter()
+{
+    //dtor
+}
+
+void PageWriter::run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        _wake.wait(lock, [this]{return !_pending.empty();});
+
+        // let more edits arrive so that they go in the same write
+        _wake.wait_for(lock, std::chrono::milliseconds(PAGE_WRITE_DELAY), []{return false;});
+
+        std::map<std::string, std::string> batch;
+        batch.swap(_pending);
+        lock.unlock(); // the command threads can carry on editing while the files are written
+        for (std::map<std::string, std::string>::iterator it=batch.begin(); it!=batch.end(); ++it)
+        {
+            _write(it->first, it->second);
+        }
+        lock.lock();
+    }
+}
+
+void PageWriter::Write(const std::string& filename, const std::string& tti)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _pending[filename]=tti; // replaces an earlier edit that hasn't been written yet
+    _wake.notify_one();
+}
+
+bool PageWriter::IsOwnWrite(const std::string& filename, const struct stat& attrib)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::map<std::string, Written>::iterator it=_written.find(filename);
+    if (it==_written.end())
+        return false;
+    const Written& w=it->second;
+    return w.inode==attrib.st_ino && w.size==attrib.st_size && w.modified.tv_sec==attrib.st_mtim.tv_sec && w.modified.tv_nsec==attrib.st_mtim.tv_nsec;
+}
+
+void PageWriter::_write(const std::string& filename, const std::string& tti)
+{
+    // A name the FileMonitor won't take for a page
+    std::string temp=filename;
+    size_t dot=temp.rfind(".tti");
+    if (dot!=std::string::npos)
+        temp.replace(dot, 4, ".tmp");
+    else
+        temp+=".tmp";
+
+    std::stringstream ss;
+    int fd=open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd<0)
+    {
+        ss << "[PageWriter::_write] can't create " << temp << ": " << strerror(errno) << "\n";
+        std::cerr << ss.str();
+        return;
+    }
+
+    bool ok=true;
+    for (size_t done=0; ok && done<tti.size();)
+    {
+        ssize_t n=write(fd, tti.data()+done, tti.size()-done);
+        if (n<0 && errno==EINTR)
+            continue;
+        ok=(n>0);
+        if (ok)
+            done+=n;
+    }
+    ok=ok && fsync(fd)==0; // the new file must be on the disk before it replaces the old one
+
+    struct stat attrib;
+    ok=ok && fstat(fd, &attrib)==0;
+    close(fd);
+    if (!ok)
+    {
+        ss << "[PageWriter::_write] can't write " << temp << ": " << strerror(errno) << "\n";
+        std::cerr << ss.str();
+        unlink(temp.c_str());
+        return;
+    }
+
+    {
+        // recorded before the rename so that the FileMonitor can't see the file first
+        std::lock_guard<std::mutex> lock(_mutex);
+        Written& w=_written[filename];
+        w.inode=attrib.st_ino;
+        w.size=attrib.st_size;
+        w.modified=attrib.st_mtim;
+    }
+
+    if (rename(temp.c_str(), filename.c_str())<0)
+    {
+        ss << "[PageWriter::_write] can't replace " << filename << ": " << strerror(errno) << "\n";
+        std::cerr << ss.str();
+        unlink(temp.c_str());
+        return;
+    }
+
+    ss << "[PageWriter::_write] saved " << filename << "\n";
+    std::cerr << ss.str();
+}
@@ -0,0 +1,63 @@
+#ifndef _PAGEWRITER_H_
+#define _PAGEWRITER_H_
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <sys/stat.h>
+
+#define PAGE_WRITE_DELAY 1000 // ms that edits are gathered for before their pages are written
+
+/**
+ * @brief Writes pages that were edited through the command port back to their files
+ * The command thread hands over the page as tti text and carries on. The writer thread waits
+ * PAGE_WRITE_DELAY for more edits, so a page that is edited many times is written once with
+ * all of them. Files are written to a temporary file that is renamed over the old one, so
+ * the FileMonitor never sees half a file.
+ * The writer remembers what it wrote so that the FileMonitor can tell that a file changed
+ * because of an edit that is already in memory, and doesn't load it again.
+ */
+
+namespace vbit
+{
+    class PageWriter
+    {
+        public:
+            PageWriter();
+            ~PageWriter();
+
+            /** Run the writer thread */
+            void run();
+
+            /** Queue a page to be written
+             * @param filename The page's file
+             * @param tti The whole page as it is now
+             */
+            void Write(const std::string& filename, const std::string& tti);
+
+            /** @return true if the file is as this writer left it */
+            bool IsOwnWrite(const std::string& filename, const struct stat& attrib);
+
+        private:
+            std::mutex _mutex;
+            std::condition_variable _wake;
+            std::map<std::string, std::string> _pending; // tti by filename, latest edit only
+
+            /** What a file looked like when it was written */
+            struct Written
+            {
+                ino_t inode;
+                off_t size;
+                struct timespec modified;
+            };
+            std::map<std::string, Written> _written; // by filename
+
+            /** Write a file by way of a temporary file */
+            void _write(const std::string& filename, const std::string& tti);
+    };
+}
+
+#endif // _PAGEWRITER_H_
@@ -0,0 +1,113 @@
+/** PESSink
+ */
+#include "pessink.h"
+#include "vbit2.h"
+#include "coding.h"
+
+using namespace vbit;
+
+PESSink::PESSink(std::string destination, Backpressure policy, unsigned int bufferFields, uint16_t linesPerField, bool ts, uint16_t pid, uint8_t mag, uint8_t page) :
+    OutputSink(ts ? "ts" : "PES", destination, policy, bufferFields, ts ? (3 + _maxPESLength(linesPerField) / 184) * TSPACKETSIZE : _maxPESLength(linesPerField)),
+    _PESLines(0),
+    _tsWriter(nullptr)
+{
+    _PESField.resize(_maxPESLength(linesPerField));
+    
+    /* The parts of the PES header that don't change from field to field */
+    uint8_t* pes = _PESField.data();
+    pes[0] = 0x00; // packet_start_code_prefix
+    pes[1] = 0x00;
+    pes[2] = 0x01;
+    pes[3] = 0xBD; // private_stream_1
+    
+    /* bits | 7 | 6 |  5   | 4   |     3    |     2     |     1     |     0    |
+            | 1 | 0 | Scrambling | Priority | Alignment | Copyright | Original | */
+    pes[6] = 0x85; // Align, Original
+    
+    /* bits |  7 | 6  |   5  |    4    |     3     |     2     |    1    |       0       |
+            | PTS DTS | ESCR | ES rate | DSM trick | copy info | PES CRC | PES extension |*/
+    pes[7] = 0x80; // PTS only
+    
+    pes[8] = 0x24; // PES header data length
+    
+    std::fill(pes + 9, pes + 0x2D, 0xff); // make PES header up to 45 bytes long with stuffing bytes.
+    
+    pes[0x2D] = 0x10; // PES data identifier (EBU data)
+    
+    if (ts)
+    {
+        _tsWriter = new TSWriter(pid, _PESField.size(), mag, page);
+    }
+}
+
+PESSink::~PESSink()
+{
+    delete _tsWriter;
+}
+
+void PESSink::AddPacket(std::array<uint8_t, PACKETSIZE>* packet, uint16_t line, uint8_t field)
+{
+    if (line == 0)
+    {
+        // a new field has started - transmit data for previous field if there is any
+        if (_PESLines)
+        {
+            uint8_t* pes = _PESField.data();
+            
+            int numBlocks = _PESLines + 1; // header and N lines
+            int numTSPackets = ((numBlocks * 46) + 183) / 184; // round up
+            int packetLength = (numTSPackets * 184) - 6;
+            
+            pes[4] = packetLength >> 8;
+            pes[5] = packetLength & 0xff;
+            
+            vbit::MasterClock *mc = mc->Instance();
+            uint64_t fieldCount = mc->GetFieldCount(); // the buffered lines belong to the field before this one
+            uint64_t PTS = ((fieldCount - 1) * 1800 + TS_PTS_DELAY) & 0x1FFFFFFFFULL; // 90kHz clock, 50 fields per second
+            
+            // PTS in place of the first five stuffing bytes
+            pes[9] = 0x21 | ((PTS >> 29) & 0x0E);
+            pes[10] = (PTS & 0x3FC00000) >> 22;
+            pes[11] = 0x01 | ((PTS & 0x3F8000) >> 14);
+            pes[12] = (PTS & 0x7F80) >> 7;
+            pes[13] = 0x01 | ((PTS & 0x7F) << 1);
+            
+            std::fill(pes + numBlocks * 46, pes + numTSPackets * 184, 0xff); // pad out remainder of PES packet
+            
+            if (_tsWriter)
+            {
+                uint8_t* out = _claim(_tsWriter->GetMaxFieldLength());
+                if (out)
+                {
+                    _commit(_tsWriter->WriteField(pes, numTSPackets * 184, fieldCount * 1800, out));
+                }
+            }
+            else
+            {
+                _append(pes, numTSPackets * 184);
+            }
+            
+            _PESLines = 0; // empty buffer ready for next frame's packets
+        }
+        
+        _endField();
+    }
+    
+    uint8_t* data = _PESField.data() + (_PESLines + 1) * 46; // data units follow the 46 byte header
+    
+    data[0] = 0x02; // data_unit_id (EBU teletext non-subtitle)
+    data[1] = 0x2c; // data_unit_length (44 bytes)
+    
+    if (line > 15)
+    {
+        data[2] = ((field&1)^1) << 5; //field parity, line number undefined
+    }
+    else
+    {
+        data[2] = (((field&1)^1) << 5) | (line + 7); // field parity and line number
+    }
+    
+    ReverseBits(data+3, packet->data()+2, 43); // bits are reversed in PES stream
+    
+    _PESLines++;
+}
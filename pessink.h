@@ -0,0 +1,42 @@
+#ifndef _PESSINK_H_
+#define _PESSINK_H_
+
+#include "outputsink.h"
+#include "tswriter.h"
+
+/**
+ * Output sink for a Packetized Elementary Stream of teletext.
+ * Each field becomes one PES packet sized to fill whole transport stream packets.
+ * Optionally wraps the PES packets in an MPEG-2 transport stream.
+ */
+
+namespace vbit
+{
+    class PESSink : public OutputSink
+    {
+        public:
+            /** Constructor
+             * @param ts Wrap the PES packets in a transport stream
+             * @param pid PID of the teletext in the transport stream
+             * @param mag Initial teletext magazine for the transport stream teletext descriptor
+             * @param page Initial teletext page for the transport stream teletext descriptor
+             * Other parameters as OutputSink
+             */
+            PESSink(std::string destination, Backpressure policy, unsigned int bufferFields, uint16_t linesPerField, bool ts, uint16_t pid, uint8_t mag, uint8_t page);
+
+            /** Default destructor */
+            virtual ~PESSink();
+
+            void AddPacket(std::array<uint8_t, PACKETSIZE>* packet, uint16_t line, uint8_t field) override;
+
+        private:
+            std::vector<uint8_t> _PESField; // PES packet for one field, allocated at startup
+            unsigned int _PESLines; // number of lines in _PESField
+            TSWriter* _tsWriter; // wraps the PES packets for transport stream output
+
+            /** @return Room for a PES header and every line of a field, rounded up to whole transport stream packets */
+            static unsigned int _maxPESLength(uint16_t linesPerField){ return (((linesPerField + 1) * 46 + 183) / 184) * 184; };
+    };
+}
+
+#endif // _PESSINK_H_
@@ -0,0 +1,26 @@
+/** RawSink
+ */
+#include "rawsink.h"
+
+using namespace vbit;
+
+RawSink::RawSink(std::string destination, Backpressure policy, unsigned int bufferFields, uint16_t linesPerField) :
+    OutputSink("raw", destination, policy, bufferFields, linesPerField * PACKETSIZE)
+{
+
+}
+
+RawSink::~RawSink()
+{
+
+}
+
+void RawSink::AddPacket(std::array<uint8_t, PACKETSIZE>* packet, uint16_t line, uint8_t field)
+{
+    (void)field;
+
+    if (line == 0)
+        _endField();
+
+    _append(packet->data(), PACKETSIZE);
+}
@@ -0,0 +1,28 @@
+#ifndef _RAWSINK_H_
+#define _RAWSINK_H_
+
+#include "outputsink.h"
+
+/**
+ * Output sink for full 45 byte teletext packets.
+ * Each packet includes the clock run in and framing code.
+ */
+
+namespace vbit
+{
+    class RawSink : public OutputSink
+    {
+        public:
+            /** Constructor
+             * Parameters as OutputSink
+             */
+            RawSink(std::string destination, Backpressure policy, unsigned int bufferFields, uint16_t linesPerField);
+
+            /** Default destructor */
+            virtual ~RawSink();
+
+            void AddPacket(std::array<uint8_t, PACKETSIZE>* packet, uint16_t line, uint8_t field) override;
+    };
+}
+
+#endif // _RAWSINK_H_
@@ -2,42 +2,199 @@
  */
 #include "service.h"
 #include "vbit2.h"
+#include "coding.h"
 
 using namespace ttx;
 using namespace vbit;
 
+volatile std::sig_atomic_t Service::_reportRequested = 0;
+
 Service::Service(Configure *configure, PageList *pageList) :
     _configure(configure),
     _pageList(pageList),
-    _fieldCounter(49) // roll over immediately
+    _fieldCounter(49), // roll over immediately
+    _shareScheduler(configure->GetSchedulerMode() == Configure::Share),
+    _virtualTime(0),
+    _reportFields(0),
+    _fillerRows(0),
+    _tuneFields(0),
+    _outputReportFields(0),
+    _timingValid(false),
+    _lateFields(0),
+    _skippedFields(0),
+    _resyncs(0),
+    _worstLate(0),
+    _minLead(INT64_MAX),
+    _subtitleNext(0),
+    _subtitleInPage(nullptr),
+    _heldMagazine(nullptr),
+    _subtitleLines(0),
+    _schedule(nullptr),
+    _replaying(false)
 {
+    _linesPerField = _configure->GetLinesPerField();
+    
+    int reserve = _configure->GetSubtitleReservedLines();
+    _subtitleReserve = (reserve < 0) ? 0 : ((reserve > _linesPerField) ? _linesPerField : reserve);
+    
+    _lineCounter = _linesPerField - 1; // roll over immediately
+    
+    // Magazines without a configured share get a slice of the lines in proportion to 1/magazine_priority
+    double capacity = _linesPerField * 50.0;
+    double priorityWeights = 0;
+    for (uint8_t mag=0;mag<8;mag++)
+    {
+        priorityWeights += 1.0 / _configure->GetMagazinePriority(mag);
+    }
+    
     vbit::PacketMag **magList=_pageList->GetMagazines();
     // Register all the packet sources
     for (uint8_t mag=0;mag<8;mag++)
     {
         vbit::PacketMag* m=magList[mag];
-        m->SetPriority(_configure->GetMagazinePriority(mag)); // set the mags to the desired priorities
-        _register(m); // use the PacketMags created in pageList rather than duplicating them
+        double share = _configure->GetMagazineShare(mag);
+        if (share == 0)
+        {
+            share = capacity / (_configure->GetMagazinePriority(mag) * priorityWeights);
+        }
+        
+        if (_shareScheduler)
+        {
+            m->SetPriority(1); // the share scheduler decides when a magazine may go so don't hold it back
+        }
+        else
+        {
+            m->SetPriority(_configure->GetMagazinePriority(mag)); // set the mags to the desired priorities
+        }
+        
+        std::stringstream ss;
+        ss << "magazine " << (int)((mag == 0)?8:mag);
+        _register(m, ss.str(), share); // use the PacketMags created in pageList rather than duplicating them
     }
     
     // Add packet sources for subtitles and packet 830
-    _register(_subtitle=new PacketSubtitle(_configure));
-    _register(new Packet830(_configure));
+    std::vector<Configure::SubtitleServiceSpec> services = _configure->GetSubtitleServices();
+    for (unsigned int i = 0; i < services.size(); i++)
+    {
+        vbit::PacketSubtitle* subtitle = new PacketSubtitle(_configure, services[i].page, services[i].repeats);
+        _subtitles.push_back(subtitle);
+        
+        std::stringstream ss;
+        ss << "subtitles " << std::hex << std::uppercase << services[i].page;
+        _register(subtitle, ss.str()); // subtitles always go first so aren't share scheduled
+    }
+    
+    if (!_configure->GetSubtitleFile().empty())
+    {
+        uint16_t page = _configure->GetSubtitleFilePage();
+        vbit::PacketSubtitleFile* subtitle = new PacketSubtitleFile(_configure, page, _configure->GetSubtitleRepeats(), _configure->GetSubtitleFile(), _configure->GetSubtitleFileStart());
+        for (unsigned int i = 0; i < services.size(); i++)
+        {
+            if (services[i].page == page)
+            {
+                std::stringstream ss;
+                ss << "[Service::Service] subtitle file and a subtitle service are both on P" << std::hex << std::uppercase << page << "\n";
+                std::cerr << ss.str();
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (!subtitle->IsLoaded())
+        {
+            std::stringstream ss;
+            ss << "[Service::Service] no subtitles to play from " << _configure->GetSubtitleFile() << "\n";
+            std::cerr << ss.str();
+            exit(EXIT_FAILURE);
+        }
+        _subtitles.push_back(subtitle); // after the services with command ports
+        
+        std::stringstream ss;
+        ss << "subtitle file " << std::hex << std::uppercase << page;
+        _register(subtitle, ss.str());
+    }
+    if (_subtitleReserve)
+    {
+        // A page due just after the reservation is used up waits for the next field, then takes as many fields as it needs
+        const int lines = 8; // header and seven Newfor rows
+        std::stringstream ss;
+        ss << "[Service::Service] " << _subtitleReserve << " lines per field reserved for subtitles. A page of " << lines << " lines is on air within " << 1 + (lines + _subtitleReserve - 1) / _subtitleReserve << " fields\n";
+        std::cerr << ss.str();
+    }
     
-    _register(_debug=new PacketDebug(_configure));
+    vbit::Packet830* p830 = new Packet830(_configure);
+    _register(p830, "packet 8/30", _configure->GetPacket830Share());
     
-    _linesPerField = _configure->GetLinesPerField();
+    _register(_debug=new PacketDebug(_configure), "debug");
     
-    _lineCounter = _linesPerField - 1; // roll over immediately
+    if (_configure->GetCycleSchedule())
+    {
+        std::vector<vbit::PacketSource*> timed = {p830, _debug};
+        _schedule = new vbit::CycleSchedule(_configure, _pageList, _linesPerField, timed);
+        std::cerr << "[Service::Service] A cycle of the magazines is recorded and played out\n";
+    }
+    
+    // Create the outputs. Each one gets the same packets
+    std::vector<Configure::OutputSinkSpec> specs = _configure->GetOutputSinks();
+    for (unsigned int i = 0; i < specs.size(); i++)
+    {
+        vbit::OutputSink* sink;
+        vbit::OutputSink::Backpressure policy = specs[i].drop ? vbit::OutputSink::Drop : vbit::OutputSink::Block;
+        switch (specs[i].format)
+        {
+            default:
+            case Configure::OutputFormat::T42:
+                sink = new vbit::T42Sink(specs[i].destination, policy, specs[i].bufferFields, _linesPerField, specs[i].reverse);
+                break;
+            case Configure::OutputFormat::Raw:
+                sink = new vbit::RawSink(specs[i].destination, policy, specs[i].bufferFields, _linesPerField);
+                break;
+            case Configure::OutputFormat::PES:
+            case Configure::OutputFormat::TS:
+                sink = new vbit::PESSink(specs[i].destination, policy, specs[i].bufferFields, _linesPerField, specs[i].format == Configure::OutputFormat::TS, _configure->GetTSPID(), _configure->GetInitialMag(), _configure->GetInitialPage());
+                break;
+            case Configure::OutputFormat::VBI:
+                sink = new vbit::VBISink(specs[i].destination, policy, specs[i].bufferFields, _linesPerField, specs[i].sampleRate, specs[i].sampleBits);
+                break;
+            case Configure::OutputFormat::OP47:
+            case Configure::OutputFormat::ST2031:
+                sink = new vbit::AncSink(specs[i].destination, policy, specs[i].bufferFields, _linesPerField, (specs[i].format == Configure::OutputFormat::OP47) ? vbit::AncSink::OP47 : vbit::AncSink::ST2031);
+                break;
+        }
+        
+        if (!sink->IsOpen())
+        {
+            std::stringstream ss;
+            ss << "[Service::Service] could not open output " << specs[i].destination << "\n";
+            std::cerr << ss.str();
+            exit(EXIT_FAILURE);
+        }
+        _sinks.push_back(sink);
+    }
+    
+    if (_shareScheduler)
+    {
+        std::cerr << "[Service::Service] Magazines are scheduled by bandwidth share\n";
+    }
 }
 
 Service::~Service()
 {
+    for (unsigned int i = 0; i < _sinks.size(); i++)
+    {
+        delete _sinks[i];
+    }
 }
 
-void Service::_register(PacketSource *src)
+void Service::_register(PacketSource *src, std::string name, double share)
 {
     _Sources.push_front(src);
+    
+    SourceShare s;
+    s.source = src;
+    s.name = name;
+    s.share = share;
+    s.finish = 0;
+    s.rows = 0;
+    _shares.push_back(s);
 }
 
 int Service::run()
@@ -53,6 +210,7 @@ int Service::run()
 
     std::cerr << "[Service::run] Loop starts" << std::endl;
     std::cerr << "[Service::run] Lines per field: " << (int)_linesPerField << std::endl;
+    std::cerr << "[Service::run] Packet coding: " << CodingKernels() << std::endl;
     while(1)
     {
         //std::cerr << "[Service::run]iterates. VBI line=" << (int) _lineCounter << " (int) field=" << (int) _fieldCounter << std::endl;
@@ -61,6 +219,7 @@ int Service::run()
         // Iterate through the packet sources until we get a packet to transmit
         
         vbit::PacketSource* p;
+        vbit::PacketSubtitle* subtitle=nullptr;
         first=iterator;
         bool force=false;
         uint8_t sourceCount=0;
@@ -69,27 +228,44 @@ int Service::run()
         // Send ONLY one packet per loop
         _updateEvents();
         
-        if (_debug->IsReady()) // Special case for debug. Ensures it can have the first line of field
+        if (_replaying)
         {
-            if (_debug->GetPacket(pkt) != nullptr)
-            {
-                _packetOutput(pkt);
-            }
-            else
+            for (unsigned int i = 0; i < _subtitles.size(); i++)
             {
-                _packetOutput(filler);
+                if (_subtitles[i]->IsReady())
+                {
+                    _schedule->Stop(); // subtitles aren't part of the cycle
+                    _replaying = false;
+                    break;
+                }
             }
         }
-        else if (_subtitle->IsReady()) // Special case for subtitles. Subtitles always go if there is one waiting
+        
+        if (_replaying)
         {
-            if (_subtitle->GetPacket(pkt) != nullptr)
+            _lineOutput(_schedule->Replay(pkt, &p));
+            if (p)
             {
-                _packetOutput(pkt);
+                _countRow(p);
             }
             else
             {
-                _packetOutput(filler);
+                _fillerRows++;
             }
+            continue;
+        }
+        
+        if (_debug->IsReady()) // Special case for debug. Ensures it can have the first line of field
+        {
+            p=_debug;
+        }
+        else if ((subtitle=_nextSubtitle())) // Special case for subtitles. Subtitles go first while they have lines left in the field
+        {
+            p=subtitle;
+        }
+        else if (_shareScheduler)
+        {
+            p=_nextShare(); // the source furthest behind its share goes next
         }
         else
         {
@@ -123,25 +299,40 @@ int Service::run()
 
                 sourceCount++; // Count how many sources we tried.
             }
-            while (!p->IsReady(force));
+            while (p==_heldMagazine || !p->IsReady(force));
+        }
+        
+        if (!p && _subtitleReserve && (subtitle=_nextSubtitle(true))) // subtitles can have lines nothing else wants
+        {
+            p=subtitle;
+        }
+        
+        // Did we find a packet? Then send it otherwise put out a filler
+        // GetPacket returns nullptr if the pkt isn't valid
+        if (p && p->GetPacket(pkt) != nullptr)
+        {
+            if (_schedule)
+            {
+                _schedule->Record(pkt, p);
+            }
+            _packetOutput(pkt);
+            _countRow(p);
             
-            // Did we find a packet? Then send it otherwise put out a filler
-            if (p)
+            if (subtitle)
             {
-                // GetPacket returns nullptr if the pkt isn't valid - if it's null go round again.
-                if (p->GetPacket(pkt) != nullptr)
-                {
-                    _packetOutput(pkt);
-                }
-                else
-                {
-                    _packetOutput(filler);
-                }
+                _subtitleLines++;
+                _subtitleInPage = subtitle->InPage() ? subtitle : nullptr; // hold on to it until its rows have gone
+                _heldMagazine = _subtitleInPage ? _pageList->GetMagazines()[(subtitle->GetPageNumber() >> 8) & 0x07] : nullptr;
             }
-            else
+        }
+        else
+        {
+            if (_schedule)
             {
-                _packetOutput(filler);
+                _schedule->Record(nullptr, p);
             }
+            _packetOutput(filler);
+            _fillerRows++;
         }
 
     } // while forever
@@ -161,6 +352,35 @@ void Service::_updateEvents()
     if (_lineCounter == 0) // new field
     {
         _fieldCounter = (_fieldCounter + 1) % 50;
+        mc->IncrementFieldCount();
+        _subtitleLines = 0;
+        
+        _reportFields++;
+        int reportInterval = _configure->GetSchedulerReportInterval();
+        if (reportInterval > 0 && _reportFields >= (uint32_t)reportInterval * 50)
+        {
+            if (_shareScheduler)
+            {
+                _reportShares();
+            }
+            _reportMagazines();
+            _reportDeadlines();
+            _fillerRows = 0;
+            _reportFields = 0;
+        }
+        
+        int outputInterval = _configure->GetOutputReportInterval();
+        if (_reportRequested || (outputInterval > 0 && ++_outputReportFields >= (uint32_t)outputInterval * 50))
+        {
+            _reportRequested = 0;
+            _reportOutput();
+        }
+        
+        if (!_replaying && _configure->GetMagazineTuning() != Configure::TuneOff && ++_tuneFields >= (uint32_t)_configure->GetMagazineTuningInterval() * 50)
+        {
+            _tuneMagazines();
+            _tuneFields = 0;
+        }
         
         time_t now;
         time(&now);
@@ -175,12 +395,21 @@ void Service::_updateEvents()
         
         _debug->TimeAndField(masterClock, _fieldCounter, now); // update the clocks in debugPacket.
         
+        _checkFieldTiming(masterClock);
+        
         if (_fieldCounter == 0)
         {
             // if internal master clock is behind real time, or too far ahead, resynchronise it.
             if (masterClock < now || masterClock > now + FORWARDSBUFFER + 1)
             {
+                if (mc->GetMasterClock() != 0) // not the first time it is set
+                {
+                    if (masterClock < now)
+                        _skippedFields += (now - masterClock) * 50;
+                    _resyncs++;
+                }
                 masterClock = now;
+                _timingValid = false;
                 
                 std::cerr << "[Service::_updateEvents] Resynchronising master clock" << std::endl; // emit warning on stderr
             }
@@ -196,6 +425,9 @@ void Service::_updateEvents()
                 }
             }
         }
+        
+        mc->SetField(_fieldCounter); // before the sources see the new field
+        
         // New field, so set the FIELD event in all the sources.
         for (std::list<vbit::PacketSource*>::const_iterator iterator = _Sources.begin(), end = _Sources.end(); iterator != end; ++iterator)
         {
@@ -239,128 +471,368 @@ void Service::_updateEvents()
             }
         }
         
+        _replaying = _schedule && _schedule->StartField(); // after the events, which it waits on while recording
+        
         std::cout << std::flush;
     }
     
     // @todo Databroadcast events. Flag when there is data in the buffer.
 }
 
-void Service::_packetOutput(vbit::Packet* pkt)
+vbit::PacketSubtitle* Service::_nextSubtitle(bool spare)
 {
-    std::array<uint8_t, PACKETSIZE> *p = pkt->tx();
+    // lines left for subtitles in this field, counting this one
+    int available = _linesPerField - _lineCounter;
+    if (_subtitleReserve && !spare && _subtitleReserve - _subtitleLines < available)
+        available = _subtitleReserve - _subtitleLines;
+    if (available <= 0)
+        return nullptr; // _heldMagazine keeps the rest of the magazine out until the next field
     
-    Configure::OutputFormat OutputFormat = _configure->GetOutputFormat();
+    if (_subtitleInPage)
+    {
+        // rows sent in between for another page in the same magazine would be taken as part of that page
+        if (_subtitleInPage->IsReady())
+            return _subtitleInPage;
+        _subtitleInPage = nullptr;
+        _heldMagazine = nullptr;
+    }
     
-    switch (OutputFormat)
+    for (unsigned int i = 0; i < _subtitles.size(); i++)
     {
-        case Configure::OutputFormat::T42:
+        unsigned int n = (_subtitleNext + i) % _subtitles.size();
+        if (_subtitles[n]->IsReady())
         {
-            /* t42 output */
-            if (_configure->GetReverseFlag())
-            {
-                static std::array<uint8_t, PACKETSIZE> tmp;
-                for (unsigned int i=0;i<(p->size());i++)
-                {
-                    tmp[i]=ReverseByteTab[p->at(i)];
-                }
-                p = &tmp;
-            }
-            
-            std::cout.write((char*)p->data()+3, 42); // have to cast the pointer to char for cout.write()
-            
-            break;
+            // The first ready service in turn has the next page, so it waits rather than let another service jump in
+            int lines = _subtitles[n]->GetLinesToSend();
+            if (_subtitleReserve && lines > available && (spare || lines <= _subtitleReserve))
+                return nullptr; // it all goes out in the next field instead of finishing there anyway
+            _subtitleNext = (n + 1) % _subtitles.size(); // the next service gets the first look next time
+            return _subtitles[n];
         }
+    }
+    
+    return nullptr;
+}
+
+vbit::PacketSource* Service::_nextShare()
+{
+    // Start-time fair queuing. A source that has been idle restarts at the current virtual time
+    // so it can't save up credit, while a busy source is held back until the others catch up.
+    SourceShare* next=nullptr;
+    double nextStart=0;
+    
+    for (std::vector<SourceShare>::iterator it=_shares.begin(); it!=_shares.end(); ++it)
+    {
+        if (it->share <= 0)
+            continue; // pre-emptive sources are handled in run()
+        
+        if (it->source == _heldMagazine || !it->source->IsReady())
+            continue;
         
-        case Configure::OutputFormat::Raw:
+        double start = (it->finish > _virtualTime) ? it->finish : _virtualTime;
+        if (next == nullptr || start < nextStart)
         {
-            /* full 45 byte teletext packets */
-            std::cout.write((char*)p->data(), 45); // have to cast the pointer to char for cout.write()
-            
-            break;
+            next = &(*it);
+            nextStart = start;
         }
+    }
+    
+    if (next == nullptr)
+        return nullptr;
+    
+    _virtualTime = nextStart;
+    next->finish = nextStart + 1.0 / next->share;
+    return next->source;
+}
+
+Service::SourceShare* Service::_findShare(vbit::PacketSource *src)
+{
+    for (std::vector<SourceShare>::iterator it=_shares.begin(); it!=_shares.end(); ++it)
+    {
+        if (it->source == src)
+        {
+            return &(*it);
+        }
+    }
+    return nullptr;
+}
+
+void Service::_countRow(vbit::PacketSource *src)
+{
+    SourceShare* s = _findShare(src);
+    if (s)
+    {
+        s->rows++;
+    }
+}
+
+void Service::_tuneMagazines()
+{
+    vbit::PacketMag **magList=_pageList->GetMagazines();
+    Configure::MagazineTuning tuning = _configure->GetMagazineTuning();
+    double cycle[8];
+    double total = 0;
+    int count = 0;
+    
+    for (uint8_t mag=0;mag<8;mag++)
+    {
+        cycle[mag] = magList[mag]->GetCycleTime() / 50.0;
+        if (magList[mag]->Get_pageSet()->size() > 0 && cycle[mag] > 0)
+        {
+            total += cycle[mag];
+            count++;
+        }
+    }
+    
+    if (count == 0)
+        return; // nothing measured yet
+    
+    double mean = total / count;
+    
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1);
+    
+    for (uint8_t mag=0;mag<8;mag++)
+    {
+        vbit::PacketMag* m=magList[mag];
+        if (m->Get_pageSet()->size() == 0 || cycle[mag] == 0)
+            continue;
         
-        case Configure::OutputFormat::PES:
+        double target;
+        bool faster;
+        bool slower;
+        if (tuning == Configure::TuneEqualise)
         {
-            /* Packetized Elementary Stream for insertion into MPEG-2 transport stream */
-            
-            if (_lineCounter == 0)
-            {
-                // a new field has started - transmit data for previous field if there is any
-                if (!(_PESBuffer.empty()))
-                {
-                    std::array<uint8_t, 46> padding;
-                    padding.fill(0xff);
-                    
-                    std::vector<uint8_t> header = {0x00, 0x00, 0x01, 0xBD};
-                    
-                    int numBlocks = _PESBuffer.size() + 1; // header and N lines
-                    int numTSPackets = ((numBlocks * 46) + 183) / 184; // round up
-                    int packetLength = (numTSPackets * 184) - 6;
-                    
-                    header.push_back(packetLength >> 8);
-                    header.push_back(packetLength & 0xff);
-                    
-                    /* bits | 7 | 6 |  5   | 4   |     3    |     2     |     1     |     0    |
-                            | 1 | 0 | Scrambling | Priority | Alignment | Copyright | Original | */
-                    header.push_back(0x85); // Align, Original
-                    
-                    /* bits |  7 | 6  |   5  |    4    |     3     |     2     |    1    |       0       |
-                            | PTS DTS | ESCR | ES rate | DSM trick | copy info | PES CRC | PES extension |*/
-                    header.push_back(0x00); // No PTS
-                    
-                    header.push_back(0x24); // PES header data length
-                    
-                    /* 
-                    uint64_t PTS = 0; // ???
-                    
-                    // append PTS
-                    header.push_back(0x21 | (PTS >> 30));
-                    header.push_back((PTS & 0x3FC00000) >> 22);
-                    header.push_back(0x01 | ((PTS & 0x3F8000) >> 14));
-                    header.push_back((PTS & 0x7F80) >> 7);
-                    header.push_back(0x01 | ((PTS & 0x7F) << 1));
-                    */
-                    
-                    header.resize(0x2D, 0xff); // make PES header up to 45 bytes long with stuffing bytes.
-                    
-                    header.push_back(0x10); // append PES data identifier (EBU data)
-                    
-                    std::cout.write((char*)header.data(), header.size()); // output PES header and data_identifier
-                    
-                    for (unsigned int i = 0; i < _PESBuffer.size(); i++)
-                    {
-                        std::cout.write((char*)_PESBuffer[i].data(), 46);
-                    }
-                    
-                    for (int i = numBlocks; i < numTSPackets * 4; i++)
-                    {
-                        std::cout.write((char*)padding.data(), 46); // pad out remainder of PES packet
-                    }
-                    
-                    _PESBuffer.clear(); // empty buffer ready for next frame's packets
-                }
-            }
-            
-            std::vector<uint8_t> data = {0x02, 0x2c}; // data_unit_id and data_unit_length (EBU teletext non-subtitle, 44 bytes)
-            
-            if (_lineCounter > 15)
-            {
-                data.push_back(((_fieldCounter&1)^1) << 5); //field parity, line number undefined
-            }
+            // move every magazine towards the average, with a dead band so that they settle
+            target = mean;
+            faster = cycle[mag] > target * 1.1;
+            slower = cycle[mag] < target * 0.9;
+        }
+        else
+        {
+            // only push magazines that are over their maximum, and give back bandwidth from those well under
+            target = _configure->GetMagazineMaxCycle(mag);
+            if (target <= 0)
+                continue;
+            faster = cycle[mag] > target;
+            slower = cycle[mag] < target * 0.5;
+        }
+        
+        if (!(faster || slower))
+            continue;
+        
+        ss << "[Service::_tuneMagazines] magazine " << (int)((mag == 0)?8:mag) << " cycle " << cycle[mag] << "s target " << target << "s ";
+        
+        if (_shareScheduler)
+        {
+            SourceShare* s = _findShare(m);
+            double ratio = cycle[mag] / target;
+            if (ratio > 2.0) ratio = 2.0; // limit the step size so that one bad measurement can't upset everything
+            if (ratio < 0.5) ratio = 0.5;
+            double share = s->share * ratio;
+            if (share < 1.0) share = 1.0;
+            if (share > _linesPerField * 50.0) share = _linesPerField * 50.0;
+            ss << "share " << s->share << " -> " << share << "\n";
+            s->share = share;
+        }
+        else
+        {
+            // 1 is the highest priority
+            int priority = m->GetPriority();
+            int newPriority = priority;
+            if (faster && priority > 1)
+                newPriority--;
+            else if (slower && priority < 9)
+                newPriority++;
+            if (newPriority == priority)
+                ss << "priority " << priority << " at limit\n";
             else
-            {
-                data.push_back((((_fieldCounter&1)^1) << 5) | (_lineCounter + 7)); // field parity and line number
-            }
-            
-            for (int i = 2; i < 45; i++)
-            {
-                data.push_back(ReverseByteTab[p->at(i)]); // bits are reversed in PES stream
-            }
-            
-            _PESBuffer.push_back(data);
-            
-            break;
+                ss << "priority " << priority << " -> " << newPriority << "\n";
+            m->SetPriority(newPriority);
         }
     }
+    std::cerr << ss.str();
+}
+
+void Service::_reportShares()
+{
+    double seconds = _reportFields / 50.0;
+    double capacity = _linesPerField * 50.0;
+    double total = 0;
+    
+    for (std::vector<SourceShare>::iterator it=_shares.begin(); it!=_shares.end(); ++it)
+    {
+        total += it->share;
+    }
+    
+    // when the shares add up to more than the lines available each one is scaled back in proportion
+    double scale = (total > capacity) ? capacity / total : 1.0;
+    
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1);
+    ss << "[Service::_reportShares] rows per second over the last " << seconds << "s\n";
+    for (std::vector<SourceShare>::iterator it=_shares.begin(); it!=_shares.end(); ++it)
+    {
+        ss << "[Service::_reportShares] " << std::setw(12) << std::left << it->name << std::right;
+        if (it->share > 0)
+            ss << " target " << std::setw(6) << it->share * scale;
+        else
+            ss << " target      -";
+        ss << " achieved " << std::setw(6) << it->rows / seconds << "\n";
+        it->rows = 0;
+    }
+    ss << "[Service::_reportShares] " << std::setw(12) << std::left << "filler" << std::right << " target      - achieved " << std::setw(6) << _fillerRows / seconds << "\n";
+    std::cerr << ss.str();
+}
 
+void Service::_reportMagazines()
+{
+    vbit::PacketMag **magList=_pageList->GetMagazines();
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1);
+    for (uint8_t mag=0;mag<8;mag++)
+    {
+        vbit::PacketMag* m=magList[mag];
+        if (m->Get_pageSet()->size() == 0)
+            continue;
+        
+        ss << "[Service::_reportMagazines] magazine " << (int)((mag == 0)?8:mag) << " cycle ";
+        if (m->GetCycleTime() > 0)
+            ss << m->GetCycleTime() / 50.0 << "s";
+        else
+            ss << "-"; // no full cycle yet
+        
+        if (_shareScheduler)
+        {
+            SourceShare* s = _findShare(m);
+            if (s)
+                ss << " share " << s->share;
+        }
+        else
+        {
+            ss << " priority " << (int)m->GetPriority();
+        }
+        ss << "\n";
+    }
+    std::cerr << ss.str();
+}
+
+void Service::_reportDeadlines()
+{
+    vbit::PacketMag **magList=_pageList->GetMagazines();
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    for (uint8_t mag=0;mag<8;mag++)
+    {
+        vbit::PacketMag* m=magList[mag];
+        if (m->GetMissedDeadlines())
+        {
+            ss << "[Service::_reportDeadlines] magazine " << (int)((mag == 0)?8:mag) << " missed " << m->GetMissedDeadlines() << " page deadlines, worst by " << m->GetWorstLateness() / 50.0 << "s\n";
+        }
+        m->ResetDeadlineStats();
+    }
+    std::cerr << ss.str();
+}
+
+void Service::RequestReport(int signum)
+{
+    (void)signum;
+    _reportRequested = 1;
+}
+
+void Service::_checkFieldTiming(time_t masterClock)
+{
+    // when the field should go on air
+    std::chrono::system_clock::time_point due = std::chrono::system_clock::from_time_t(masterClock) + std::chrono::milliseconds(20 * _fieldCounter);
+    int64_t lead = std::chrono::duration_cast<std::chrono::microseconds>(due - std::chrono::system_clock::now()).count();
+    
+    if (lead >= 0)
+    {
+        _timingValid = true;
+        if (lead < _minLead)
+            _minLead = lead;
+    }
+    else if (_timingValid)
+    {
+        _lateFields++;
+        if ((uint64_t)-lead > _worstLate)
+            _worstLate = -lead;
+    }
+}
+
+void Service::_reportOutput()
+{
+    std::stringstream ss;
+    ss << "[Service::_reportOutput] fields " << vbit::MasterClock::Instance()->GetFieldCount() << " late " << _lateFields;
+    if (_worstLate)
+        ss << " (worst " << LatencyHistogram::Format(_worstLate) << ")";
+    ss << " skipped " << _skippedFields << " resyncs " << _resyncs;
+    if (_minLead != INT64_MAX)
+        ss << " min lead " << LatencyHistogram::Format(_minLead);
+    ss << "\n";
+    
+    for (unsigned int i = 0; i < _sinks.size(); i++)
+    {
+        vbit::OutputSink* sink = _sinks[i];
+        ss << "[Service::_reportOutput] output " << sink->GetDestination();
+        if (!sink->IsOpen())
+        {
+            ss << " closed\n";
+            continue;
+        }
+        ss << " written " << sink->GetWrittenFields() << " stalls " << sink->GetStalls() << " dropped " << sink->GetDroppedFields();
+        if (sink->GetWriteLatency()->GetCount())
+            ss << " write " << sink->GetWriteLatency()->Summary();
+        ss << "\n";
+        sink->GetWriteLatency()->Reset();
+    }
+    
+    for (unsigned int i = 0; i < _subtitles.size(); i++)
+    {
+        vbit::PacketSubtitle* subtitle = _subtitles[i];
+        ss << "[Service::_reportOutput] subtitles P" << std::hex << std::uppercase << subtitle->GetPageNumber() << std::dec << std::nouppercase;
+        ss << " cues " << subtitle->GetCues() << " late " << subtitle->GetLateCues() << " overflowed " << subtitle->GetOverflows() << "\n";
+        if (subtitle->GetHeaderLatency()->GetCount())
+        {
+            ss << "[Service::_reportOutput] subtitles P" << std::hex << std::uppercase << subtitle->GetPageNumber() << std::dec << std::nouppercase;
+            if (subtitle->GetInputLatency()->GetCount())
+                ss << " input " << subtitle->GetInputLatency()->Summary();
+            ss << " header " << subtitle->GetHeaderLatency()->Summary();
+            if (subtitle->GetTotalLatency()->GetCount())
+                ss << " total " << subtitle->GetTotalLatency()->Summary();
+            ss << "\n";
+        }
+        subtitle->GetInputLatency()->Reset();
+        subtitle->GetHeaderLatency()->Reset();
+        subtitle->GetTotalLatency()->Reset();
+    }
+    std::cerr << ss.str();
+    
+    _worstLate = 0;
+    _minLead = INT64_MAX;
+    _outputReportFields = 0;
+}
+
+void Service::_packetOutput(vbit::Packet* pkt)
+{
+    _lineOutput(pkt->tx()); // encode the packet once for every sink
+}
+
+void Service::_lineOutput(std::array<uint8_t, PACKETSIZE>* p)
+{
+    bool open = false;
+    for (unsigned int i = 0; i < _sinks.size(); i++)
+    {
+        if (_sinks[i]->IsOpen())
+        {
+            _sinks[i]->AddPacket(p, _lineCounter, _fieldCounter);
+            open = true;
+        }
+    }
+    
+    if (!open)
+    {
+        std::cerr << "[Service::_lineOutput] No outputs left open" << std::endl;
+        exit(EXIT_FAILURE);
+    }
 }
@@ -5,7 +5,11 @@
 #include <iomanip>
 #include <thread>
 #include <ctime>
+#include <chrono>
+#include <csignal>
 #include <list>
+#include <vector>
+#include <string>
 
 #include "configure.h"
 #include "pagelist.h"
@@ -14,7 +18,14 @@
 #include <packetmag.h>
 #include <packet830.h>
 #include <packetsubtitle.h>
+#include <packetsubtitlefile.h>
 #include <packetDebug.h>
+#include "t42sink.h"
+#include "rawsink.h"
+#include "pessink.h"
+#include "vbisink.h"
+#include "ancsink.h"
+#include "cycleschedule.h"
 
 namespace ttx
 {
@@ -45,9 +56,13 @@ namespace ttx
             int run();
 
             /** Part of Newfor subtitles implementation
-             * \return The packet source handling the subtitles
+             * \return The packet sources handling the subtitle services, in the order they were configured,
+             * then the one playing the subtitle file if there is one
              */
-            vbit::PacketSubtitle* GetSubtitle(){return _subtitle;};
+            std::vector<vbit::PacketSubtitle*> GetSubtitles(){return _subtitles;};
+
+            /** Signal handler that asks for an output report at the start of the next field */
+            static void RequestReport(int signum);
 
         private:
             // Member variables that define the service
@@ -60,13 +75,102 @@ namespace ttx
             uint8_t _fieldCounter; // Which field? Used to time packet 8/30
             
             std::list<vbit::PacketSource*> _Sources; /// A list of packet sources
+            
+            /** Book keeping for the bandwidth share scheduler.
+             *  Sources are served in start-time fair queuing order so that each one gets
+             *  at least its configured rows per second whenever it has something to send.
+             */
+            struct SourceShare
+            {
+                vbit::PacketSource* source;
+                std::string name;
+                double share;    // guaranteed rows per second. 0 means the source is not share scheduled
+                double finish;   // virtual finish time of the last row from this source
+                uint32_t rows;   // rows sent since the last report
+            };
+            
+            std::vector<SourceShare> _shares;
+            bool _shareScheduler; // true when magazines are scheduled by share rather than priority
+            double _virtualTime; // virtual start time of the row most recently sent
+            uint32_t _reportFields; // fields counted since the last scheduler report
+            uint32_t _fillerRows; // filler rows sent since the last scheduler report
+            uint32_t _tuneFields; // fields counted since magazines were last tuned
+            
+            /** Output timing book keeping.
+             *  A field is late if it is generated after the time the master clock gives it.
+             *  Counting starts once the service is first ahead of the clock, and again after each resynchronisation.
+             */
+            uint32_t _outputReportFields; // fields counted since the last output report
+            bool _timingValid; // service has been ahead of the master clock since it was last set
+            uint64_t _lateFields;
+            uint64_t _skippedFields; // fields of air time lost when the master clock was resynchronised forwards
+            uint32_t _resyncs;
+            uint64_t _worstLate; // microseconds since the last output report
+            int64_t _minLead; // microseconds the service was ahead of the clock at the closest since the last output report
+            static volatile std::sig_atomic_t _reportRequested;
 
-            vbit::PacketSubtitle* _subtitle; // Newfor needs to know which packet source is doing subtitles
+            std::vector<vbit::PacketSubtitle*> _subtitles; // Newfor needs to know which packet source is doing subtitles
+            unsigned int _subtitleNext; // subtitle service that gets the first look when none is part way through a page
+            vbit::PacketSubtitle* _subtitleInPage; // subtitle service that has sent a header and not yet its rows
+            vbit::PacketSource* _heldMagazine; // magazine of _subtitleInPage, which mustn't send a header until the page is done
+            uint16_t _subtitleReserve; // lines per field held for subtitles, 0 for no limit
+            uint16_t _subtitleLines; // lines subtitles have had in this field
             
             vbit::PacketDebug* _debug; // Debug packet source
+            
+            vbit::CycleSchedule* _schedule; // nullptr unless cycle_schedule is on
+            bool _replaying; // lines of this field come from _schedule
 
             // Member functions
-            void _register(vbit::PacketSource *src); /// Register packet sources
+            void _register(vbit::PacketSource *src, std::string name, double share=0); /// Register packet sources
+            
+            /**
+             * @brief Pick the next source to send from in Share mode
+             * @return The ready source with the earliest virtual start time or nullptr if none are ready
+             */
+            vbit::PacketSource* _nextShare();
+            
+            /** @return the share book keeping for src or nullptr if it isn't registered */
+            SourceShare* _findShare(vbit::PacketSource *src);
+            
+            /**
+             * @brief Pick the subtitle service to send from
+             * A service that has started a page finishes it first. Otherwise the ready services take turns,
+             * so a subtitle waits for no more than one page from each of the other services.
+             * With subtitle_reserved_lines, subtitles get no more than the reserved lines in each field,
+             * and a page only starts if it fits in what is left of the reservation. A page bigger than the
+             * reservation starts straight away and goes out over as few fields as it can.
+             * @param spare true to offer a line that no other source wants. A page that fits in the rest of the field may start
+             * @return The subtitle service to send from, or nullptr if none are ready or the next page has to wait
+             */
+            vbit::PacketSubtitle* _nextSubtitle(bool spare=false);
+            
+            /** Count a row against the source it came from */
+            void _countRow(vbit::PacketSource *src);
+            
+            /**
+             * @brief Adjust magazine priorities, or shares, towards the configured cycle time target
+             * Compares the measured cycle time of each magazine with the target and moves its priority
+             * one step, or scales its share, in the direction that closes the gap.
+             */
+            void _tuneMagazines();
+            
+            /** Log achieved against target rows per second for each source on stderr */
+            void _reportShares();
+            
+            /** Log the measured cycle time of each magazine and its priority, or share, as tuning has left it on stderr */
+            void _reportMagazines();
+            
+            /** Log the magazines that missed page deadlines on stderr */
+            void _reportDeadlines();
+            
+            /** Compare the field being started with the master clock
+             * @param masterClock The second the field belongs to
+             */
+            void _checkFieldTiming(time_t masterClock);
+            
+            /** Log late fields, the write latency, stalls and dropped fields of each output, and the cues of each subtitle service on stderr */
+            void _reportOutput();
 
             /**
              * @brief Check if anything changed, and if so signal the event to the packet sources.
@@ -74,11 +178,13 @@ namespace ttx
              */
             void _updateEvents();
             
-            /* output a packet in the desired format */
+            /* output a packet to every sink */
             void _packetOutput(vbit::Packet* pkt);
             
-            /* queue up packets for outputting as a Packetised Elementary Stream */
-            std::vector<std::vector<uint8_t>> _PESBuffer;
+            /* output an encoded line to every sink */
+            void _lineOutput(std::array<uint8_t, PACKETSIZE>* p);
+            
+            std::vector<vbit::OutputSink*> _sinks; // every packet goes to all of these
     };
 }
 
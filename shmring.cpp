@@ -0,0 +1,109 @@
+/** ShmRing
+ */
+#include "shmring.h"
+
+#include <iostream>
+#include <sstream>
+#include <cerrno>
+#include <cstring>
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+using namespace vbit;
+
+ShmRing::ShmRing(std::string name, std::string format, uint32_t slotCount, uint32_t slotSize) :
+    _name(name),
+    _slotCount(slotCount),
+    _slotSize(slotSize),
+    _size(ShmRingFirstSlot() + slotCount * ShmRingSlotStride(slotSize)),
+    _header(nullptr),
+    _sequence(0),
+    _slot(nullptr),
+    _data(nullptr)
+{
+#ifndef WIN32
+    int fd = shm_open(_name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0 || ftruncate(fd, _size) < 0)
+    {
+        std::stringstream ss;
+        ss << "[ShmRing::ShmRing] " << _name << ": " << std::strerror(errno) << "\n";
+        std::cerr << ss.str();
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+
+    void* p = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps the object open
+    if (p == MAP_FAILED)
+    {
+        std::stringstream ss;
+        ss << "[ShmRing::ShmRing] " << _name << ": " << std::strerror(errno) << "\n";
+        std::cerr << ss.str();
+        return;
+    }
+
+    _header = (ShmRingHeader*)p;
+    
+    // readers of a previous run may still have the ring mapped so reset it in place rather than recreating it
+    _header->magic = 0;
+    for (uint32_t i = 0; i < _slotCount; i++)
+    {
+        _getSlot(i)->sequence.store(0, std::memory_order_relaxed);
+    }
+    
+    _header->version = SHMRING_VERSION;
+    _header->slotCount = _slotCount;
+    _header->slotSize = _slotSize;
+    std::memset(_header->format, 0, sizeof(_header->format));
+    std::strncpy(_header->format, format.c_str(), sizeof(_header->format) - 1);
+    _header->published.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _header->magic = SHMRING_MAGIC; // readers wait for this
+
+    _beginSlot();
+#else
+    std::cerr << "[ShmRing::ShmRing] shared memory output is not supported on Windows\n";
+#endif
+}
+
+ShmRing::~ShmRing()
+{
+#ifndef WIN32
+    if (_header)
+    {
+        munmap(_header, _size);
+        shm_unlink(_name.c_str());
+    }
+#endif
+}
+
+ShmRingSlot* ShmRing::_getSlot(uint64_t sequence)
+{
+    return (ShmRingSlot*)((uint8_t*)_header + ShmRingFirstSlot() + (sequence % _slotCount) * ShmRingSlotStride(_slotSize));
+}
+
+void ShmRing::_beginSlot()
+{
+    _sequence++;
+    _slot = _getSlot(_sequence);
+    _data = (uint8_t*)(_slot + 1);
+    _slot->sequence.store(0, std::memory_order_relaxed); // mark the slot as being written before touching the data
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void ShmRing::Publish(uint32_t length, uint64_t fieldCount)
+{
+    if (!_header)
+        return;
+
+    _slot->fieldCount = fieldCount;
+    _slot->length = length;
+    _slot->sequence.store(_sequence, std::memory_order_release);
+    _header->published.store(_sequence, std::memory_order_release);
+
+    _beginSlot();
+}
@@ -0,0 +1,107 @@
+#ifndef _SHMRING_H_
+#define _SHMRING_H_
+
+#include <cstdint>
+#include <atomic>
+#include <string>
+
+/**
+ * Shared memory ring of output fields.
+ * The shared memory object holds a ShmRingHeader followed by slotCount slots. Each slot is
+ * a ShmRingSlot followed by slotSize bytes of output in the format named in the header.
+ * Field n (counting from 1) goes in slot n % slotCount.
+ *
+ * The writer never waits for readers. While a slot is being filled its sequence is 0, and
+ * once the field is complete the sequence is set to the field's number and published is
+ * advanced to match. A reader that wants field n checks the slot's sequence is n, uses the
+ * data in place, then checks the sequence again. If it has changed the writer has lapped
+ * the reader and the data must be thrown away.
+ * If published goes backwards vbit2 has been restarted.
+ *
+ * This header describes the layout for readers as well as the writer.
+ */
+
+#define SHMRING_MAGIC 0x32544256 // "VBT2"
+#define SHMRING_VERSION 1
+#define SHMRING_ALIGN 64
+
+struct ShmRingHeader
+{
+    uint32_t magic; // SHMRING_MAGIC once the ring is ready
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t slotSize; // bytes of data in each slot
+    char format[16]; // output format of the data, e.g. "t42"
+    std::atomic<uint64_t> published; // number of the newest complete field
+};
+
+struct ShmRingSlot
+{
+    std::atomic<uint64_t> sequence; // field number in this slot, or 0 while it is being written
+    uint64_t fieldCount; // master clock field count of the field
+    uint32_t length; // bytes of data
+    uint32_t reserved;
+};
+
+/** Offset of the first slot from the start of the shared memory */
+inline size_t ShmRingFirstSlot()
+{
+    return (sizeof(ShmRingHeader) + SHMRING_ALIGN - 1) & ~(size_t)(SHMRING_ALIGN - 1);
+}
+
+/** Distance between slots for a given slotSize */
+inline size_t ShmRingSlotStride(uint32_t slotSize)
+{
+    return (sizeof(ShmRingSlot) + slotSize + SHMRING_ALIGN - 1) & ~(size_t)(SHMRING_ALIGN - 1);
+}
+
+namespace vbit
+{
+    /**
+     * Writer side of the shared memory ring.
+     */
+    class ShmRing
+    {
+        public:
+            /** Constructor
+             * Creates or replaces the POSIX shared memory object.
+             * @param name Shared memory object name, e.g. /vbit2
+             * @param format Output format name stored in the header for readers
+             * @param slotCount Number of fields in the ring
+             * @param slotSize Largest amount of data in one field
+             */
+            ShmRing(std::string name, std::string format, uint32_t slotCount, uint32_t slotSize);
+
+            /** Default destructor */
+            virtual ~ShmRing();
+
+            /** @return false if the shared memory couldn't be set up */
+            bool IsOpen(){return _header != nullptr;};
+
+            /** @return Where to write the data of the field being built */
+            uint8_t* GetData(){return _data;};
+
+            uint32_t GetSlotSize(){return _slotSize;};
+
+            /** Make the field being built visible to readers and start the next one
+             * @param length Bytes of data in the field
+             * @param fieldCount Master clock field count
+             */
+            void Publish(uint32_t length, uint64_t fieldCount);
+
+        private:
+            std::string _name;
+            uint32_t _slotCount;
+            uint32_t _slotSize;
+            size_t _size;
+            ShmRingHeader* _header;
+            uint64_t _sequence; // number of the field being built
+            ShmRingSlot* _slot; // slot of the field being built
+            uint8_t* _data; // data of the field being built
+
+            ShmRingSlot* _getSlot(uint64_t sequence);
+            void _beginSlot();
+    };
+}
+
+#endif // _SHMRING_H_
@@ -26,6 +26,8 @@ class SpecialPages
 
         void deletePage(TTXPageStream* p);
 
+        int GetPageCount(){ return _specialPagesList.size(); };
+
 
     protected:
 
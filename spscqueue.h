@@ -0,0 +1,87 @@
+#ifndef _SPSCQUEUE_H_
+#define _SPSCQUEUE_H_
+
+#include <cstdint>
+#include <atomic>
+#include <array>
+
+/**
+ * Bounded single producer, single consumer queue.
+ * Hands items from one thread to another without locks or allocation. The items live
+ * in the queue, so the producer fills a slot in place and the consumer reads it in place
+ * for as long as it needs before letting it go. Neither side ever waits for the other.
+ */
+
+namespace vbit
+{
+    template <typename T, uint32_t N>
+    class SpscQueue
+    {
+        static_assert(N > 0 && (N & (N - 1)) == 0, "SpscQueue length must be a power of two");
+
+        public:
+            SpscQueue() : _head(0), _tail(0) {};
+
+            /** Producer side. Get the next free slot to fill
+             * @return The slot, or nullptr if the queue is full
+             */
+            T* Claim()
+            {
+                uint32_t tail = _tail.load(std::memory_order_relaxed);
+                if (tail - _head.load(std::memory_order_acquire) >= N)
+                    return nullptr;
+                return &_items[tail % N];
+            };
+
+            /** Producer side. Make the slot from Claim visible to the consumer */
+            void Publish()
+            {
+                _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            };
+
+            /** Consumer side
+             * @return The oldest item, or nullptr if the queue is empty
+             */
+            T* Front()
+            {
+                uint32_t head = _head.load(std::memory_order_relaxed);
+                if (head == _tail.load(std::memory_order_acquire))
+                    return nullptr;
+                return &_items[head % N];
+            };
+
+            /** Consumer side
+             * @param index 0 for the oldest item, 1 for the one after it and so on
+             * @return The item, or nullptr if there are not that many waiting
+             */
+            T* At(uint32_t index)
+            {
+                uint32_t head = _head.load(std::memory_order_relaxed);
+                if (_tail.load(std::memory_order_acquire) - head <= index)
+                    return nullptr;
+                return &_items[(head + index) % N];
+            };
+
+            /** Consumer side. Give the oldest item's slot back to the producer */
+            void Pop()
+            {
+                _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            };
+
+            /** Consumer side
+             * @return Number of items waiting, including the one at the front
+             */
+            uint32_t Size()
+            {
+                return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_relaxed);
+            };
+
+        private:
+            std::array<T, N> _items;
+            std::atomic<uint32_t> _head; // next item for the consumer
+            char _padding[64]; // keep the two sides off each other's cache line without needing aligned new
+            std::atomic<uint32_t> _tail; // next slot for the producer
+    };
+}
+
+#endif // _SPSCQUEUE_H_
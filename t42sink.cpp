@@ -0,0 +1,38 @@
+/** T42Sink
+ */
+#include "t42sink.h"
+#include "coding.h"
+
+using namespace vbit;
+
+T42Sink::T42Sink(std::string destination, Backpressure policy, unsigned int bufferFields, uint16_t linesPerField, bool reverse) :
+    OutputSink("t42", destination, policy, bufferFields, linesPerField * 42),
+    _reverse(reverse)
+{
+
+}
+
+T42Sink::~T42Sink()
+{
+
+}
+
+void T42Sink::AddPacket(std::array<uint8_t, PACKETSIZE>* packet, uint16_t line, uint8_t field)
+{
+    (void)field;
+
+    if (line == 0)
+    {
+        if (_reverse)
+        {
+            // reverse the whole field in one pass rather than a packet at a time
+            unsigned int length;
+            uint8_t* p = _getField(&length);
+            if (p)
+                ReverseBits(p, p, length);
+        }
+        _endField();
+    }
+
+    _append(packet->data()+3, 42); // drop the clock run in and framing code
+}
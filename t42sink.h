@@ -0,0 +1,32 @@
+#ifndef _T42SINK_H_
+#define _T42SINK_H_
+
+#include "outputsink.h"
+
+/**
+ * Output sink for T42 teletext packets.
+ * 42 bytes per packet with optional bit reversal.
+ */
+
+namespace vbit
+{
+    class T42Sink : public OutputSink
+    {
+        public:
+            /** Constructor
+             * @param reverse Reverse the bits in every byte
+             * Other parameters as OutputSink
+             */
+            T42Sink(std::string destination, Backpressure policy, unsigned int bufferFields, uint16_t linesPerField, bool reverse);
+
+            /** Default destructor */
+            virtual ~T42Sink();
+
+            void AddPacket(std::array<uint8_t, PACKETSIZE>* packet, uint16_t line, uint8_t field) override;
+
+        private:
+            bool _reverse;
+    };
+}
+
+#endif // _T42SINK_H_
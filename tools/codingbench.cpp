@@ -0,0 +1,178 @@
+/** codingbench
+ * Checks every version of the parity, Hamming 8/4 and bit reversal loops in coding.cpp that this
+ * processor can run against the tables, then times them, e.g.
+ *     tools/codingbench
+ *     tools/codingbench 2
+ * The optional argument is the number of seconds to time each loop for, default 0.2. If any
+ * version gives a different result to the tables, what differs is reported on stderr, nothing is
+ * timed and the exit status is failure.
+ */
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#include "coding.h"
+#include "tables.h"
+
+using namespace vbit;
+
+/** Lengths that are checked: every tail after the vector loops, a row, and enough for every byte value */
+static const unsigned int MAX_CHECK_LENGTH=260;
+static const unsigned int MAX_CHECK_OFFSET=32; // start at each alignment of an AVX2 load
+
+/** Sizes that are timed: a row, a field of t42 lines and a field of PES data units */
+static const unsigned int BENCH_LENGTHS[]={40, 16*42, 32*46};
+
+static uint32_t seed=1;
+static uint8_t random8()
+{
+    seed=seed*1103515245+12345;
+    return seed>>16;
+}
+
+static bool fail(const CodingKernelSet* k, const char* what, unsigned int offset, unsigned int length, unsigned int i, uint8_t in, uint8_t got, uint8_t want)
+{
+    std::stringstream ss;
+    ss << "[codingbench] " << k->name << " " << what << " offset " << offset << " length " << length << " byte " << i << std::hex << std::setfill('0')
+       << ": 0x" << std::setw(2) << (int)in << " gave 0x" << std::setw(2) << (int)got << ", table gives 0x" << std::setw(2) << (int)want << "\n";
+    std::cerr << ss.str();
+    return false;
+}
+
+/** Run one version over every length and alignment, with random bytes and then every byte value */
+static bool check(const CodingKernelSet* k)
+{
+    std::vector<uint8_t> in(MAX_CHECK_OFFSET+MAX_CHECK_LENGTH+1);
+    std::vector<uint8_t> buf(in.size());
+    std::vector<uint8_t> out(in.size());
+    for (int pass=0; pass<2; pass++)
+    {
+        for (unsigned int offset=0; offset<MAX_CHECK_OFFSET; offset++)
+        {
+            for (unsigned int length=0; length<=MAX_CHECK_LENGTH; length++)
+            {
+                for (unsigned int i=0; i<in.size(); i++)
+                    in[i]=pass ? (i-offset)&0xff : random8();
+
+                // the bytes either side must not be touched
+                buf=in;
+                k->parity(buf.data()+offset, length);
+                for (unsigned int i=0; i<buf.size(); i++)
+                {
+                    uint8_t want=(i>=offset && i<offset+length) ? OddParityTable[in[i] & 0x7f] : in[i];
+                    if (buf[i]!=want)
+                        return fail(k, "parity", offset, length, i, in[i], buf[i], want);
+                }
+
+                buf=in;
+                k->hamming(buf.data()+offset, length);
+                for (unsigned int i=0; i<buf.size(); i++)
+                {
+                    uint8_t want=(i>=offset && i<offset+length) ? Hamming8EncodeTable[in[i] & 0x0f] : in[i];
+                    if (buf[i]!=want)
+                        return fail(k, "hamming", offset, length, i, in[i], buf[i], want);
+                }
+
+                // reversal from one buffer to another at different alignments, then in place
+                std::fill(out.begin(), out.end(), 0xaa);
+                k->reverse(out.data()+(MAX_CHECK_OFFSET-1-offset), in.data()+offset, length);
+                for (unsigned int i=0; i<length; i++)
+                {
+                    uint8_t got=out[MAX_CHECK_OFFSET-1-offset+i];
+                    if (got!=ReverseByteTab[in[offset+i]])
+                        return fail(k, "reverse", offset, length, i, in[offset+i], got, ReverseByteTab[in[offset+i]]);
+                }
+                if (out[MAX_CHECK_OFFSET-1-offset+length]!=0xaa)
+                    return fail(k, "reverse past the end", offset, length, length, 0xaa, out[MAX_CHECK_OFFSET-1-offset+length], 0xaa);
+
+                buf=in;
+                k->reverse(buf.data()+offset, buf.data()+offset, length);
+                for (unsigned int i=0; i<buf.size(); i++)
+                {
+                    uint8_t want=(i>=offset && i<offset+length) ? ReverseByteTab[in[i]] : in[i];
+                    if (buf[i]!=want)
+                        return fail(k, "reverse in place", offset, length, i, in[i], buf[i], want);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/** @return Nanoseconds per call of f, which is called for about the given time */
+template <typename F>
+static double bench(F f, double seconds)
+{
+    typedef std::chrono::steady_clock clock;
+    uint64_t calls=0;
+    uint64_t batch=64;
+    clock::time_point start=clock::now();
+    double elapsed;
+    do
+    {
+        for (uint64_t i=0; i<batch; i++)
+            f();
+        calls+=batch;
+        batch*=2;
+        elapsed=std::chrono::duration<double>(clock::now()-start).count();
+    } while (elapsed<seconds);
+    return elapsed*1e9/calls;
+}
+
+int main(int argc, char** argv)
+{
+    double seconds=0.2;
+    if (argc>2 || (argc==2 && (seconds=atof(argv[1]))<=0))
+    {
+        std::cerr << "usage: codingbench [seconds to time each loop]\n";
+        return EXIT_FAILURE;
+    }
+
+    const CodingKernelSet* sets=CodingKernelSets();
+    bool ok=true;
+    for (const CodingKernelSet* k=sets; k->name; k++)
+    {
+        bool same=check(k);
+        std::cout << std::left << std::setw(12) << k->name << (same ? "matches the tables" : "DOES NOT MATCH the tables") << "\n";
+        ok=ok && same;
+    }
+    std::cout << "vbit2 uses " << CodingKernels() << "\n";
+    if (!ok)
+        return EXIT_FAILURE;
+
+    std::cout << "\nns per call (MB/s)\n" << std::left << std::setw(12) << "" << std::setw(8) << "bytes";
+    std::cout << std::right << std::setw(20) << "parity" << std::setw(20) << "hamming" << std::setw(20) << "reverse" << "\n";
+    std::vector<uint8_t> src(BENCH_LENGTHS[sizeof(BENCH_LENGTHS)/sizeof(BENCH_LENGTHS[0])-1]);
+    std::vector<uint8_t> dest(src.size());
+    for (unsigned int i=0; i<src.size(); i++)
+        src[i]=random8();
+
+    for (const CodingKernelSet* k=sets; k->name; k++)
+    {
+        for (unsigned int length : BENCH_LENGTHS)
+        {
+            uint8_t* s=src.data();
+            uint8_t* d=dest.data();
+            double ns[3];
+            ns[0]=bench([k, s, length]{ k->parity(s, length); }, seconds);
+            ns[1]=bench([k, s, length]{ k->hamming(s, length); }, seconds);
+            ns[2]=bench([k, s, d, length]{ k->reverse(d, s, length); }, seconds);
+
+            std::cout << std::left << std::setw(12) << k->name << std::setw(8) << length << std::right << std::fixed;
+            for (int i=0; i<3; i++)
+            {
+                std::stringstream cell;
+                cell << std::fixed << std::setprecision(1) << ns[i] << " (" << std::setprecision(0) << length*1e3/ns[i] << ")";
+                std::cout << std::setw(20) << cell.str();
+            }
+            std::cout << "\n";
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,235 @@
+/** pesbench
+ * Checks the PES packets that PESSink assembles in place against PES packets built the way
+ * Service used to build them, with a vector for each line and a header vector for each field,
+ * then times both, e.g.
+ *     tools/pesbench
+ *     tools/pesbench 16 2
+ * The optional arguments are the lines per field, default 16, and the number of seconds to time
+ * each for, default 1. Both are fed the same random packets. If the outputs differ, the first
+ * difference is reported on stderr, nothing is timed and the exit status is failure.
+ */
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+
+#include "pessink.h"
+#include "tables.h"
+#include "vbit2.h"
+
+using namespace vbit;
+
+MasterClock *MasterClock::instance = 0; // PESSink takes the PTS from the field count
+
+static const unsigned int CHECK_FIELDS=500;
+static const unsigned int PACKET_FIELDS=64; // fields of different packets that are sent over and over
+
+/** Build the PES packet for one field the way Service did before PESSink
+ * @param out The packet is appended to this
+ * @param lines Data units of the field, 46 bytes each
+ * @param field Field count of the field
+ */
+static void referencePES(std::vector<uint8_t>& out, const std::vector<std::vector<uint8_t>>& lines, uint64_t field)
+{
+    std::array<uint8_t, 46> padding;
+    padding.fill(0xff);
+
+    std::vector<uint8_t> header = {0x00, 0x00, 0x01, 0xBD};
+
+    int numBlocks = lines.size() + 1; // header and N lines
+    int numTSPackets = ((numBlocks * 46) + 183) / 184; // round up
+    int packetLength = (numTSPackets * 184) - 6;
+
+    header.push_back(packetLength >> 8);
+    header.push_back(packetLength & 0xff);
+    header.push_back(0x85); // Align, Original
+    header.push_back(0x80); // PTS only
+    header.push_back(0x24); // PES header data length
+
+    uint64_t PTS = (field * 1800 + TS_PTS_DELAY) & 0x1FFFFFFFFULL;
+    header.push_back(0x21 | ((PTS >> 29) & 0x0E));
+    header.push_back((PTS & 0x3FC00000) >> 22);
+    header.push_back(0x01 | ((PTS & 0x3F8000) >> 14));
+    header.push_back((PTS & 0x7F80) >> 7);
+    header.push_back(0x01 | ((PTS & 0x7F) << 1));
+
+    header.resize(0x2D, 0xff); // make PES header up to 45 bytes long with stuffing bytes.
+    header.push_back(0x10); // PES data identifier (EBU data)
+
+    out.insert(out.end(), header.begin(), header.end());
+    for (unsigned int i = 0; i < lines.size(); i++)
+        out.insert(out.end(), lines[i].begin(), lines[i].end());
+    for (int i = numBlocks; i < numTSPackets * 4; i++)
+        out.insert(out.end(), padding.begin(), padding.end());
+}
+
+/** Make one line's data unit the way Service did before PESSink */
+static std::vector<uint8_t> referenceLine(std::array<uint8_t, PACKETSIZE>* packet, uint16_t line, uint8_t field)
+{
+    std::vector<uint8_t> data = {0x02, 0x2c}; // data_unit_id and data_unit_length (EBU teletext non-subtitle, 44 bytes)
+    if (line > 15)
+        data.push_back(((field&1)^1) << 5); //field parity, line number undefined
+    else
+        data.push_back((((field&1)^1) << 5) | (line + 7)); // field parity and line number
+    for (int i = 2; i < 45; i++)
+        data.push_back(ReverseByteTab[packet->at(i)]); // bits are reversed in PES stream
+    return data;
+}
+
+/** Send fields through a PESSink, stepping the master clock as Service does
+ * @return Nanoseconds per field
+ */
+static double runSink(PESSink* sink, std::vector<std::array<uint8_t, PACKETSIZE>>& packets, uint16_t linesPerField, unsigned int fields)
+{
+    MasterClock *mc = mc->Instance();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned int f = 0; f <= fields; f++)
+    {
+        mc->IncrementFieldCount();
+        for (uint16_t line = 0; line < linesPerField; line++)
+        {
+            sink->AddPacket(&packets[(f % PACKET_FIELDS) * linesPerField + line], line, f % 50);
+            if (f == fields)
+                break; // line 0 of the extra field sends the last one
+        }
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e9 / fields;
+}
+
+/** Build fields with the reference code into out
+ * @return Nanoseconds per field
+ */
+static double runReference(std::vector<uint8_t>& out, std::vector<std::array<uint8_t, PACKETSIZE>>& packets, uint16_t linesPerField, unsigned int fields, uint64_t firstField)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::vector<uint8_t>> lines;
+    for (unsigned int f = 0; f < fields; f++)
+    {
+        for (uint16_t line = 0; line < linesPerField; line++)
+            lines.push_back(referenceLine(&packets[(f % PACKET_FIELDS) * linesPerField + line], line, f % 50));
+        referencePES(out, lines, firstField + f);
+        lines.clear();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e9 / fields;
+}
+
+int main(int argc, char** argv)
+{
+    int linesPerField = 16;
+    double seconds = 1;
+    if (argc > 3 || (argc > 1 && ((linesPerField = atoi(argv[1])) < 1 || linesPerField > 32)) || (argc > 2 && (seconds = atof(argv[2])) <= 0))
+    {
+        std::cerr << "usage: pesbench [lines per field 1..32] [seconds to time each]\n";
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::array<uint8_t, PACKETSIZE>> packets(PACKET_FIELDS * linesPerField);
+    uint32_t seed = 1;
+    for (unsigned int i = 0; i < packets.size(); i++)
+    {
+        packets[i][0] = 0x55; // clock run in
+        packets[i][1] = 0x55;
+        packets[i][2] = 0x27; // framing code
+        for (int j = 3; j < PACKETSIZE; j++)
+        {
+            seed = seed * 1103515245 + 12345;
+            packets[i][j] = seed >> 16;
+        }
+    }
+
+    // the output of PESSink goes to a file, which is then read back
+    char path[] = "/tmp/pesbenchXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        perror("[pesbench] can't make a temporary file");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+
+    MasterClock *mc = mc->Instance();
+    uint64_t firstField = mc->GetFieldCount() + 1; // runSink steps the clock before the first field
+    PESSink* sink = new PESSink(path, OutputSink::Block, 1, linesPerField, false, 0, 0, 0);
+    runSink(sink, packets, linesPerField, CHECK_FIELDS);
+    delete sink;
+
+    std::vector<uint8_t> got;
+    FILE* f = fopen(path, "rb");
+    if (f)
+    {
+        uint8_t buffer[65536];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+            got.insert(got.end(), buffer, buffer + n);
+        fclose(f);
+    }
+    unlink(path);
+
+    std::vector<uint8_t> want;
+    runReference(want, packets, linesPerField, CHECK_FIELDS, firstField);
+
+    if (got != want)
+    {
+        size_t i = 0;
+        while (i < got.size() && i < want.size() && got[i] == want[i])
+            i++;
+        std::stringstream ss;
+        ss << "[pesbench] PESSink gave " << got.size() << " bytes, the reference " << want.size() << ". They differ at byte " << i;
+        if (i < got.size() && i < want.size())
+            ss << std::hex << std::setfill('0') << ": 0x" << std::setw(2) << (int)got[i] << " not 0x" << std::setw(2) << (int)want[i];
+        ss << "\n";
+        std::cerr << ss.str();
+        return EXIT_FAILURE;
+    }
+    std::cout << CHECK_FIELDS << " fields of " << linesPerField << " lines, " << got.size() << " bytes: PESSink output is byte-identical to the reference\n";
+
+    // timed, with PESSink writing to /dev/null once a field
+    unsigned int fields = 1000;
+    for (;;)
+    {
+        PESSink sink("/dev/null", OutputSink::Block, 1, linesPerField, false, 0, 0, 0);
+        double ns = runSink(&sink, packets, linesPerField, fields);
+        if (ns * fields >= seconds * 1e9)
+        {
+            std::cout << std::fixed << std::setprecision(0) << "PESSink                 " << std::setw(8) << ns << " ns per field\n";
+            break;
+        }
+        fields *= 4;
+    }
+
+    for (fields = 1000;; fields *= 4)
+    {
+        PESSink sink("/dev/null", OutputSink::Block, 1, linesPerField, true, 0x20, 1, 0);
+        double ns = runSink(&sink, packets, linesPerField, fields);
+        if (ns * fields >= seconds * 1e9)
+        {
+            std::cout << std::fixed << std::setprecision(0) << "PESSink in TS           " << std::setw(8) << ns << " ns per field\n";
+            break;
+        }
+    }
+
+    for (fields = 1000;; fields *= 4)
+    {
+        std::vector<uint8_t> out;
+        out.reserve(100 * (((linesPerField + 1) * 46 + 183) / 184) * 184);
+        double ns = 0;
+        for (unsigned int done = 0; done < fields; done += 100)
+        {
+            out.clear(); // start again every 100 fields so that the output doesn't grow
+            ns += runReference(out, packets, linesPerField, 100, 0) * 100;
+        }
+        ns /= fields;
+        if (ns * fields >= seconds * 1e9)
+        {
+            std::cout << std::fixed << std::setprecision(0) << "reference, not written  " << std::setw(8) << ns << " ns per field\n";
+            break;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,61 @@
+/** shmcat
+ * Example reader for the vbit2 shared memory ring output.
+ * Copies every field from the ring to stdout, e.g.
+ *     ./vbit2 --output t42:shm:/vbit2 &
+ *     tools/shmcat /vbit2 | raspi-teletext -
+ * Lost fields are reported on stderr.
+ */
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <csignal>
+
+#include "shmreader.h"
+
+int main(int argc, char** argv)
+{
+    if (argc != 2)
+    {
+        std::cerr << "usage: shmcat <shared memory name>\n";
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    ShmReader reader;
+    while (!reader.Open(argv[1]))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100)); // wait for vbit2 to start
+    }
+
+    std::stringstream ss;
+    ss << "[shmcat] reading " << reader.GetFormat() << " from " << argv[1] << "\n";
+    std::cerr << ss.str();
+
+    std::vector<uint8_t> field;
+    uint64_t lost = 0;
+    for (;;)
+    {
+        uint32_t length;
+        uint64_t sequence;
+        const uint8_t* data = reader.Next(&length, &sequence);
+
+        // take a copy so that nothing torn gets written out
+        field.assign(data, data + length);
+        if (!reader.Valid(sequence))
+            continue;
+
+        if (write(STDOUT_FILENO, field.data(), field.size()) < 0)
+            break;
+
+        if (reader.GetLost() != lost)
+        {
+            std::stringstream ss;
+            ss << "[shmcat] lost " << (reader.GetLost() - lost) << " fields\n";
+            std::cerr << ss.str();
+            lost = reader.GetLost();
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,141 @@
+#ifndef _SHMREADER_H_
+#define _SHMREADER_H_
+
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shmring.h"
+
+/**
+ * Reader for the vbit2 shared memory ring output (--output <format>:shm:<name>).
+ * Readers map the ring read only and never hold up vbit2. A reader that falls more
+ * than a ring's worth of fields behind skips forward and counts the fields it lost.
+ *
+ * Usage:
+ *     ShmReader reader;
+ *     if (reader.Open("/vbit2")) for (;;) {
+ *         uint32_t length; uint64_t sequence;
+ *         const uint8_t* data = reader.Next(&length, &sequence);
+ *         ... use the data in place ...
+ *         if (!reader.Valid(sequence)) ... the field was overwritten while it was in use ...
+ *     }
+ */
+
+class ShmReader
+{
+    public:
+        ShmReader() : _header(nullptr), _size(0), _next(0), _lost(0) {}
+
+        ~ShmReader()
+        {
+            if (_header)
+                munmap((void*)_header, _size);
+        }
+
+        /** Map the ring
+         * @param name Shared memory object name as given to vbit2
+         * @return false if vbit2 hasn't created the ring yet
+         */
+        bool Open(const char* name)
+        {
+            int fd = shm_open(name, O_RDONLY, 0);
+            if (fd < 0)
+                return false;
+
+            struct stat st;
+            if (fstat(fd, &st) < 0 || (size_t)st.st_size < ShmRingFirstSlot())
+            {
+                close(fd);
+                return false;
+            }
+            _size = st.st_size;
+
+            void* p = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (p == MAP_FAILED)
+                return false;
+            _header = (const ShmRingHeader*)p;
+
+            if (_header->magic != SHMRING_MAGIC || _header->version != SHMRING_VERSION ||
+                ShmRingFirstSlot() + _header->slotCount * ShmRingSlotStride(_header->slotSize) > _size)
+            {
+                munmap(p, _size);
+                _header = nullptr;
+                return false;
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return true;
+        }
+
+        /** @return Output format of the data, e.g. "t42" */
+        const char* GetFormat(){ return _header->format; }
+
+        /** @return Number of fields that were overwritten before they could be read */
+        uint64_t GetLost(){ return _lost; }
+
+        /** Wait for the next field
+         * @param length Receives the number of bytes of data
+         * @param sequence Receives the field's number, to pass to Valid()
+         * @return The field's data in shared memory
+         */
+        const uint8_t* Next(uint32_t* length, uint64_t* sequence)
+        {
+            for (;;)
+            {
+                uint64_t published = _header->published.load(std::memory_order_acquire);
+
+                if (_next == 0 || published + 1 < _next)
+                    _next = published ? published : 1; // start with the newest field, or vbit2 restarted
+
+                if (_next <= published)
+                {
+                    if (published - _next >= _header->slotCount - 1)
+                    {
+                        // too far behind, so skip to the newest field
+                        _lost += published - _next;
+                        _next = published;
+                    }
+
+                    const ShmRingSlot* slot = _slot(_next);
+                    if (slot->sequence.load(std::memory_order_acquire) == _next)
+                    {
+                        *length = slot->length;
+                        *sequence = _next++;
+                        return (const uint8_t*)(slot + 1);
+                    }
+                    _lost++; // overwritten already
+                    _next++;
+                    continue;
+                }
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        /** @return true if the data returned by Next() for sequence was not overwritten while it was in use */
+        bool Valid(uint64_t sequence)
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return _slot(sequence)->sequence.load(std::memory_order_relaxed) == sequence;
+        }
+
+    private:
+        const ShmRingHeader* _header;
+        size_t _size;
+        uint64_t _next; // number of the next field to read, 0 before the first
+        uint64_t _lost;
+
+        const ShmRingSlot* _slot(uint64_t sequence)
+        {
+            return (const ShmRingSlot*)((const uint8_t*)_header + ShmRingFirstSlot() + (sequence % _header->slotCount) * ShmRingSlotStride(_header->slotSize));
+        }
+};
+
+#endif // _SHMREADER_H_
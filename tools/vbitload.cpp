@@ -0,0 +1,664 @@
+/** vbitload
+ * Load generator and latency benchmark for the vbit2 command port.
+ * Runs Newfor subtitle clients and XPT620 command clients against a running vbit2, e.g.
+ *     ./vbit2 | tools/vbitload --newfor 8 --command 4 --rate 10 --count 200 --t42 -
+ * and reports how long vbit2 takes to answer each transaction and, when it can read the
+ * output, how long each subtitle takes to get on air.
+ *
+ * Every transaction is followed by a Y command. Its reply comes after the replies to
+ * everything before it, so the response time covers all the work the transaction asked for.
+ * Subtitles are found in the output by the text of their rows. Generated subtitles say
+ * which client sent them, so they are never mistaken for each other.
+ *
+ * A session is what a real client sent, one read per line as
+ *     <milliseconds from the start> <hex bytes>
+ * --capture records one: it passes a client through to vbit2 and writes down what it sent.
+ * --session replays it from every client, split back into whole messages.
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <csignal>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "shmreader.h"
+
+static const uint8_t HAMMING8[16] = {0x15, 0x02, 0x49, 0x5e, 0x64, 0x73, 0x38, 0x2f, 0xd0, 0xc7, 0x8c, 0x9b, 0xa1, 0xb6, 0xfd, 0xea};
+static uint8_t unhamming8[256];
+
+static const std::string PROBE = "Y\r";
+static const std::string PROBEREPLY = "VBIT620"; // the start of what Y answers
+
+/** One write to vbit2 and the replies that show it has been dealt with */
+struct Transaction
+{
+    uint64_t at; // us from the start of the session
+    std::string data; // whole messages
+    int replies; // Y replies it causes, counting the probe
+    bool newfor;
+    std::vector<std::string> onAir; // text of the rows of a subtitle that it puts on air
+};
+
+/** Latencies of one kind of thing, in us */
+struct Samples
+{
+    std::vector<uint64_t> values;
+
+    void Report(const std::string& name)
+    {
+        std::stringstream ss;
+        ss << "[vbitload] " << std::left << std::setw(16) << name << std::right << values.size();
+        if (!values.empty())
+        {
+            std::sort(values.begin(), values.end());
+            ss << " p50 " << _format(_percentile(0.5)) << " p90 " << _format(_percentile(0.9)) << " p99 " << _format(_percentile(0.99)) << " max " << _format(values.back());
+        }
+        std::cout << ss.str() << "\n";
+    }
+
+private:
+    uint64_t _percentile(double fraction)
+    {
+        size_t i = (size_t)(fraction * values.size() + 0.5);
+        return values[(i > 0) ? i - 1 : 0];
+    }
+
+    static std::string _format(uint64_t microseconds)
+    {
+        std::stringstream ss;
+        if (microseconds < 1000)
+            ss << microseconds << "us";
+        else if (microseconds < 1000000)
+            ss << std::fixed << std::setprecision(1) << microseconds / 1000.0 << "ms";
+        else
+            ss << std::fixed << std::setprecision(2) << microseconds / 1000000.0 << "s";
+        return ss.str();
+    }
+};
+
+/** Subtitles that have been sent and not yet seen in the output */
+class Tracker
+{
+    public:
+        Tracker() : _sent(0) {}
+
+        void Sent(const std::vector<std::string>& rows, uint64_t when)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _sent++;
+            // any row will do. The last one is the last to go out
+            if (!rows.empty())
+                _pending[rows.back()].push_back(when);
+        }
+
+        void Seen(const std::string& row, uint64_t when)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            std::map<std::string, std::deque<uint64_t> >::iterator it = _pending.find(row);
+            if (it == _pending.end())
+                return; // not one of ours, or a repeat
+            _onAir.values.push_back(when - it->second.front());
+            it->second.pop_front();
+            if (it->second.empty())
+                _pending.erase(it);
+        }
+
+        void Report()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _onAir.Report("on air");
+            std::cout << "[vbitload] subtitles sent " << _sent << ", not seen on air " << (_sent - _onAir.values.size()) << "\n";
+        }
+
+    private:
+        std::mutex _mutex;
+        std::map<std::string, std::deque<uint64_t> > _pending;
+        Samples _onAir;
+        uint64_t _sent;
+};
+
+static uint64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/** @return Row text the way it is compared with the output. Parity and trailing spaces don't count */
+static std::string rowKey(const char* text)
+{
+    std::string key(40, ' ');
+    for (int i = 0; i < 40; i++)
+    {
+        uint8_t ch = text[i] & 0x7f;
+        key[i] = (ch < 0x20) ? ' ' : ch; // control codes show as spaces
+    }
+    key.erase(key.find_last_not_of(' ') + 1);
+    return key;
+}
+
+/** @return Length of the message that starts at data[i] the way TCPClient reads it, or 0 if it isn't all there */
+static size_t messageLength(const std::string& data, size_t i)
+{
+    size_t left = data.size() - i;
+    switch ((uint8_t)data[i])
+    {
+        case 0x0e: // page init
+            return (left >= 5) ? 5 : 0;
+        case 0x0f: // subtitle data
+        {
+            if (left < 2)
+                return 0;
+            int rows = unhamming8[(uint8_t)data[i + 1]];
+            if (rows < 1 || rows > 7)
+                rows = 1; // TCPClient still reads a row
+            size_t length = 2 + rows * 42;
+            return (left >= length) ? length : 0;
+        }
+        case 0x10: // on air
+        case 0x18: // off air
+            return 1;
+        default: // a command, up to CR or LF
+        {
+            size_t end = data.find_first_of("\r\n", i);
+            return (end == std::string::npos) ? 0 : end - i + 1;
+        }
+    }
+}
+
+/** Turn reads into transactions of whole messages. A read that ends part way through a message is held back until the rest arrives */
+static std::vector<Transaction> transactions(const std::vector<std::pair<uint64_t, std::string> >& reads)
+{
+    std::vector<Transaction> result;
+    std::string data;
+    std::vector<std::string> rows; // of the last subtitle data
+    size_t used = 0;
+    for (unsigned int r = 0; r < reads.size(); r++)
+    {
+        data.append(reads[r].second);
+        Transaction t;
+        t.at = reads[r].first;
+        t.replies = 1;
+        t.newfor = false;
+        size_t length;
+        while (used < data.size() && (length = messageLength(data, used)) > 0)
+        {
+            uint8_t type = data[used];
+            if (type == 0x0e || type == 0x0f || type == 0x10 || type == 0x18)
+                t.newfor = true;
+            if (type == 0x0f)
+            {
+                rows.clear();
+                for (size_t row = used + 2; row + 42 <= used + length; row += 42)
+                {
+                    std::string key = rowKey(&data[row + 2]);
+                    if (!key.empty())
+                        rows.push_back(key);
+                }
+            }
+            if (type == 0x10)
+                t.onAir = rows;
+            if (type == 'Y')
+                t.replies++;
+            t.data.append(data, used, length);
+            used += length;
+        }
+        if (!t.data.empty())
+            result.push_back(t);
+    }
+    return result;
+}
+
+/** Generated traffic for one client */
+static std::vector<Transaction> generate(bool newfor, int client, int page, int rows, double rate, int count)
+{
+    std::vector<std::pair<uint64_t, std::string> > reads;
+    uint64_t period = (uint64_t)(1000000 / rate);
+    if (newfor)
+    {
+        std::string init = "\x0e";
+        init += (char)HAMMING8[0];
+        init += (char)HAMMING8[(page >> 8) & 0xf];
+        init += (char)HAMMING8[(page >> 4) & 0xf];
+        init += (char)HAMMING8[page & 0xf];
+        reads.push_back(std::make_pair(0, init));
+    }
+
+    // read only commands, so that the pages are the same at the end
+    const char* commands[] = {"Y\r", "P10000\r", "R01\r", "S\r"};
+    for (int n = 0; n < count; n++)
+    {
+        std::string data;
+        if (newfor)
+        {
+            data += '\x0f';
+            data += (char)HAMMING8[rows];
+            for (int r = 0; r < rows; r++)
+            {
+                int row = 24 - 2 * (rows - r); // double height rows at the bottom of the screen
+                std::stringstream ss;
+                ss << "vbitload " << client << " " << n << " row " << r;
+                std::string text = ss.str();
+                text.resize(40, ' ');
+                data += (char)HAMMING8[row >> 4];
+                data += (char)HAMMING8[row & 0xf];
+                data += text;
+            }
+            data += '\x10';
+        }
+        else
+        {
+            data = commands[n % 4];
+        }
+        reads.push_back(std::make_pair((uint64_t)(n + 1) * period, data));
+    }
+    return transactions(reads);
+}
+
+/** Read a captured session */
+static bool loadSession(const char* filename, double speed, std::vector<Transaction>* session)
+{
+    std::ifstream filein(filename);
+    if (!filein.is_open())
+        return false;
+    std::vector<std::pair<uint64_t, std::string> > reads;
+    std::string line;
+    while (std::getline(filein, line))
+    {
+        std::stringstream ss(line);
+        double ms;
+        std::string hex;
+        if (line.empty() || line[0] == '#' || !(ss >> ms >> hex) || hex.size() % 2)
+            continue;
+        std::string data;
+        for (size_t i = 0; i < hex.size(); i += 2)
+            data += (char)strtol(hex.substr(i, 2).c_str(), nullptr, 16);
+        reads.push_back(std::make_pair((uint64_t)(ms * 1000 / speed), data));
+    }
+    *session = transactions(reads);
+    return !session->empty();
+}
+
+static int connectTo(const std::string& host, int port)
+{
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+        return -1;
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0)
+        return -1;
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        close(sock);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct timeval timeout = {5, 0}; // a reply that takes longer than this is lost
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return sock;
+}
+
+/** What a client thread found */
+struct ClientResult
+{
+    ClientResult() : behind(0), failed(false) {}
+    Samples newfor;
+    Samples command;
+    int behind; // transactions sent late because the last reply took too long
+    bool failed;
+};
+
+static void runClient(std::string host, int port, std::vector<Transaction> session, Tracker* tracker, ClientResult* result)
+{
+    int sock = connectTo(host, port);
+    for (int tries = 0; sock < 0 && errno == ECONNREFUSED && tries < 50; tries++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100)); // give vbit2 time to start
+        sock = connectTo(host, port);
+    }
+    if (sock < 0)
+    {
+        std::stringstream ss;
+        ss << "[vbitload] can't connect to " << host << ":" << port << ": " << strerror(errno) << "\n";
+        std::cerr << ss.str();
+        result->failed = true;
+        return;
+    }
+
+    uint64_t start = now();
+    int expected = 0;
+    int seen = 0;
+    std::string tail; // end of the last read, in case it split a reply
+    for (unsigned int i = 0; i < session.size(); i++)
+    {
+        Transaction& t = session[i];
+        uint64_t due = start + t.at;
+        uint64_t sent = now();
+        if (sent < due)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(due - sent));
+            sent = now();
+        }
+        else if (sent > due + 20000)
+        {
+            result->behind++;
+        }
+
+        std::string data = t.data + PROBE;
+        if (send(sock, data.data(), data.size(), MSG_NOSIGNAL) != (ssize_t)data.size())
+        {
+            result->failed = true;
+            break;
+        }
+        if (!t.onAir.empty())
+            tracker->Sent(t.onAir, sent);
+
+        expected += t.replies;
+        while (seen < expected)
+        {
+            char buffer[4096];
+            ssize_t n = recv(sock, buffer, sizeof(buffer), 0);
+            if (n <= 0)
+                break;
+            tail.append(buffer, n);
+            for (size_t at = tail.find(PROBEREPLY); at != std::string::npos; at = tail.find(PROBEREPLY, at + 1))
+                seen++;
+            if (tail.size() >= PROBEREPLY.size())
+                tail.erase(0, tail.size() - PROBEREPLY.size() + 1); // keep what could be the start of a reply
+        }
+        if (seen < expected)
+        {
+            std::stringstream ss;
+            ss << "[vbitload] no reply from " << host << ":" << port << "\n";
+            std::cerr << ss.str();
+            result->failed = true;
+            break;
+        }
+        (t.newfor ? result->newfor : result->command).values.push_back(now() - sent);
+    }
+    close(sock);
+}
+
+/** Read t42 packets and find the subtitle rows in them */
+static void decodeT42(const uint8_t* data, size_t length, Tracker* tracker)
+{
+    uint64_t when = now();
+    for (size_t i = 0; i + 42 <= length; i += 42)
+    {
+        int row = unhamming8[data[i]] >> 3 | unhamming8[data[i + 1]] << 1;
+        if (unhamming8[data[i]] > 15 || unhamming8[data[i + 1]] > 15 || row < 1 || row > 24)
+            continue;
+        std::string key = rowKey((const char*)data + i + 2);
+        if (!key.empty())
+            tracker->Seen(key, when);
+    }
+}
+
+static void watchFile(std::string filename, Tracker* tracker, std::atomic<bool>* stop)
+{
+    int fd = (filename == "-") ? STDIN_FILENO : open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "[vbitload] can't open " << filename << "\n";
+        return;
+    }
+    std::vector<uint8_t> buffer(42 * 1024);
+    size_t have = 0;
+    while (!*stop)
+    {
+        ssize_t n = read(fd, buffer.data() + have, buffer.size() - have);
+        if (n <= 0)
+            break;
+        have += n;
+        size_t whole = have - have % 42;
+        decodeT42(buffer.data(), whole, tracker);
+        std::memmove(buffer.data(), buffer.data() + whole, have - whole);
+        have -= whole;
+    }
+}
+
+static void watchShm(std::string name, Tracker* tracker, std::atomic<bool>* stop)
+{
+    ShmReader reader;
+    while (!reader.Open(name.c_str()))
+    {
+        if (*stop)
+            return;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    if (std::strcmp(reader.GetFormat(), "t42") != 0)
+    {
+        std::cerr << "[vbitload] " << name << " has " << reader.GetFormat() << " in it, not t42\n";
+        return;
+    }
+    std::vector<uint8_t> field;
+    while (!*stop)
+    {
+        uint32_t length;
+        uint64_t sequence;
+        const uint8_t* data = reader.Next(&length, &sequence);
+        field.assign(data, data + length);
+        if (reader.Valid(sequence))
+            decodeT42(field.data(), field.size(), tracker);
+    }
+}
+
+/** Pass one client through to vbit2 and record what it sends */
+static int capture(int listenPort, const char* filename, const std::string& host, int port)
+{
+    std::ofstream fileout(filename);
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(listenPort);
+    if (!fileout.is_open() || server < 0 || bind(server, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(server, 1) < 0)
+    {
+        std::cerr << "[vbitload] can't capture: " << strerror(errno) << "\n";
+        return EXIT_FAILURE;
+    }
+    std::cerr << "[vbitload] waiting for a client on port " << listenPort << "\n";
+    int client = accept(server, nullptr, nullptr);
+    int upstream = connectTo(host, port);
+    if (client < 0 || upstream < 0)
+    {
+        std::cerr << "[vbitload] can't connect the client to " << host << ":" << port << "\n";
+        return EXIT_FAILURE;
+    }
+    struct timeval none = {0, 0};
+    setsockopt(upstream, SOL_SOCKET, SO_RCVTIMEO, &none, sizeof(none));
+
+    fileout << "# vbitload session: <milliseconds> <hex bytes the client sent>\n";
+    uint64_t start = now();
+    uint64_t bytes = 0;
+    struct pollfd fds[2] = {{client, POLLIN, 0}, {upstream, POLLIN, 0}};
+    for (;;)
+    {
+        if (poll(fds, 2, -1) < 0 && errno != EINTR)
+            break;
+        char buffer[4096];
+        if (fds[0].revents)
+        {
+            ssize_t n = recv(client, buffer, sizeof(buffer), 0);
+            if (n <= 0 || send(upstream, buffer, n, MSG_NOSIGNAL) != n)
+                break;
+            fileout << std::fixed << std::setprecision(1) << (now() - start) / 1000.0 << " ";
+            for (ssize_t i = 0; i < n; i++)
+                fileout << std::hex << std::setw(2) << std::setfill('0') << (int)(uint8_t)buffer[i];
+            fileout << std::dec << std::setfill(' ') << "\n";
+            bytes += n;
+        }
+        if (fds[1].revents)
+        {
+            ssize_t n = recv(upstream, buffer, sizeof(buffer), 0);
+            if (n <= 0 || send(client, buffer, n, MSG_NOSIGNAL) != n)
+                break;
+        }
+    }
+    std::cerr << "[vbitload] captured " << bytes << " bytes in " << (now() - start) / 1000000.0 << "s\n";
+    return EXIT_SUCCESS;
+}
+
+static void usage()
+{
+    std::cerr << "usage: vbitload [options]\n"
+        "  --host <address>        vbit2 address, default 127.0.0.1\n"
+        "  --port <port>[,<port>]  command ports that clients take in turn, default 5570\n"
+        "  --newfor <clients>      Newfor subtitle clients, default 1\n"
+        "  --command <clients>     XPT620 command clients, default 0\n"
+        "  --page <mpp>            subtitle page, default 888\n"
+        "  --rows <rows>           rows in each subtitle, 1 to 5, default 2\n"
+        "  --rate <per second>     transactions per second from each client, default 5\n"
+        "  --count <transactions>  transactions from each client, default 100\n"
+        "  --session <file>        every Newfor client replays a captured session instead\n"
+        "  --speed <factor>        replay the session faster, default 1\n"
+        "  --t42 <file>            find subtitles on air in t42 from a file or fifo, - for stdin\n"
+        "  --shm <name>            find subtitles on air in a t42 shared memory ring\n"
+        "  --drain <seconds>       time to wait for the last subtitles to go on air, default 2\n"
+        "  --capture <port> <file> record a session from one client passed through to vbit2\n";
+}
+
+int main(int argc, char** argv)
+{
+    for (int i = 0; i < 256; i++)
+        unhamming8[i] = 0xff;
+    for (int i = 0; i < 16; i++)
+        unhamming8[HAMMING8[i]] = i;
+
+    std::string host = "127.0.0.1";
+    std::vector<int> ports;
+    int newforClients = 1, commandClients = 0, page = 0x888, rows = 2, count = 100;
+    double rate = 5, speed = 1, drain = 2;
+    const char* sessionFile = nullptr;
+    const char* captureFile = nullptr;
+    int capturePort = 0;
+    std::string t42, shm;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool more = (i + 1 < argc);
+        if (arg == "--host" && more) host = argv[++i];
+        else if (arg == "--port" && more)
+        {
+            std::stringstream ss(argv[++i]);
+            std::string port;
+            while (std::getline(ss, port, ','))
+                ports.push_back(atoi(port.c_str()));
+        }
+        else if (arg == "--newfor" && more) newforClients = atoi(argv[++i]);
+        else if (arg == "--command" && more) commandClients = atoi(argv[++i]);
+        else if (arg == "--page" && more) page = strtol(argv[++i], nullptr, 16);
+        else if (arg == "--rows" && more) rows = atoi(argv[++i]);
+        else if (arg == "--rate" && more) rate = atof(argv[++i]);
+        else if (arg == "--count" && more) count = atoi(argv[++i]);
+        else if (arg == "--session" && more) sessionFile = argv[++i];
+        else if (arg == "--speed" && more) speed = atof(argv[++i]);
+        else if (arg == "--t42" && more) t42 = argv[++i];
+        else if (arg == "--shm" && more) shm = argv[++i];
+        else if (arg == "--drain" && more) drain = atof(argv[++i]);
+        else if (arg == "--capture" && i + 2 < argc)
+        {
+            capturePort = atoi(argv[++i]);
+            captureFile = argv[++i];
+        }
+        else
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (ports.empty())
+        ports.push_back(5570);
+    if (rows < 1 || rows > 5 || rate <= 0 || speed <= 0 || page < 0x100 || page > 0x8ff)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if (captureFile)
+        return capture(capturePort, captureFile, host, ports[0]);
+
+    std::vector<Transaction> session;
+    if (sessionFile && !loadSession(sessionFile, speed, &session))
+    {
+        std::cerr << "[vbitload] no session in " << sessionFile << "\n";
+        return EXIT_FAILURE;
+    }
+
+    // the watcher may still be using these when main returns
+    Tracker* tracker = new Tracker();
+    std::atomic<bool>* stop = new std::atomic<bool>(false);
+    std::thread watcher;
+    if (!t42.empty())
+        watcher = std::thread(watchFile, t42, tracker, stop);
+    else if (!shm.empty())
+        watcher = std::thread(watchShm, shm, tracker, stop);
+
+    int clients = newforClients + commandClients;
+    std::vector<ClientResult> results(clients);
+    std::vector<std::thread> threads;
+    uint64_t start = now();
+    for (int c = 0; c < clients; c++)
+    {
+        bool newfor = (c < newforClients);
+        std::vector<Transaction> traffic = (newfor && sessionFile) ? session : generate(newfor, c, page, rows, rate, count);
+        threads.push_back(std::thread(runClient, host, ports[c % ports.size()], traffic, tracker, &results[c]));
+    }
+    for (unsigned int c = 0; c < threads.size(); c++)
+        threads[c].join();
+    double seconds = (now() - start) / 1000000.0;
+
+    if (watcher.joinable())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds((int)(drain * 1000)));
+        *stop = true;
+        watcher.detach(); // it may be waiting for output that isn't coming
+    }
+
+    ClientResult total;
+    int failed = 0;
+    for (int c = 0; c < clients; c++)
+    {
+        total.newfor.values.insert(total.newfor.values.end(), results[c].newfor.values.begin(), results[c].newfor.values.end());
+        total.command.values.insert(total.command.values.end(), results[c].command.values.begin(), results[c].command.values.end());
+        total.behind += results[c].behind;
+        failed += results[c].failed;
+    }
+
+    std::cout << "[vbitload] " << clients << " clients for " << std::fixed << std::setprecision(2) << seconds << "s, "
+        << (total.newfor.values.size() + total.command.values.size()) / seconds << " transactions a second, "
+        << total.behind << " sent late, " << failed << " clients failed\n";
+    total.newfor.Report("newfor reply");
+    total.command.Report("command reply");
+    if (!t42.empty() || !shm.empty())
+        tracker->Report();
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,136 @@
+/** TSWriter
+ */
+#include "tswriter.h"
+
+#include <cstring>
+#include <cassert>
+
+using namespace vbit;
+
+TSWriter::TSWriter(uint16_t pid, unsigned int maxPESLength, uint8_t mag, uint8_t page) :
+    _pid(pid),
+    _continuity(0),
+    _patContinuity(0),
+    _pmtContinuity(0),
+    _psiCount(0), // start with a PAT and PMT
+    _maxPESLength(maxPESLength)
+{
+    const uint8_t pat[] = {
+        0x00, // table_id
+        0xB0, 13, // section_syntax_indicator, section_length
+        0x00, 0x01, // transport_stream_id
+        0xC1, // version 0, current_next_indicator
+        0x00, 0x00, // section_number, last_section_number
+        TS_PROGRAM_NUMBER >> 8, TS_PROGRAM_NUMBER & 0xFF,
+        0xE0 | (TS_PMT_PID >> 8), TS_PMT_PID & 0xFF
+    };
+    _makeSection(_pat, 0x0000, pat, sizeof(pat));
+
+    const uint8_t pmt[] = {
+        0x02, // table_id
+        0xB0, 25, // section_syntax_indicator, section_length
+        TS_PROGRAM_NUMBER >> 8, TS_PROGRAM_NUMBER & 0xFF,
+        0xC1, // version 0, current_next_indicator
+        0x00, 0x00, // section_number, last_section_number
+        (uint8_t)(0xE0 | (pid >> 8)), (uint8_t)(pid & 0xFF), // PCR_PID
+        0xF0, 0x00, // no program_info
+        0x06, // stream_type private PES
+        (uint8_t)(0xE0 | (pid >> 8)), (uint8_t)(pid & 0xFF), // elementary_PID
+        0xF0, 7, // ES_info_length
+        0x56, 5, // teletext_descriptor
+        'u', 'n', 'd', // ISO_639_language_code
+        (uint8_t)((0x01 << 3) | (mag & 0x7)), page // initial teletext page
+    };
+    _makeSection(_pmt, TS_PMT_PID, pmt, sizeof(pmt));
+}
+
+TSWriter::~TSWriter()
+{
+
+}
+
+unsigned int TSWriter::WriteField(const uint8_t* pes, unsigned int length, uint64_t pcrBase, uint8_t* out)
+{
+    assert(length % 184 == 0 && length <= _maxPESLength);
+
+    uint8_t* p = out;
+
+    if (_psiCount == 0)
+    {
+        std::memcpy(p, _pat.data(), TSPACKETSIZE);
+        p[3] |= _patContinuity;
+        _patContinuity = (_patContinuity + 1) & 0xF;
+        p += TSPACKETSIZE;
+
+        std::memcpy(p, _pmt.data(), TSPACKETSIZE);
+        p[3] |= _pmtContinuity;
+        _pmtContinuity = (_pmtContinuity + 1) & 0xF;
+        p += TSPACKETSIZE;
+
+        _psiCount = TS_PSI_INTERVAL;
+    }
+    _psiCount--;
+
+    // adaptation field only packet carrying the PCR. The continuity counter doesn't increment without a payload
+    pcrBase &= 0x1FFFFFFFFULL;
+    p[0] = 0x47;
+    p[1] = _pid >> 8;
+    p[2] = _pid & 0xFF;
+    p[3] = 0x20 | ((_continuity - 1) & 0xF);
+    p[4] = 183; // adaptation_field_length
+    p[5] = 0x10; // PCR_flag
+    p[6] = pcrBase >> 25;
+    p[7] = pcrBase >> 17;
+    p[8] = pcrBase >> 9;
+    p[9] = pcrBase >> 1;
+    p[10] = ((pcrBase & 1) << 7) | 0x7E; // reserved bits and top bit of the zero extension
+    p[11] = 0x00;
+    std::memset(p + 12, 0xFF, TSPACKETSIZE - 12);
+    p += TSPACKETSIZE;
+
+    // the PES packet is padded to fill whole transport stream packets
+    for (unsigned int offset = 0; offset < length; offset += 184)
+    {
+        p[0] = 0x47;
+        p[1] = (offset == 0 ? 0x40 : 0x00) | (_pid >> 8); // payload_unit_start_indicator on the first packet
+        p[2] = _pid & 0xFF;
+        p[3] = 0x10 | _continuity;
+        _continuity = (_continuity + 1) & 0xF;
+        std::memcpy(p + 4, pes + offset, 184);
+        p += TSPACKETSIZE;
+    }
+
+    return p - out;
+}
+
+void TSWriter::_makeSection(std::array<uint8_t, TSPACKETSIZE> &packet, uint16_t pid, const uint8_t* section, unsigned int length)
+{
+    packet.fill(0xFF);
+    packet[0] = 0x47;
+    packet[1] = 0x40 | (pid >> 8); // payload_unit_start_indicator
+    packet[2] = pid & 0xFF;
+    packet[3] = 0x10; // payload only. continuity counter is added when the packet is sent
+    packet[4] = 0x00; // pointer_field
+    std::memcpy(packet.data() + 5, section, length);
+
+    uint32_t crc = _crc32(section, length);
+    packet[5 + length] = crc >> 24;
+    packet[6 + length] = crc >> 16;
+    packet[7 + length] = crc >> 8;
+    packet[8 + length] = crc;
+}
+
+uint32_t TSWriter::_crc32(const uint8_t* data, unsigned int length)
+{
+    // CRC-32/MPEG-2 as used by PSI sections
+    uint32_t crc = 0xFFFFFFFF;
+    for (unsigned int i = 0; i < length; i++)
+    {
+        crc ^= (uint32_t)data[i] << 24;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+    return crc;
+}
@@ -0,0 +1,72 @@
+#ifndef _TSWRITER_H_
+#define _TSWRITER_H_
+
+#include <cstdint>
+#include <iostream>
+#include <array>
+
+/**
+ * MPEG-2 transport stream writer.
+ * Wraps the teletext PES packet for each field in 188 byte transport stream packets
+ * on a single PID, along with a PAT, a PMT carrying a teletext descriptor, and a PCR.
+ * Nothing is allocated per field.
+ */
+
+#define TSPACKETSIZE 188
+#define TS_PMT_PID 0x1000
+#define TS_PROGRAM_NUMBER 1
+#define TS_PSI_INTERVAL 5 // fields between each PAT/PMT
+#define TS_PTS_DELAY 9000 // 100ms of 90kHz clock between the PCR and the PTS of a field
+
+namespace vbit
+{
+    class TSWriter
+    {
+        public:
+            /** Constructor
+             * @param pid PID for the teletext elementary stream. Also carries the PCR
+             * @param maxPESLength Largest PES packet that will be written
+             * @param mag Initial teletext magazine for the teletext descriptor 0..7 where 0 is magazine 8
+             * @param page Initial teletext page for the teletext descriptor 00..ff
+             */
+            TSWriter(uint16_t pid, unsigned int maxPESLength, uint8_t mag, uint8_t page);
+
+            /** Default destructor */
+            virtual ~TSWriter();
+
+            /** Make one field of transport stream
+             * @param pes The PES packet for the field
+             * @param length Length of the PES packet. Must be a multiple of 184 bytes
+             * @param pcrBase Program clock reference base (90kHz) for the start of the field
+             * @param out Where to put the transport stream packets. Must have room for GetMaxFieldLength() bytes
+             * @return Number of bytes written to out
+             */
+            unsigned int WriteField(const uint8_t* pes, unsigned int length, uint64_t pcrBase, uint8_t* out);
+
+            /** @return The most transport stream that WriteField can make for one field */
+            unsigned int GetMaxFieldLength(){ return (3 + _maxPESLength / 184) * TSPACKETSIZE; }; // PAT, PMT, PCR and the PES packet
+
+        private:
+            uint16_t _pid;
+            uint8_t _continuity; // continuity counter of the teletext PID
+            uint8_t _patContinuity;
+            uint8_t _pmtContinuity;
+            unsigned int _psiCount; // fields until the next PAT/PMT
+
+            std::array<uint8_t, TSPACKETSIZE> _pat; // complete PAT packet apart from the continuity counter
+            std::array<uint8_t, TSPACKETSIZE> _pmt; // complete PMT packet apart from the continuity counter
+            unsigned int _maxPESLength;
+
+            /** Fill in a packet holding a PSI section and its CRC
+             * @param packet The packet to fill in
+             * @param pid PID of the section
+             * @param section Section from the table_id up to but not including the CRC
+             * @param length Length of the section
+             */
+            void _makeSection(std::array<uint8_t, TSPACKETSIZE> &packet, uint16_t pid, const uint8_t* section, unsigned int length);
+
+            uint32_t _crc32(const uint8_t* data, unsigned int length);
+    };
+}
+
+#endif // _TSWRITER_H_
@@ -25,10 +25,15 @@
 
 #include "ttxline.h"
 
+std::atomic<unsigned int> TTXLine::_nextGeneration(0);
 
 TTXLine::TTXLine(std::string const& line, bool validateLine):
     m_textline(validate(line)),
-    _nextLine(nullptr)
+    _nextLine(nullptr),
+    _encodedFor(-1),
+    _encodedCoding(0),
+    _encodedGeneration(0),
+    _generation(++_nextGeneration)
 
 {
     if (!validateLine)
@@ -36,7 +41,11 @@ TTXLine::TTXLine(std::string const& line, bool validateLine):
 }
 
 TTXLine::TTXLine():m_textline("                                        "),
-    _nextLine(nullptr)
+    _nextLine(nullptr),
+    _encodedFor(-1),
+    _encodedCoding(0),
+    _encodedGeneration(0),
+    _generation(++_nextGeneration)
 {
 }
 
@@ -46,12 +55,21 @@ TTXLine::~TTXLine()
         delete _nextLine;
 }
 
+TTXLine& TTXLine::operator=(const TTXLine& other)
+{
+    m_textline = other.m_textline;
+    _nextLine = other._nextLine;
+    _generation = ++_nextGeneration; // line must be encoded again
+    return *this;
+}
+
 void TTXLine::Setm_textline(std::string const& val, bool validateLine)
 {
     if (validateLine)
         m_textline = validate(val);
     else
         m_textline = val;
+    _generation = ++_nextGeneration; // line must be encoded again
 }
 
 std::string TTXLine::validate(std::string const& val)
@@ -103,6 +121,7 @@ char TTXLine::SetCharAt(int x,int code)
     char c=m_textline[x];
     code=code & 0x7f;
     m_textline[x]=code;
+    _generation = ++_nextGeneration; // line must be encoded again
     return c;
 }
 
@@ -138,3 +157,22 @@ void TTXLine::AppendLine(std::string  const& line)
     for (p=this;p->_nextLine;p=p->_nextLine);
     p->_nextLine=new TTXLine(line,true);
 }
+
+bool TTXLine::GetEncoded(int coding, uint8_t* data, int* encodedCoding)
+{
+    if (_encodedFor != coding || _encodedGeneration != _generation)
+        return false;
+    std::copy(_encoded.begin(), _encoded.end(), data);
+    *encodedCoding = _encodedCoding;
+    return true;
+}
+
+void TTXLine::SetEncoded(unsigned int generation, int coding, const uint8_t* data, int encodedCoding)
+{
+    if (generation != _generation)
+        return; // the line changed while it was being encoded
+    std::copy(data, data + 40, _encoded.begin());
+    _encodedCoding = encodedCoding;
+    _encodedFor = coding;
+    _encodedGeneration = generation;
+}
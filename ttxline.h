@@ -3,6 +3,9 @@
 #include <iostream>
 #include <iomanip>
 #include <string>
+#include <array>
+#include <cstdint>
+#include <atomic>
 
 /** TTXLine - a single line of teletext
  *  The line is always stored in 40 bytes in transmission ready format
@@ -19,6 +22,9 @@ class TTXLine
         /** Default destructor */
         virtual ~TTXLine();
 
+        /** Copy the text of another line. The encoding cache is not copied */
+        TTXLine& operator=(const TTXLine& other);
+
         /** Set the teletext line contents
          * \param val - New value to set
          * \param validateLine - If true, it ensures the line is checked and modified if needed to be transmission ready.
@@ -56,12 +62,47 @@ class TTXLine
 
         TTXLine* GetNextLine(){return _nextLine;}
 
+        /** Get the cached transmission encoding of this line
+         *  Packet::SetRow fills the cache the first time the line goes out so that
+         *  the line only has to be encoded again after it changes.
+         *  Only the service thread uses the cache. Other threads may change the line at
+         *  any time, which moves on its generation and so makes the cache out of date.
+         * \param coding - The coding the line is being sent with
+         * \param data - 40 bytes to receive the encoded line
+         * \param encodedCoding - Receives the coding that was actually applied
+         * \return true if the cache was valid for this coding
+         */
+        bool GetEncoded(int coding, uint8_t* data, int* encodedCoding);
+
+        /** Get the generation of the line, which changes every time the line is changed.
+         *  Generations are never reused, even by another line, so a line that replaces
+         *  another one can't be mistaken for it.
+         *  Read it before reading the line to encode it.
+         */
+        unsigned int GetGeneration(){return _generation;}
+
+        /** Fill the transmission encoding cache
+         * \param generation - GetGeneration() from before the line was read. If the line
+         *  has changed since then the encoding is already out of date and is not kept
+         * \param coding - The coding the line was sent with
+         * \param data - 40 encoded bytes
+         * \param encodedCoding - The coding that was actually applied
+         */
+        void SetEncoded(unsigned int generation, int coding, const uint8_t* data, int encodedCoding);
+
     protected:
     private:
         std::string validate(std::string const& test);
 
         std::string m_textline;
         TTXLine* _nextLine;
+
+        std::array<uint8_t, 40> _encoded; // m_textline encoded for transmission
+        int _encodedFor; // coding that _encoded was made for, or -1 if there is none
+        int _encodedCoding;
+        unsigned int _encodedGeneration; // generation of m_textline that _encoded was made from
+        std::atomic<unsigned int> _generation; // moved on by every change to m_textline
+        static std::atomic<unsigned int> _nextGeneration; // shared by every line
 };
 
 #endif // TTXLINE_H
@@ -23,6 +23,8 @@
  * this software.
  *************************************************************************** **/
  #include "ttxpage.h"
+ #include "tables.h"
+ #include "coding.h"
 
 
 bool TTXPage::pageChanged=false;
@@ -289,6 +291,62 @@ bool TTXPage::m_LoadTTI(std::string filename)
 }
 
 
+/** Put the control codes in a row back the way a tti file has them */
+static std::string escapeTTI(std::string const& text)
+{
+    std::string result;
+    for (unsigned int i=0;i<text.length();i++)
+    {
+        char ch=text[i] & 0x7f;
+        if (ch<0x20)
+        {
+            result+=0x1b; // ascii escape, as validate reads it
+            ch|=0x40;
+        }
+        result+=ch;
+    }
+    return result;
+}
+
+std::string TTXPage::GetTTI()
+{
+    std::stringstream ss;
+    ss << "DE," << m_description << "\n";
+    ss << "DS," << m_destination << "\n";
+    ss << "SP," << m_sourcepage << "\n";
+    ss << "CT," << m_cycletimeseconds << "," << m_cycletimetype << "\n";
+    for (TTXPage* p=this;p!=nullptr;p=p->m_SubPage)
+    {
+        ss << std::uppercase << std::hex << "PN," << (p->m_PageNumber >> 8) << std::dec << std::setw(2) << std::setfill('0') << (p->m_PageNumber & 0xff) << "\n";
+        ss << "SC," << std::hex << std::setw(4) << p->m_subcode << "\n";
+        ss << "PS," << std::setw(4) << p->m_pagestatus << "\n";
+        if (p->m_region)
+            ss << "RE," << p->m_region << "\n";
+        if (p->m_pagefunction!=LOP || p->m_pagecoding!=CODING_7BIT_TEXT)
+            ss << "PF," << (int)p->m_pagefunction << "," << (int)p->m_pagecoding << "\n";
+        ss << std::dec;
+        for (int row=0;row<=MAXROW;row++)
+        {
+            for (TTXLine* line=p->m_pLine[row];line!=nullptr;line=line->GetNextLine()) // enhancement rows can have several packets
+            {
+                std::string text=line->GetLine();
+                if (row<26)
+                {
+                    if (line->IsBlank())
+                        continue;
+                    text.erase(text.find_last_not_of(' ')+1); // validate pads it out again
+                }
+                // row 29 is kept as it was read
+                ss << "OL," << row << "," << ((row<MAXROW) ? escapeTTI(text) : text) << "\n";
+            }
+        }
+        ss << std::hex << "FL";
+        for (int i=0;i<6;i++)
+            ss << "," << p->m_fastextlinks[i];
+        ss << std::dec << "\n";
+    }
+    return ss.str();
+}
 
 TTXPage::TTXPage(const TTXPage& other)
 {
@@ -398,6 +456,35 @@ void TTXPage::SetRow(unsigned int rownumber, std::string line)
             m_pLine[rownumber]->AppendLine(line);
         }
     }
+
+    if (rownumber >= 26)
+    {
+        TTXLine* txLine;
+        for (txLine=m_pLine[rownumber];txLine->GetNextLine();txLine=txLine->GetNextLine()); // the line just added is at the end
+        m_EncodeEnhancementRow(rownumber, txLine);
+    }
+}
+
+void TTXPage::m_EncodeEnhancementRow(unsigned int rownumber, TTXLine* txLine)
+{
+    unsigned int generation=txLine->GetGeneration(); // before the line is read
+    std::string text=txLine->GetLine();
+    text.resize(40, ' '); // rows are often saved without their trailing triplets, which read as spaces
+    uint8_t data[40];
+    std::copy(text.begin(), text.end(), data);
+
+    // same choice of coding as PacketMag
+    PageCoding coding=CODING_13_TRIPLETS;
+    if (rownumber == 27 && (data[0] & 0xF) < 4)
+        coding=CODING_HAMMING_8_4; // navigation packets
+
+    data[0]=Hamming8EncodeTable[data[0] & 0x0F]; // designation code
+    if (coding == CODING_HAMMING_8_4)
+        vbit::Hamming84Encode(data+1, 39);
+    else
+        vbit::Hamming2418EncodeTriplets(data+1, 13);
+
+    txLine->SetEncoded(generation, coding, data, coding);
 }
 
 int TTXPage::GetPageCount()
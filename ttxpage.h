@@ -107,6 +107,11 @@ class TTXPage
          */
         int GetPageCount();
 
+        /** Write the page and its subpages out the way m_LoadTTI reads them
+         * \return The contents of a tti file
+         */
+         std::string GetTTI();
+
         /** Get a row of text
          * \return The TTXLine object of the required row. Check result for NULL if there isn't an actual row.
          */
@@ -230,6 +235,12 @@ class TTXPage
         // Private functions
         void m_Init();
 
+        /** Encode an enhancement row ready for transmission so that PacketMag only has to copy it
+         * \param rownumber - Row 26 to 29
+         * \param txLine - The TTXLine that holds it
+         */
+        void m_EncodeEnhancementRow(unsigned int rownumber, TTXLine* txLine);
+
 };
 
 #endif // TTXPAGE_H
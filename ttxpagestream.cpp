@@ -10,7 +10,8 @@ TTXPageStream::TTXPageStream() :
     _isSpecial(false),
     _isNormal(false),
     _isUpdated(false),
-    _updateCount(0)
+    _updateCount(0),
+    _lastTxField(0)
 {
     //ctor
 }
@@ -25,7 +26,8 @@ TTXPageStream::TTXPageStream(std::string filename) :
     _isSpecial(false),
     _isNormal(false),
     _isUpdated(false),
-    _updateCount(0)
+    _updateCount(0),
+    _lastTxField(0)
 {
     struct stat attrib;               // create a file attribute structure
     stat(filename.c_str(), &attrib);  // get the attributes of the file
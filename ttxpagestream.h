@@ -50,6 +50,10 @@ class TTXPageStream : public TTXPage
         
         int GetUpdateCount() {return _updateCount;}
         void IncrementUpdateCount();
+        
+        /** The field count when the header of this page was last transmitted. 0 if never sent */
+        uint64_t GetLastTxField() { return _lastTxField; }
+        void SetLastTxField(uint64_t field) { _lastTxField = field; }
 
         /** Is the page a carousel?
          *  Don't confuse this with the _isCarousel flag which is used to mark when a page changes between single/carousel
@@ -139,6 +143,8 @@ class TTXPageStream : public TTXPage
         bool _isUpdated;
 
         int _updateCount; // update counter for special pages.
+        
+        uint64_t _lastTxField; // used by deadline scheduling
 };
 
 #endif // _TTXPAGESTREAM_H_
@@ -0,0 +1,138 @@
+/** VBISink
+ */
+#include "vbisink.h"
+
+#include <cmath>
+#include <cstring>
+
+using namespace vbit;
+
+/** Raised cosine pulse
+ * @param x Time from the centre of the bit in bit periods
+ * @return Amplitude, 1 at the centre and 0 at the centre of every other bit
+ */
+static double raisedCosine(double x)
+{
+    if (x == 0)
+        return 1.0;
+    double sinc = std::sin(M_PI * x) / (M_PI * x);
+    double d = 2.0 * VBI_ROLL_OFF * x;
+    if (std::fabs(std::fabs(d) - 1.0) < 1e-9)
+        return M_PI / 4.0 * std::sin(M_PI / (2.0 * VBI_ROLL_OFF)) / (M_PI / (2.0 * VBI_ROLL_OFF));
+    return sinc * std::cos(M_PI * VBI_ROLL_OFF * x) / (1.0 - d * d);
+}
+
+VBISink::VBISink(std::string destination, Backpressure policy, unsigned int bufferFields, uint16_t linesPerField, unsigned int sampleRate, unsigned int sampleBits) :
+    OutputSink("vbi", destination, policy, bufferFields, linesPerField * SamplesPerLine(sampleRate) * (sampleBits / 8)),
+    _samplesPerLine(SamplesPerLine(sampleRate)),
+    _sampleBytes(sampleBits / 8),
+    _maxLevel((sampleBits == 16) ? 0xffff : 0xff)
+{
+    _buildTables(sampleRate);
+}
+
+VBISink::~VBISink()
+{
+
+}
+
+unsigned int VBISink::SamplesPerLine(unsigned int sampleRate)
+{
+    return (unsigned int)((uint64_t)sampleRate * VBI_LINE_NS / 1000000000);
+}
+
+void VBISink::_buildTables(unsigned int sampleRate)
+{
+    _firstBit.assign(_samplesPerLine, 0);
+    _lowTable.assign(_samplesPerLine * 16, 0);
+    _highTable.assign(_samplesPerLine * 16, 0);
+
+    double black = VBI_BLACK_LEVEL * _maxLevel;
+    double one = VBI_DATA_LEVEL * _maxLevel;
+    int lastFirstBit = (PACKETSIZE + 1) * 8; // reads only the zero padding after the packet
+
+    for (unsigned int j = 0; j < _samplesPerLine; j++)
+    {
+        double ns = j * 1e9 / sampleRate;
+        int32_t* low = &_lowTable[j * 16];
+        int32_t* high = &_highTable[j * 16];
+
+        if (ns < VBI_SYNC_NS)
+            continue; // sync tip whatever the bits
+
+        double u = (ns - VBI_DATA_START_NS) * 1e-9 * VBI_BIT_RATE - 0.5; // bits from the centre of the first bit
+        int first = (int)std::floor(u) - 3;
+        int padded = first + 8; // there is a byte of padding before the packet
+
+        if (padded < 0 || padded > lastFirstBit)
+        {
+            // too far from the data for any bit to reach
+            for (int n = 0; n < 16; n++)
+                low[n] = std::lround(black);
+            continue;
+        }
+
+        _firstBit[j] = padded;
+        for (int n = 0; n < 16; n++)
+        {
+            double l = black;
+            double h = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                if (n & (1 << i))
+                {
+                    l += one * raisedCosine(u - (first + i));
+                    h += one * raisedCosine(u - (first + 4 + i));
+                }
+            }
+            low[n] = std::lround(l);
+            high[n] = std::lround(h);
+        }
+    }
+}
+
+void VBISink::AddPacket(std::array<uint8_t, PACKETSIZE>* packet, uint16_t line, uint8_t field)
+{
+    (void)field;
+
+    if (line == 0)
+        _endField();
+
+    uint8_t* out = _claim(_samplesPerLine * _sampleBytes);
+    if (!out)
+        return;
+
+    // a zero byte either side of the packet so that every sample can read 8 bits, and one more for reading 16 at a time
+    uint8_t bits[PACKETSIZE + 3];
+    bits[0] = 0;
+    std::memcpy(bits + 1, packet->data(), PACKETSIZE);
+    bits[PACKETSIZE + 1] = 0;
+    bits[PACKETSIZE + 2] = 0;
+
+    const uint16_t* firstBit = _firstBit.data();
+    const int32_t* low = _lowTable.data();
+    const int32_t* high = _highTable.data();
+
+    for (unsigned int j = 0; j < _samplesPerLine; j++, low += 16, high += 16)
+    {
+        unsigned int k = firstBit[j];
+        unsigned int w = (bits[k >> 3] | (bits[(k >> 3) + 1] << 8)) >> (k & 7); // bits are sent least significant first
+        int32_t level = low[w & 0x0f] + high[(w >> 4) & 0x0f];
+        if (level < 0)
+            level = 0;
+        else if (level > _maxLevel)
+            level = _maxLevel;
+
+        if (_sampleBytes == 1)
+        {
+            out[j] = level;
+        }
+        else
+        {
+            out[j * 2] = level & 0xff;
+            out[j * 2 + 1] = level >> 8;
+        }
+    }
+
+    _commit(_samplesPerLine * _sampleBytes);
+}
@@ -0,0 +1,68 @@
+#ifndef _VBISINK_H_
+#define _VBISINK_H_
+
+#include <vector>
+
+#include "outputsink.h"
+
+/**
+ * Output sink for teletext rendered as VBI line waveforms.
+ * Each packet becomes one 64us line of unsigned 8 bit or little endian 16 bit samples,
+ * starting at the leading edge of line sync. The first lines_per_field lines of each
+ * field are VBI lines 7 onwards (320 onwards in the second field).
+ *
+ * Full scale is -300mV to +700mV: sync tip is 0, black is 30% and a teletext 1 is
+ * 462mV above black. The line is black apart from a 4.7us sync pulse and the data,
+ * which starts with the clock run in 10.2us after the sync edge. Colour burst is left
+ * to the playout chain.
+ *
+ * The bits are sent at 6.9375 Mbit/s, least significant bit of each byte first, and
+ * shaped with a raised cosine of 60% roll off so that they fit in 5.5MHz.
+ * Every sample depends on the 8 nearest bits. Rather than filter at run time, the
+ * weights for every combination of 4 bits are worked out in advance for each sample
+ * position, so a sample costs two table lookups and an add.
+ */
+
+#define VBI_BIT_RATE 6937500.0
+#define VBI_LINE_NS 64000
+#define VBI_SYNC_NS 4700
+#define VBI_DATA_START_NS 10200 // start of the clock run in after the leading edge of line sync
+#define VBI_ROLL_OFF 0.6
+#define VBI_BLACK_LEVEL 0.3 // as a fraction of full scale
+#define VBI_DATA_LEVEL 0.462 // amplitude of a 1 above black
+
+namespace vbit
+{
+    class VBISink : public OutputSink
+    {
+        public:
+            /** Constructor
+             * Parameters as OutputSink plus
+             * @param sampleRate Samples per second
+             * @param sampleBits 8 or 16
+             */
+            VBISink(std::string destination, Backpressure policy, unsigned int bufferFields, uint16_t linesPerField, unsigned int sampleRate, unsigned int sampleBits);
+
+            /** Default destructor */
+            virtual ~VBISink();
+
+            void AddPacket(std::array<uint8_t, PACKETSIZE>* packet, uint16_t line, uint8_t field) override;
+
+            /** @return Number of samples in each 64us line */
+            static unsigned int SamplesPerLine(unsigned int sampleRate);
+
+        private:
+            unsigned int _samplesPerLine;
+            unsigned int _sampleBytes;
+            int32_t _maxLevel;
+
+            std::vector<uint16_t> _firstBit; // for each sample the first of the 8 bits it depends on, counting from the padding before the packet
+            std::vector<int32_t> _lowTable; // for each sample the level given by each combination of the first 4 bits, including black
+            std::vector<int32_t> _highTable; // and what the last 4 bits add to it
+
+            /** Build the lookup tables */
+            void _buildTables(unsigned int sampleRate);
+    };
+}
+
+#endif // _VBISINK_H_
@@ -43,12 +43,32 @@ MasterClock *MasterClock::instance = 0; // initialise MasterClock singleton
 /* Options
  * --dir <path to pages>
  * Sets the pages directory and the location of vbit.conf.
+ * --format <t42|raw|PES|ts|vbi|op47|st2031>
+ * Output format on stdout when there are no --output options.
+ * --output <format>[,option...][:destination]
+ * Send the packets to a destination. May be repeated to feed several outputs at once.
+ * The destination is - for stdout (the default), unix:<path> for a UNIX socket, or a file or fifo.
+ * shm:<name> publishes fields into a POSIX shared memory ring of buffer=<fields> fields that any
+ * number of local readers can map. See shmring.h and tools/shmreader.h.
+ * Options are reverse (t42 only), block (the default) to wait for a slow destination,
+ * drop to discard whole fields instead, and buffer=<fields> to set how far a dropping output may fall behind.
+ * vbi output takes rate=<samples per second> (default 13500000) and bits=<8|16> (default 8). See vbisink.h.
+ * op47 and st2031 output SDI ancillary data packets a frame at a time. See ancsink.h.
+ * --pid <pid>
+ * PID of the teletext in ts output.
+ *
+ * Subtitle services are set with subtitle_services in vbit.conf. Each one takes Newfor on its own command port.
+ * subtitle_file plays out a SubRip or EBU-STL file on a page of its own.
+ * page_upload_socket takes pages and rows from a local client in binary. See pageupload.h.
  */
 
 int main(int argc, char** argv)
 {
     #ifdef WIN32
     _setmode(_fileno(stdout), _O_BINARY); // set stdout to binary mode stdout to avoid pesky line ending conversion
+    #else
+    signal(SIGPIPE, SIG_IGN); // an output that goes away is closed by its sink instead of stopping everything
+    signal(SIGUSR1, Service::RequestReport); // log the output report now
     #endif
     /// @todo option of adding a non standard config path
     Configure *configure=new Configure(argc, argv);
@@ -58,17 +78,34 @@ int main(int argc, char** argv)
 
     std::thread monitorThread(&FileMonitor::run, FileMonitor(configure, pageList));
     std::thread serviceThread(&Service::run, svc);
+    std::thread writerThread(&PageWriter::run, pageList->GetPageWriter());
 
+    std::vector<std::thread> commandThreads;
     if (configure->GetCommandPortEnabled())
     {
-        // only start command thread if required
-        std::thread commandThread(&Command::run, Command(configure, svc->GetSubtitle(), pageList) );
-        commandThread.join();
+        // only start command threads if required. Each subtitle service has its own port
+        std::vector<PacketSubtitle*> subtitles=svc->GetSubtitles();
+        std::vector<Configure::SubtitleServiceSpec> services=configure->GetSubtitleServices();
+        for (unsigned int i=0; i<services.size(); i++) // a subtitle file comes after these and takes no commands
+        {
+            commandThreads.push_back(std::thread(&Command::run, Command(configure, subtitles[i], pageList, services[i].port)));
+        }
+    }
+    
+    if (!configure->GetPageUploadSocket().empty())
+    {
+        commandThreads.push_back(std::thread(&PageUpload::run, PageUpload(configure, pageList)));
+    }
+    
+    for (unsigned int i=0; i<commandThreads.size(); i++)
+    {
+        commandThreads[i].join();
     }
 
     // The threads should never stop, but just in case...
     monitorThread.join();
     serviceThread.join();
+    writerThread.join();
 
     return 0;
 }
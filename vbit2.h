@@ -3,11 +3,13 @@
 
 #include <iostream>
 #include <thread>
+#include <csignal>
 #include "service.h"
 #include "configure.h"
 #include "pagelist.h"
 #include "filemonitor.h"
 #include "command.h"
+#include "pageupload.h"
 
 #ifdef WIN32
 #include "fcntl.h"
@@ -26,10 +28,22 @@ namespace vbit
             void SetMasterClock(time_t t){_masterClock = t;}
             time_t GetMasterClock(){return _masterClock;}
             
+            /* monotonic count of fields generated since startup. Stepped by Service at the start of each field */
+            void IncrementFieldCount(){_fieldCount++;}
+            uint64_t GetFieldCount(){return _fieldCount;}
+            
+            /* field 0..49 within the master clock second. Set by Service at the start of each field */
+            void SetField(uint8_t field){_field = field;}
+            
+            /* field clock: master clock seconds * 50 + field. Timed events such as subtitle cues are released against this */
+            uint64_t GetFieldTime(){return (uint64_t)_masterClock * 50 + _field;}
+            
         private:
-            MasterClock(){_masterClock = 0;}; // initialise master clock to unix epoch, it will be set when run() starts generating packets
+            MasterClock(){_masterClock = 0; _fieldCount = 0; _field = 0;}; // initialise master clock to unix epoch, it will be set when run() starts generating packets
             static MasterClock *instance;
             time_t _masterClock;
+            uint64_t _fieldCount;
+            uint8_t _field;
     };
 }
 